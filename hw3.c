@@ -36,15 +36,253 @@
 
 typedef unsigned char UCHAR;
 typedef unsigned int UINT;
+typedef unsigned short WORD;
+typedef unsigned long long UINT64;
 
 
 
 #define MEM_SIZE 0x0FFF // memory size
 #define END_OF_ARG 0xFFFF // end of argument
+#define OUT_SIZE 0x10000 // output buffer size
+#define IN_ADDRS 8 // max # of input numbers recorded (WCET, USE_PEEPHOLE)
+#define STACK_END 0x0100 // end of stack area
 
 
 
+#ifndef USE_DIRTY_PAGES
+#define USE_DIRTY_PAGES 1 // 1: reset only memory pages written since last reset
+#endif
+#define PAGE_SIZE 0x0100 // page size for dirty tracking
+#define N_PAGES ((MEM_SIZE + PAGE_SIZE - 1) / PAGE_SIZE)
+
+
+
+#ifndef WORD_MEM
+#define WORD_MEM 0 // 1: memory holds native 16-bit words, byte order fixed at the edges
+#endif
+#if WORD_MEM && !(defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define BYTE_SWAP 1 // guest byte at addr is host byte at addr ^ 1
+#else
+#define BYTE_SWAP 0
+#endif
+
+
+
+#ifndef BANKS
+#define BANKS 16 // # of data banks for BNK/LDB/STB (0: none), e.g. 1024 for 4 MB
+#endif
+#define BANK_SIZE 0x1000 // bank size (12-bit address)
+
+
+
+#ifndef USE_GUARD_PAGES
+#if defined(__unix__) || defined(__APPLE__)
+#define USE_GUARD_PAGES 1 // 1: memory between PROT_NONE pages, overrun is a guest fault
+#else
+#define USE_GUARD_PAGES 0
+#endif
+#endif
+
+
+
+#ifndef RET_STACK
+#define RET_STACK 1 // 1: return addresses in a separate stack, not in guest memory
+#endif
+#ifndef RET_MIRROR
+#define RET_MIRROR 0 // 1: also write the return stack to mem[0] ~ for programs that read it
+#endif
+#ifndef RET_DEPTH
+#define RET_DEPTH (STACK_END / 2) // max call depth
+#endif
+#define STACK_IN_MEM (!RET_STACK || RET_MIRROR) // return addresses visible in mem[]
+#ifndef RUN_STATS
+#define RUN_STATS 0 // 1: print [RUN] (instructions, return stack, max call depth) at exit
+#endif
+
+
+
+#ifndef WORKLOAD
+#define WORKLOAD 0 // 0: prime list with MUL loops, 1: prime list with DIV/MOD/CMP, 2: sieve, 3: banked sieve,
+                   // 4: prime list with the runtime library (no DIV/MOD)
+#endif
+#ifndef LIST_CODE
+#define LIST_CODE 0 // 1: print disassembly of CODE section after loading
+#endif
+#ifndef ASM_FILE
+#define ASM_FILE "" // assembler source to load instead of WORKLOAD (e.g. written by minicc)
+#endif
+#define ASM_SYMS 1024 // # of assembler labels
+#define ASM_SIZE 0x20000 // max bytes of ASM_FILE
+#define ASM_BOUNDS 32 // # of .bound loop annotations
+#if WORKLOAD == 3 && BANKS < 16
+#error "WORKLOAD 3 needs BANKS >= 16"
+#endif
+
+
+
+#ifndef BATCH_MODE
+#define BATCH_MODE 0 // 1: repeat load-input-run until end of input
+#endif
+
+
+
+#ifndef USE_RESULT_CACHE
+#define USE_RESULT_CACHE 0 // 1: reuse results of identical runs
+#endif
+#define CACHE_FILE "acccom.cache" // result cache file
+#define CACHE_SLOTS 64 // # of result cache entries
+
+
+
+#ifndef USE_MEMO
+#define USE_MEMO 0 // 1: skip CALs of pure subroutines with known inputs
+#endif
+#define MEMO_SLOTS 16384 // # of recorded calls
+#define MEMO_SUBS 64 // # of subroutines
+#define MEMO_DEPTH 16 // max nesting of recorded calls
+#define MEMO_SET 16 // max read/write set size of a call
+#define MEMO_STACK 16 // max stack words pushed by nested calls
+#define MEMO_TRIAL 4096 // # of calls before a subroutine without hits is dropped
+
+
+
+#ifndef USE_LOOP_ACCEL
+#define USE_LOOP_ACCEL 0 // 1: run simple loops over DATA words natively
+#endif
+#define LOOP_SLOTS 64 // # of analyzed loops
+#define LOOP_OPS 32 // max # of instructions in a loop
+#define LOOP_VARS 8 // max # of DATA words used by a loop
+
+
+
+#ifndef BUS_TIMING
+#define BUS_TIMING 0 // 1: count bus cycles per phase and instruction class
+#endif
+#ifndef BUS_LATENCY
+#define BUS_LATENCY 3 // cycles per bus transfer
+#endif
+#ifndef BUS_WIDTH
+#define BUS_WIDTH 2 // bytes per bus transfer (1 or 2)
+#endif
+#ifndef EXEC_CYCLES
+#define EXEC_CYCLES 1 // internal cycles of an instruction
+#endif
+#ifndef MULDIV_CYCLES
+#define MULDIV_CYCLES 8 // internal cycles of MUL/DIV/MOD
+#endif
+#if BUS_TIMING && (USE_MEMO || USE_LOOP_ACCEL || USE_RESULT_CACHE)
+#error "BUS_TIMING counts interpreted instructions only"
+#endif
+#if BUS_WIDTH != 1 && BUS_WIDTH != 2
+#error "BUS_WIDTH must be 1 or 2"
+#endif
+
+
+
+#ifndef WCET
+#define WCET 0 // 1: static worst-case instructions/cycles, checked against the runs
+#endif
+#ifndef WCET_RUNS
+#define WCET_RUNS 0 // > 0: run with this many random inputs instead of reading them
+#endif
+#ifndef WCET_IN_MIN
+#define WCET_IN_MIN 0 // range of inputs assumed by the analysis (and of random inputs)
+#endif
+#ifndef WCET_IN_MAX
+#define WCET_IN_MAX 1000
+#endif
+#define WCET_NODES 1024 // max # of analyzed instructions
+#define WCET_SUBS 64 // max # of subroutines
+#define WCET_LOOPS 64 // max # of loops in a subroutine
+#define WCET_EXITS 16 // max # of exit edges of a loop
+#define WCET_WIDEN 4 // # of changes before a value range is widened
+#define WCET_CTX 16 // max # of words narrowed at the entry of a subroutine
+#if WCET && !BUS_TIMING
+#error "WCET needs BUS_TIMING for the measured cycles"
+#endif
+
+
+
+#ifndef USE_PEEPHOLE
+#define USE_PEEPHOLE 0 // 1: optimize the CODE section after input, before each run
+#endif
+#ifndef PEEP_CHECK
+#define PEEP_CHECK 1 // 1: with USE_PEEPHOLE, also run the original code quietly and compare
+#endif
+#define PEEP_INSTS 1024 // max # of instructions in the CODE section
+#if USE_PEEPHOLE && PEEP_CHECK && (USE_MEMO || USE_LOOP_ACCEL || USE_RESULT_CACHE || BUS_TIMING)
+#error "PEEP_CHECK runs the original code without memo, loop, cache or bus state"
+#endif
+#if USE_PEEPHOLE && WCET
+#error "WCET loop bounds refer to the addresses of the original code"
+#endif
+#ifndef PEEP_RULES
+#define PEEP_RULES 1 // 1: with USE_PEEPHOLE, also apply the rewrite rules in RULE_FILE
+#endif
+#ifndef PEEP_EDGES
+#define PEEP_EDGES 0 // 1: also apply rules verified on boundary values only (flag edges)
+#endif
+#define RULE_FILE "acccom.rules" // rewrite rule database (written by SUPEROPT)
+#define RULE_LEN 5 // max # of instructions in a rule
+#define RULES 16384 // max # of rules
+
+
+
+#ifndef SUPEROPT
+#define SUPEROPT 0 // 1: search short sequences for rewrite rules, write RULE_FILE and exit
+#endif
+#ifndef SOPT_LEN
+#define SOPT_LEN 4 // max # of instructions in a target sequence
+#endif
+#ifndef SOPT_VARS
+#define SOPT_VARS 2 // # of variable words in the DATA footprint
+#endif
+#define SOPT_CONSTS 0, 1, 2 // values of the constant words in the DATA footprint
+#define SOPT_TESTS 16 // # of states of a fingerprint
+#define SOPT_RUNS 64 // # of random states run on the interpreter per candidate
+#define SOPT_SAMPLES 65536 // # of random states after the boundary values of two or more inputs
+#define SOPT_TABLE (1 << 21) // # of fingerprint table entries
+#if SUPEROPT && (SOPT_LEN > RULE_LEN || SOPT_VARS > 4)
+#error "SOPT_LEN must be <= RULE_LEN and SOPT_VARS <= 4"
+#endif
+#if SUPEROPT && (USE_MEMO || USE_LOOP_ACCEL || USE_RESULT_CACHE || WCET)
+#error "SUPEROPT runs plain sequences on the interpreter"
+#endif
+
+
+
+#if USE_RESULT_CACHE || USE_GUARD_PAGES
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#if USE_RESULT_CACHE
+#include <fcntl.h>
+#include <sys/file.h>
+#endif
+#if USE_GUARD_PAGES
+#include <signal.h>
+#include <setjmp.h>
+#endif
+
+
+
+#if USE_GUARD_PAGES
+UCHAR *mem; // memory image (between guard pages)
+UCHAR *mem_map; // mapped area including guard pages
+size_t mem_map_size; // size of mem_map
+sigjmp_buf fault_jmp; // where runProgram() handles a memory fault
+volatile sig_atomic_t fault_armed = 0; // 1: in runProgram()
+long fault_addr; // guest address of the fault
+#elif WORD_MEM
+WORD mem_buf[MEM_SIZE / 2 + 1]; // memory image (word aligned)
+UCHAR *mem = (UCHAR *)mem_buf;
+#else
 UCHAR mem[MEM_SIZE]; // memory image
+#endif
+#if USE_DIRTY_PAGES
+UCHAR mem_dirty[N_PAGES + 1]; // 1: page written since last reset
+int mem_clean = 0; // 1: mem[] is all zero except dirty pages
+#endif
 
 
 
@@ -55,7 +293,11 @@ UINT code_end; // end address of CODE section
 
 
 
-int tos = 0; // top of stack
+int tos = 0; // top of stack (byte offset, 2 per return address)
+int tos_max = 0; // max tos reached
+#if RET_STACK
+WORD ret_stk[RET_DEPTH]; // return address stack
+#endif
 
 
 
@@ -69,10 +311,44 @@ int tos = 0; // top of stack
 
 
 
+#if WORD_MEM
+
+// Read a word data at odd address (two host words)
+
+UINT readWordOdd(UINT addr) {
+    return (mem[addr ^ BYTE_SWAP] << 8) | mem[(addr + 1) ^ BYTE_SWAP];
+}
+
+
+
+// Write a word data at odd address (two host words)
+
+void writeWordOdd(UINT addr, UINT data) {
+    mem[addr ^ BYTE_SWAP] = (UCHAR)((data & 0xFF00) >> 8);
+    mem[(addr + 1) ^ BYTE_SWAP] = (UCHAR)(data & 0x00FF);
+}
+
+#endif
+
+
+
 // Read a word data from memory
 
 UINT readWord(UINT addr) {
+#if WORD_MEM
+    if (addr & 1) return readWordOdd(addr);
+    return *(WORD *)&mem[addr];
+#else
     return (mem[addr] << 8) | mem[addr + 1];
+#endif
+}
+
+
+
+// Read a byte data from memory
+
+UINT readByte(UINT addr) {
+    return mem[addr ^ BYTE_SWAP];
 }
 
 
@@ -80,8 +356,190 @@ UINT readWord(UINT addr) {
 // Write a word data to memory
 
 void writeWord(UINT addr, UINT data) {
+#if WORD_MEM
+    if (addr & 1) writeWordOdd(addr, data);
+    else *(WORD *)&mem[addr] = (WORD)data;
+#else
     mem[addr] = (UCHAR)((data & 0xFF00) >> 8);
     mem[addr + 1] = (UCHAR)(data & 0x00FF);
+#endif
+#if USE_DIRTY_PAGES
+    mem_dirty[addr / PAGE_SIZE] = 1;
+    mem_dirty[(addr + 1) / PAGE_SIZE] = 1;
+#endif
+}
+
+
+
+#if USE_GUARD_PAGES
+
+// SIGSEGV/SIGBUS handler
+
+// - access to a guard page: back to runProgram() as a guest fault
+
+void memFault(int sig, siginfo_t *si, void *ctx) {
+    UCHAR *p = (UCHAR *)si->si_addr;
+    (void)ctx;
+    if (fault_armed && p >= mem_map && p < mem_map + mem_map_size) {
+        fault_armed = 0;
+        fault_addr = (long)(p - mem) ^ BYTE_SWAP;
+        siglongjmp(fault_jmp, 1);
+    }
+    signal(sig, SIG_DFL); // host bug: crash as usual
+}
+
+
+
+// Allocate memory between two PROT_NONE guard pages
+
+// - addresses are at most 12 bits, so an overrun hits the guard page
+
+//   before any host memory; readWord()/writeWord() need no check
+
+void initMemory() {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = (MEM_SIZE + page - 1) / page * page;
+    struct sigaction sa;
+
+    mem_map_size = size + 2 * page;
+    mem_map = (UCHAR *)mmap(NULL, mem_map_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem_map == MAP_FAILED || mprotect(mem_map + page, size, PROT_READ | PROT_WRITE) != 0) {
+        printf("Error: Memory allocation");
+        exit(-1);
+    }
+    mem = mem_map + page;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = memFault;
+    sa.sa_flags = SA_SIGINFO;
+    sigaction(SIGSEGV, &sa, NULL);
+    sigaction(SIGBUS, &sa, NULL);
+}
+
+#endif
+
+
+
+#if BANKS
+
+//========================================
+
+// Data Banks
+
+// - BNK selects one of BANKS banks, LDB/STB access it
+
+// - home memory (stack, DATA, CODE) is not banked
+
+//========================================
+
+UCHAR *bank_base; // all banks
+UCHAR *bank_mem; // selected bank
+UINT bank = 0; // bank-select register
+UCHAR bank_dirty[BANKS]; // 1: selected since last reset
+
+
+
+// Allocate data banks (zero filled)
+
+void initBanks() {
+    bank_base = (UCHAR *)calloc((size_t)BANKS * BANK_SIZE + 2, 1); // + word at last address
+    if (bank_base == NULL) {
+        printf("Error: Memory allocation");
+        exit(-1);
+    }
+    bank_mem = bank_base;
+}
+
+
+
+// Select bank b
+
+// - return 0 if there is no bank b
+
+int selectBank(UINT b) {
+    if (b >= BANKS) return 0;
+    bank = b;
+    bank_mem = bank_base + (size_t)b * BANK_SIZE;
+    bank_dirty[b] = 1;
+    return 1;
+}
+
+
+
+// Read a word data from selected bank
+
+UINT readBankWord(UINT addr) {
+#if WORD_MEM
+    if (addr & 1) return (bank_mem[addr ^ BYTE_SWAP] << 8) | bank_mem[(addr + 1) ^ BYTE_SWAP];
+    return *(WORD *)&bank_mem[addr];
+#else
+    return (bank_mem[addr] << 8) | bank_mem[addr + 1];
+#endif
+}
+
+
+
+// Write a word data to selected bank
+
+void writeBankWord(UINT addr, UINT data) {
+#if WORD_MEM
+    if (addr & 1) {
+        bank_mem[addr ^ BYTE_SWAP] = (UCHAR)((data & 0xFF00) >> 8);
+        bank_mem[(addr + 1) ^ BYTE_SWAP] = (UCHAR)(data & 0x00FF);
+    }
+    else *(WORD *)&bank_mem[addr] = (WORD)data;
+#else
+    bank_mem[addr] = (UCHAR)((data & 0xFF00) >> 8);
+    bank_mem[addr + 1] = (UCHAR)(data & 0x00FF);
+#endif
+}
+
+
+
+// Clear banks selected since last reset
+
+void resetBanks() {
+    UINT b;
+    for (b = 0; b < BANKS; b++) {
+        if (bank_dirty[b]) {
+            memset(bank_base + (size_t)b * BANK_SIZE, 0, BANK_SIZE + 2);
+            bank_dirty[b] = 0;
+        }
+    }
+}
+
+#endif
+
+
+
+// Reset whole memory to zero
+
+// - with dirty tracking only pages written since last reset are cleared
+
+void resetMemory() {
+#if BANKS
+    resetBanks();
+#endif
+#if USE_DIRTY_PAGES
+    UINT i;
+    UINT size;
+
+    if (!mem_clean) {
+        memset(mem, 0, MEM_SIZE);
+        memset(mem_dirty, 0, sizeof(mem_dirty));
+        mem_clean = 1;
+        return;
+    }
+    for (i = 0; i < N_PAGES; i++) {
+        if (mem_dirty[i]) {
+            size = (i == N_PAGES - 1) ? MEM_SIZE - i * PAGE_SIZE : PAGE_SIZE;
+            memset(&mem[i * PAGE_SIZE], 0, size);
+            mem_dirty[i] = 0;
+        }
+    }
+#else
+    memset(mem, 0, MEM_SIZE);
+#endif
 }
 
 
@@ -151,28 +609,62 @@ UINT cint2accnum(int i) {
 
 
 
+#if WCET || USE_PEEPHOLE
+UINT in_addr[IN_ADDRS]; // addresses of input numbers
+int n_in_addr = 0; // # of input numbers
+#endif
+
+
+
 // Scan a number and write to memory
 
-void inputNumber(char* msg, UINT addr) {
-    int n;
+// - return 0 at end of input
+
+// - WCET_RUNS: a random number in WCET_IN_MIN ~ WCET_IN_MAX instead
+
+int inputNumber(char* msg, UINT addr) {
+    int n = 0;
+    int ok;
+#if WCET || USE_PEEPHOLE
+    int i;
+    for (i = 0; i < n_in_addr && in_addr[i] != addr; i++);
+    if (i == n_in_addr && i < IN_ADDRS) in_addr[n_in_addr++] = addr;
+#endif
     printf("%s", msg);
-    scanf("%d", &n);
+#if WCET_RUNS
+    n = WCET_IN_MIN + rand() % (WCET_IN_MAX - WCET_IN_MIN + 1);
+    printf("%d\n", n);
+    ok = 1;
+#else
+    ok = (scanf("%d", &n) == 1);
+#endif
     writeWord(addr, cint2accnum(n));
+    return ok;
 }
 
 
 
 // stack push function
 
-// - stack area: mem[0] ~ mem[0x00FF]
+// - stack area: ret_stk[] (RET_STACK) or mem[0] ~ mem[STACK_END - 1]
 
 void push(UINT addr) {
-    if (tos == 0x00FFFF) {
+#if RET_STACK
+    if (tos == RET_DEPTH * 2) {
+#else
+    if (tos == STACK_END) {
+#endif
         printf("Error: Stack full");
         exit(-1);
     }
+#if RET_STACK
+    ret_stk[tos >> 1] = (WORD)addr;
+#endif
+#if STACK_IN_MEM
     writeWord(tos, addr);
+#endif
     tos += 2;
+    if (tos > tos_max) tos_max = tos;
 }
 
 
@@ -185,410 +677,5159 @@ UINT pop() {
         exit(-1);
     }
     tos -= 2;
+#if RET_STACK
+    return ret_stk[tos >> 1];
+#else
     return readWord(tos);
+#endif
 }
 
 
 
 //========================================
 
-// Load AccCom program to memory
-
-// - return start address of program
+// Assembler / Disassembler
 
-//========================================
+// - one instruction or directive per line, ';' starts a comment
 
-UINT loadProgram() {
+// - operand: label, hex address or 'c' (PRC)
 
-    // reset whole memory
+// - addressing mode: addr,X (indexed), (addr) (indirect), (addr),X
 
-    memset(mem, 0, MEM_SIZE);
+//   any instruction with an address operand is assembled to F form
 
+//   with a mode other than absolute
 
+// - .data addr / .code addr: start of DATA / CODE section
 
-    /*
+// - label: .word n: AccCom number n
 
-    A=7 // input data
+// - .bound n: the loop headed by the next instruction repeats at most n times
 
-    B=-5 // input data
+//   (back edges per entry, used by the WCET analysis)
 
-    X // result
+//========================================
 
-    10 // constant 10
+typedef struct {
+    char *name; // mnemonic
+    UINT code; // instruction word without operand
+    int arg; // 0: none, 1: address, 2: address in next word
+} ASM_OP;
+
+ASM_OP asm_op[] = {
+    {"LDA", 0x1000, 1}, {"STA", 0x2000, 1}, {"ADD", 0x3000, 1}, {"SUB", 0x4000, 1},
+    {"JMP", 0x5000, 1}, {"CAL", 0x6000, 1}, {"MUL", 0x7000, 1},
+    {"HLT", 0x8000, 0}, {"IAC", 0x8002, 0}, {"INX", 0x8003, 0}, {"RET", 0x8005, 0},
+    {"BRZ", 0x9000, 1}, {"BRN", 0xA000, 1},
+    {"PRT", 0xB000, 1}, {"PRC", 0xC000, 1}, {"PRS", 0xD000, 1},
+    {"CMP", 0xE000, 1},
+    {"DIV", 0xF010, 2}, {"MOD", 0xF011, 2}, {"LDX", 0xF020, 2}, {"STX", 0xF021, 2},
+    {"BNK", 0xF030, 2}, {"LDB", 0xF031, 2}, {"STB", 0xF032, 2},
+    {NULL, 0, 0}
+};
+
+typedef struct {
+    char name[16];
+    UINT addr;
+} ASM_SYM;
 
-    "X=" // constant "X="
+ASM_SYM asm_sym[ASM_SYMS]; // labels
+int asm_n_sym = 0; // # of labels
 
+typedef struct {
+    UINT addr; // loop header
+    UINT n; // max # of repeats
+} ASM_BOUND;
 
+ASM_BOUND asm_bound[ASM_BOUNDS]; // .bound annotations
+int asm_n_bound = 0; // # of annotations
 
-    X = A*B
 
-    X = X + 10
 
-    print("X=", X, '\n')
+// Find a label
 
-    */
+// - return address, or END_OF_ARG if not defined
 
+UINT asmSymbol(const char *name) {
+    int i;
+    for (i = 0; i < asm_n_sym; i++) {
+        if (strcmp(asm_sym[i].name, name) == 0) return asm_sym[i].addr;
+    }
+    return END_OF_ARG;
+}
 
 
-    // DATA section ----------------------------------------
 
+// Bound the loop headed at addr to n repeats, as .bound does
 
+// - for raw images, and for bounds that follow the inputs of the analysis
 
-    data_end = writeWords(data_bgn =
-                                  0x0100, 0x0000, // 0100: a = 0
-                          0x0000, // 0102: b= 0
-                          0x0000, // 0104: n
-                          0x0000, // 0106: flag
-                          0x0000, // 0108: flag_div
-                          0x0001, // 010A: i = 1
-                          0x0001,//  010C: j = 1
-                          0x0000, // 010E: div
-                          0x0000, // 0110: prime
-                          0x0001, // 0112: true = 1
-                          0x0000, // 0114: false = 0
-                          0x0002, // 0116: init = 2
-                          0x0001, // 0118: one = 1
-                          0x0000, // 011A: condition
-                          END_OF_ARG);
+void asmBound(UINT addr, UINT n) {
+    int i;
+    for (i = 0; i < asm_n_bound && asm_bound[i].addr != addr; i++);
+    if (i == ASM_BOUNDS) {
+        printf("Error: too many loop bounds\n");
+        exit(-1);
+    }
+    if (i == asm_n_bound) asm_n_bound++;
+    asm_bound[i].addr = addr;
+    asm_bound[i].n = n;
+}
 
 
 
-    // CODE section ----------------------------------------
+// Largest input assumed by the WCET analysis, for a program that caps it at max
 
+UINT asmInMax(UINT max) {
+    if (WCET_IN_MAX < 0) return 0;
+    return ((UINT)WCET_IN_MAX < max) ? (UINT)WCET_IN_MAX : max;
+}
 
 
-    code_end = writeWords(code_bgn =
-                                  //#isDivisor
-                                  0x0200,0x1118, // 0200: LDA one
-                                  0x210C, // 0202: STA j
-                                  0x710E, // 0204: MUL div
-                          0x211A, // 0206: STA condition
-                          0x1104, // 0208: LDA n
-                          0x411A, // 020A: SUB condition
-                          0xA226, // 020C: BRN 226
-                          0x1102, // 020E: LDA n
-                          0x411A, // 0210: SUB condition
-                          0x9218, // 0212: BRZ 218
-                          0x1112, // 0214: LDA true
-                          0x2108, // 0216: STA flag_div
-                          0x110C, // 0218: LDA j
-                          0x8002, // 021A: IAC
-                          0x210C, // 021C: STA j
-                          0x110C, // 021E: LDA j
-                          0x710E, // 0220: MUL div
-                          0x211A, // 0222: STA condition
-                          0x5208, // 0224: JMP 208
-                          0x8005, // 0226: RET
-                                //#isPrime
-                          0x110A, // 0228: LDA i
-                          0x8002, // 022A: IAC
-                          0x210E, // 022C: STA div
-                          0x1104, // 022E: LDA n
-                          0x4118, // 0230: SUB one
-                          0x2110, // 0232: STA Prime
-                          0x1110, // 0234: LDA Prime
-                          0x410E, // 0236: SUB div
-                          0xA254, // 0238: BRN 254
-                          0x1114, // 023A: LDA false
-                          0x2108, // 023C: STA flag_div
-                          0x6200, // 023E: cal #isDivisor
-                          0x1108, // 0240: LDA flag_div
-                          0x4112, // 0242: SUB true
-                          0x924C, // 0244: BRZ 24C
-                          0x1112, // 0246: LDA true
-                          0x2106, // 0248: STA flag
-                          0x8005, // 024A: RET
-                          0x110E, // 024C: LDA div
-                          0x8002, // 024E: IAC
-                          0x210E, // 0250: STA div
-                          0x5234, // 0252: JMP 234
-                          0x8005, // 0254: RET
-                                //main
-                          0x1100, //0256: LDA a
-                          0x2104, //0258: STA n
-                          0x1116, //025A: LDA init
-                          0x4100, //025C: SUB a
-                          0xA264, //025E: BRN 264
-                          0x1116, //0260: LDA init
-                          0x2104, //0262: STA n
-                          0x1102, //0264: LDA b
-                          0x4104, //0266: SUB n
-                          0xA282, //0268: BRN 282
-                          0x1114, //026A: LDA false
-                          0x2106, //026C: STA flag
-                          0x6228, //026E: cal #isPrime
-                          0x1106, //0270: LDA flag
-                          0x4114, //0272: SUB false
-                          0xA27A, //0274: BRZ 27A
-                          0xB104, //0276: PRC (n)
-                          0xC00A, //0278: PRC '\n'
-                          0x1104, //027A: LDA n
-                          0x8002, //027C: IAC
-                          0x2104, //027E: STA n
-                          0x5264, //0280: JMP 264
-                          0x8000, //0282: HLT
-                          END_OF_ARG);
 
+// Repeats of "d = 2, 3, ... while d * d <= n" for n <= max
 
+UINT asmRootBound(UINT max) {
+    UINT d = 2;
+    while (d * d <= max) d++;
+    return d - 2;
+}
 
-    // -----------------------------------------------------
 
-    // print memory for verify
 
-    printMemory("DATA", data_bgn, data_end);
-    printMemory("CODE", code_bgn, code_end);
+// Repeats of "m = 4, 6, ... while m <= n" (multiples of 2 from 2 * 2) for n <= max
 
-    return 0x0256; // return start address of program
+UINT asmHalfBound(UINT max) {
+    return (max < 4) ? 0 : (max - 4) / 2;
 }
 
 
 
-//========================================
-
-// Keyboard input for specific variables
+// Get an operand value
 
-//========================================
+UINT asmOperand(const char *tok, int pass, int line) {
+    UINT addr;
+    char *end;
 
-void inputData() {
-    // print problem summary
-    printf("square list of A to B\n");
-    // input data
-    inputNumber("0100: A = ", 0x0100);
-    inputNumber("0102: B = ", 0x0102);
-    // print DATA section for verify
-    printMemory("DATA", data_bgn, data_end);
+    if (tok == NULL) {
+        printf("Error: line %d: operand missing\n", line);
+        exit(-1);
+    }
+    if (tok[0] == '\'') {
+        if (tok[1] == '\\') return tok[2] == 'n' ? '\n' : tok[2] == 't' ? '\t' : (UCHAR)tok[2];
+        return (UCHAR)tok[1];
+    }
+    addr = asmSymbol(tok);
+    if (addr != END_OF_ARG) return addr;
+    addr = (UINT)strtoul(tok, &end, 16);
+    if (*end == '\0') return addr;
+    if (pass == 2) {
+        printf("Error: line %d: undefined label %s\n", line, tok);
+        exit(-1);
+    }
+    return 0;
 }
 
 
 
-//========================================
-
-// Definitions and Functions
-
-// for runProgram()
-
-//========================================
+// Assemble source to memory, set DATA and CODE section addresses
 
+void assemble(const char *src) {
+    char buf[128];
+    char *tok, *p;
+    const char *s;
+    UINT addr, code, mode, a;
+    int pass, line, i;
 
+    asm_n_sym = 0;
+    asm_n_bound = 0;
+    for (pass = 1; pass <= 2; pass++) {
+        addr = 0;
+        line = 0;
+        for (s = src; *s != '\0'; ) {
+            // next line without comment
+            for (i = 0; *s != '\0' && *s != '\n'; s++) {
+                if (i < (int)sizeof(buf) - 1) buf[i++] = *s;
+            }
+            if (*s == '\n') s++;
+            buf[i] = '\0';
+            line++;
+            for (p = buf; *p != '\0'; p++) {
+                if (*p == '\'' && p[1] != '\0' && p[2] != '\0') p += (p[1] == '\\') ? 3 : 2;
+                else if (*p == ';') {
+                    *p = '\0';
+                    break;
+                }
+            }
+
+            tok = strtok(buf, " \t\r,");
+            if (tok == NULL) continue;
+            if (tok[strlen(tok) - 1] == ':') {
+                tok[strlen(tok) - 1] = '\0';
+                if (pass == 1) {
+                    if (asm_n_sym == ASM_SYMS || strlen(tok) >= sizeof(asm_sym[0].name)) {
+                        printf("Error: line %d: too many labels\n", line);
+                        exit(-1);
+                    }
+                    strcpy(asm_sym[asm_n_sym].name, tok);
+                    asm_sym[asm_n_sym++].addr = addr;
+                }
+                tok = strtok(NULL, " \t\r,");
+                if (tok == NULL) continue;
+            }
+
+            if (strcmp(tok, ".data") == 0) {
+                data_bgn = addr = asmOperand(strtok(NULL, " \t\r,"), pass, line);
+                continue;
+            }
+            if (strcmp(tok, ".code") == 0) {
+                data_end = addr;
+                code_bgn = addr = asmOperand(strtok(NULL, " \t\r,"), pass, line);
+                continue;
+            }
+            if (strcmp(tok, ".bound") == 0) {
+                tok = strtok(NULL, " \t\r,");
+                if (pass == 2) {
+                    if (asm_n_bound == ASM_BOUNDS || tok == NULL) {
+                        printf("Error: line %d: bad .bound\n", line);
+                        exit(-1);
+                    }
+                    asm_bound[asm_n_bound].addr = addr;
+                    asm_bound[asm_n_bound++].n = (UINT)atoi(tok);
+                }
+                continue;
+            }
+            if (strcmp(tok, ".word") == 0) {
+                tok = strtok(NULL, " \t\r,");
+                if (pass == 2) writeWord(addr, cint2accnum(tok ? atoi(tok) : 0));
+                addr += 2;
+                continue;
+            }
+
+            for (i = 0; asm_op[i].name != NULL && strcmp(asm_op[i].name, tok) != 0; i++);
+            if (asm_op[i].name == NULL) {
+                printf("Error: line %d: unknown instruction %s\n", line, tok);
+                exit(-1);
+            }
+            code = asm_op[i].code;
+            mode = 0;
+            a = 0;
+            if (asm_op[i].arg) {
+                tok = strtok(NULL, " \t\r,");
+                if (tok != NULL && tok[0] == '(' && tok[strlen(tok) - 1] == ')') {
+                    tok[strlen(tok) - 1] = '\0';
+                    tok++;
+                    mode |= 0x0200;
+                }
+                a = asmOperand(tok, pass, line);
+                tok = strtok(NULL, " \t\r,");
+                if (tok != NULL && strcmp(tok, "X") == 0) mode |= 0x0100;
+            }
+            if (mode != 0 && asm_op[i].arg == 1) code = 0xF000 | (code >> 12);
+            if (pass == 2) {
+                if ((code & 0xF000) == 0xF000) {
+                    writeWord(addr, code | mode);
+                    writeWord(addr + 2, a);
+                }
+                else writeWord(addr, code | (a & 0x0FFF));
+            }
+            addr += ((code & 0xF000) == 0xF000) ? 4 : 2;
+        }
+    }
+    code_end = addr;
+}
+
+
+
+// Decode the instruction at addr as runProgram() does
+
+// - op: 0x1000 ~ 0xE000, 0x8xxx (0x8000 with ea END_OF_ARG: computed)
+
+//   or extended operation 0xF0xx
+
+// - ea: effective address (END_OF_ARG: indexed or indirect)
+
+// - base: address operand (END_OF_ARG: indirect)
+
+// - return # of words
+
+int decodeInst(UINT addr, UINT *op, UINT *ea, UINT *base) {
+    UINT ir = readWord(addr);
+    int len = 1;
+
+    *op = ir & 0xF000;
+    *ea = *base = ir & 0x0FFF;
+    if (*op == 0xF000) {
+        len = 2;
+        *base = (ir & 0x0200) ? END_OF_ARG : readWord(addr + 2) & 0x0FFF;
+        *ea = (ir & 0x0100) ? END_OF_ARG : *base;
+        *op = ((ir & 0x00FF) < 0x0010) ? (ir & 0x000F) << 12 : ir & 0xF0FF;
+    }
+    if (*op == 0x8000 && *ea != END_OF_ARG) *op |= *ea;
+    return len;
+}
+
+
+
+// Disassemble an instruction at addr
+
+// - return # of words
+
+int disassemble(UINT addr, char *str) {
+    UINT ir = readWord(addr);
+    UINT op = ir;
+    int i;
+
+    if ((ir & 0xF000) == 0xF000) {
+        // F form: base instruction or extended operation
+        op = ((ir & 0x00FF) < 0x0010) ? (ir & 0x000F) << 12 : ir & 0xF0FF;
+    }
+    for (i = 0; asm_op[i].name != NULL; i++) {
+        ASM_OP *o = &asm_op[i];
+        if (o->arg == 1 ? (op & 0xF000) == o->code : op == o->code) break;
+    }
+
+    if ((ir & 0xF000) == 0xF000) {
+        UINT a = readWord(addr + 2);
+        sprintf(str, (ir & 0x0200) ? "%s (%04X)%s" : "%s %04X%s",
+                asm_op[i].name ? asm_op[i].name : "???", a, (ir & 0x0100) ? ",X" : "");
+        return 2;
+    }
+    if (asm_op[i].name == NULL) sprintf(str, "%04X", ir);
+    else if (asm_op[i].arg == 0) sprintf(str, "%s", asm_op[i].name);
+    else sprintf(str, "%s %03X", asm_op[i].name, ir & 0x0FFF);
+    return 1;
+}
+
+
+
+// Print disassembly of addr1 ~ (addr2 - 1)
+
+void printListing(char *name, UINT addr1, UINT addr2) {
+    UINT addr;
+    char str[32];
+    int n;
+
+    if (name != NULL) printf("[%s]\n", name);
+    for (addr = addr1; addr < addr2; addr += 2*n) {
+        n = disassemble(addr, str);
+        if (n == 2) printf("%04X: %04X %04X  %s\n", addr, readWord(addr), readWord(addr + 2), str);
+        else printf("%04X: %04X       %s\n", addr, readWord(addr), str);
+    }
+}
+
+
+
+//========================================
+
+// AccCom runtime library: DIV, MOD, integer square root and GCD
+
+// for programs that must run on the base ISA (no DIV/MOD)
+
+// - calling convention: arguments in rt_a, rt_b, then CAL rt_div / rt_mod /
+
+//   rt_isqrt / rt_gcd; the result is in rt_res and ACC (PSW set from it)
+
+// - rt_div: rt_res = A / B, rt_rem = A % B (truncated as in C)
+
+//   B = 0: rt_res = 0, rt_rem = A
+
+// - rt_mod: rt_res = rt_rem = A % B
+
+// - rt_isqrt: rt_res = floor(sqrt(A)), 0 for A < 0
+
+// - rt_gcd: rt_res = gcd(|A|, |B|), gcd(0, 0) = 0
+
+// - XR and the rt_ words other than rt_a, rt_b are not preserved
+
+// - RT_DATA goes in the DATA section, RT_CODE in the CODE section
+
+//========================================
+
+#define RT_DATA \
+    "rt_a:   .word 0         ; argument A\n" \
+    "rt_b:   .word 0         ; argument B\n" \
+    "rt_res: .word 0         ; result\n" \
+    "rt_rem: .word 0         ; remainder of rt_div, rt_mod\n" \
+    "rt_ua:  .word 0         ; dividend, then remainder of rt_udiv\n" \
+    "rt_ub:  .word 0         ; divisor of rt_udiv\n" \
+    "rt_q:   .word 0         ; quotient of rt_udiv\n" \
+    "rt_p:   .word 0\n" \
+    "rt_i:   .word 0\n" \
+    "rt_t:   .word 0\n" \
+    "rt_0:   .word 0\n" \
+    "rt_2:   .word 2\n" \
+    "rt_181: .word 181       ; 181 * 181 <= 32767 < 182 * 182\n" \
+    "rt_pow: .word 128       ; bits of a root, 0-terminated\n" \
+    "        .word 64\n" \
+    "        .word 32\n" \
+    "        .word 16\n" \
+    "        .word 8\n" \
+    "        .word 4\n" \
+    "        .word 2\n" \
+    "        .word 1\n" \
+    "        .word 0\n" \
+    "rt_tbl: .word 0         ; divisor * 2^i, i = 0 ~ 14\n" \
+    "        .word 0\n" \
+    "        .word 0\n" \
+    "        .word 0\n" \
+    "        .word 0\n" \
+    "        .word 0\n" \
+    "        .word 0\n" \
+    "        .word 0\n" \
+    "        .word 0\n" \
+    "        .word 0\n" \
+    "        .word 0\n" \
+    "        .word 0\n" \
+    "        .word 0\n" \
+    "        .word 0\n" \
+    "        .word 0\n"
+
+#define RT_CODE \
+    "rt_udiv: LDA rt_ub      ; rt_q = rt_ua / rt_ub, rt_ua %= rt_ub (rt_ua >= 0, rt_ub > 0)\n" \
+    "        STA rt_p\n" \
+    "        LDX rt_0\n" \
+    "        .bound 14       ; rt_ub * 2^14 <= 32767\n" \
+    "rt_up:  STA rt_tbl,X    ; double the divisor while it fits\n" \
+    "        INX\n" \
+    "        LDA rt_ua\n" \
+    "        SUB rt_p\n" \
+    "        CMP rt_p\n" \
+    "        BRN rt_top      ; rt_ua < 2 * rt_p\n" \
+    "        LDA rt_p\n" \
+    "        ADD rt_p\n" \
+    "        STA rt_p\n" \
+    "        JMP rt_up\n" \
+    "rt_top: STX rt_i\n" \
+    "        LDA rt_0\n" \
+    "        STA rt_q\n" \
+    "        .bound 15\n" \
+    "rt_dn:  LDA rt_i        ; subtract back down, one quotient bit each\n" \
+    "        BRZ rt_uret\n" \
+    "        SUB rt_2\n" \
+    "        STA rt_i\n" \
+    "        LDX rt_i\n" \
+    "        LDA rt_q\n" \
+    "        ADD rt_q\n" \
+    "        STA rt_q\n" \
+    "        LDA rt_ua\n" \
+    "        SUB rt_tbl,X\n" \
+    "        BRN rt_dn\n" \
+    "        STA rt_ua\n" \
+    "        LDA rt_q\n" \
+    "        IAC\n" \
+    "        STA rt_q\n" \
+    "        JMP rt_dn\n" \
+    "rt_uret: RET\n" \
+    "rt_div: LDA rt_b\n" \
+    "        BRZ rt_dz\n" \
+    "        BRN rt_nb\n" \
+    "        JMP rt_pb\n" \
+    "rt_nb:  LDA rt_0\n" \
+    "        SUB rt_b\n" \
+    "rt_pb:  STA rt_ub       ; |B|\n" \
+    "        LDA rt_a\n" \
+    "        BRN rt_na\n" \
+    "        STA rt_ua\n" \
+    "        CAL rt_udiv\n" \
+    "        LDA rt_ua\n" \
+    "        STA rt_rem\n" \
+    "        LDA rt_b\n" \
+    "        BRN rt_neg      ; A >= 0, B < 0\n" \
+    "        JMP rt_pos\n" \
+    "rt_na:  LDA rt_0\n" \
+    "        SUB rt_a\n" \
+    "        STA rt_ua       ; |A|\n" \
+    "        CAL rt_udiv\n" \
+    "        LDA rt_0\n" \
+    "        SUB rt_ua\n" \
+    "        STA rt_rem      ; remainder takes the sign of A\n" \
+    "        LDA rt_b\n" \
+    "        BRN rt_pos      ; A < 0, B < 0\n" \
+    "rt_neg: LDA rt_0\n" \
+    "        SUB rt_q\n" \
+    "        STA rt_res\n" \
+    "        RET\n" \
+    "rt_pos: LDA rt_q\n" \
+    "        STA rt_res\n" \
+    "        RET\n" \
+    "rt_dz:  STA rt_res      ; B = 0\n" \
+    "        LDA rt_a\n" \
+    "        STA rt_rem\n" \
+    "        LDA rt_res\n" \
+    "        RET\n" \
+    "rt_mod: CAL rt_div\n" \
+    "        LDA rt_rem\n" \
+    "        STA rt_res\n" \
+    "        RET\n" \
+    "rt_isqrt: LDA rt_0      ; set the bits of the root from 128 down\n" \
+    "        STA rt_res\n" \
+    "        LDA rt_a\n" \
+    "        BRN rt_sret\n" \
+    "        LDX rt_0\n" \
+    "        .bound 8\n" \
+    "rt_sq:  LDA rt_pow,X\n" \
+    "        BRZ rt_sret\n" \
+    "        ADD rt_res\n" \
+    "        STA rt_t        ; candidate root\n" \
+    "        LDA rt_181\n" \
+    "        SUB rt_t\n" \
+    "        BRN rt_snext    ; rt_t * rt_t would overflow\n" \
+    "        LDA rt_t\n" \
+    "        MUL rt_t\n" \
+    "        STA rt_p\n" \
+    "        LDA rt_a\n" \
+    "        SUB rt_p\n" \
+    "        BRN rt_snext    ; rt_t * rt_t > A\n" \
+    "        LDA rt_t\n" \
+    "        STA rt_res\n" \
+    "rt_snext: INX\n" \
+    "        JMP rt_sq\n" \
+    "rt_sret: LDA rt_res\n" \
+    "        RET\n" \
+    "rt_gcd: LDA rt_a        ; Euclid on |A|, |B| with rt_udiv\n" \
+    "        BRN rt_ga\n" \
+    "        JMP rt_gb\n" \
+    "rt_ga:  LDA rt_0\n" \
+    "        SUB rt_a\n" \
+    "rt_gb:  STA rt_res\n" \
+    "        LDA rt_b\n" \
+    "        BRN rt_gc\n" \
+    "        JMP rt_gd\n" \
+    "rt_gc:  LDA rt_0\n" \
+    "        SUB rt_b\n" \
+    "rt_gd:  STA rt_t\n" \
+    "        .bound 22       ; Fibonacci worst case below 32768\n" \
+    "rt_gl:  LDA rt_t\n" \
+    "        BRZ rt_gret\n" \
+    "        STA rt_ub\n" \
+    "        LDA rt_res\n" \
+    "        STA rt_ua\n" \
+    "        CAL rt_udiv\n" \
+    "        LDA rt_ub\n" \
+    "        STA rt_res\n" \
+    "        LDA rt_ua\n" \
+    "        STA rt_t\n" \
+    "        JMP rt_gl\n" \
+    "rt_gret: LDA rt_res\n" \
+    "        RET\n"
+
+
+
+//========================================
+
+// Load AccCom program to memory
+
+// - return start address of program
+
+//========================================
+
+UINT loadProgram() {
+
+    // reset whole memory
+
+    resetMemory();
+
+
+
+    // program from ASM_FILE: start at label main
+
+    if (ASM_FILE[0] != '\0') {
+        static char src[ASM_SIZE];
+        FILE *f = fopen(ASM_FILE, "r");
+        size_t n;
+
+        if (f == NULL) {
+            printf("Error: cannot open %s\n", ASM_FILE);
+            exit(-1);
+        }
+        n = fread(src, 1, sizeof(src) - 1, f);
+        fclose(f);
+        src[n] = '\0';
+        assemble(src);
+        printMemory("DATA", data_bgn, data_end);
+        printMemory("CODE", code_bgn, code_end);
+#if LIST_CODE
+        printListing("LIST", code_bgn, code_end);
+#endif
+        if (asmSymbol("main") == END_OF_ARG) {
+            printf("Error: %s has no label main\n", ASM_FILE);
+            exit(-1);
+        }
+        return asmSymbol("main");
+    }
+
+
+
+    /*
+
+    A=7 // input data
+
+    B=-5 // input data
+
+    X // result
+
+    10 // constant 10
+
+    "X=" // constant "X="
+
+
+
+    X = A*B
+
+    X = X + 10
+
+    print("X=", X, '\n')
+
+    */
+
+
+
+#if WORKLOAD == 1
+
+    // trial division by d = 2, 3, ... while d <= n / d
+
+    assemble(
+        ".data 0100\n"
+        "a:      .word 0         ; input A\n"
+        "b:      .word 0         ; input B\n"
+        "n:      .word 0\n"
+        "d:      .word 0         ; divisor\n"
+        "two:    .word 2\n"
+        ".code 0200\n"
+        "isPrime: LDA two        ; print n if prime (n >= 2)\n"
+        "        STA d\n"
+        "test:   LDA n\n"
+        "        DIV d\n"
+        "        CMP d\n"
+        "        BRN prime       ; n / d < d: no divisor left\n"
+        "        LDA n\n"
+        "        MOD d\n"
+        "        BRZ done        ; d divides n\n"
+        "        LDA d\n"
+        "        IAC\n"
+        "        STA d\n"
+        "        JMP test\n"
+        "prime:  PRT n\n"
+        "        PRC '\\n'\n"
+        "done:   RET\n"
+        "main:   LDA a\n"
+        "        CMP two\n"
+        "        BRN low         ; A < 2: start at 2\n"
+        "        JMP first\n"
+        "low:    LDA two\n"
+        "first:  STA n\n"
+        "next:   LDA b\n"
+        "        CMP n\n"
+        "        BRN end         ; B < n\n"
+        "        CAL isPrime\n"
+        "        LDA n\n"
+        "        IAC\n"
+        "        STA n\n"
+        "        JMP next\n"
+        "end:    HLT\n");
+
+    // loop bounds for the inputs of the WCET analysis
+    asmBound(asmSymbol("test"), asmRootBound(asmInMax(32767))); // d * d <= n <= B
+
+#elif WORKLOAD == 2
+
+    // sieve of Eratosthenes over flags[n] = word at flags + 2n
+
+    assemble(
+        ".data 0100\n"
+        "a:      .word 0         ; input A\n"
+        "b:      .word 0         ; input B\n"
+        "n:      .word 0\n"
+        "d:      .word 0\n"
+        "m2:     .word 0         ; offset of multiple in flags\n"
+        "step2:  .word 0         ; offset of d in flags\n"
+        "lim2:   .word 0         ; offset of B in flags\n"
+        "one:    .word 1\n"
+        "two:    .word 2\n"
+        "max:    .word 1700      ; largest B that fits in memory\n"
+        ".code 0200\n"
+        "main:   LDA b\n"
+        "        CMP max\n"
+        "        BRN inb\n"
+        "        LDA max\n"
+        "        STA b\n"
+        "inb:    LDA a\n"
+        "        CMP two\n"
+        "        BRN low         ; A < 2: start at 2\n"
+        "        JMP sieve\n"
+        "low:    LDA two\n"
+        "        STA a\n"
+        "sieve:  LDA b\n"
+        "        ADD b\n"
+        "        STA lim2\n"
+        "        LDA two\n"
+        "        STA d\n"
+        "outer:  LDA d           ; for d while d * d <= B\n"
+        "        MUL d\n"
+        "        CMP b\n"
+        "        BRN check\n"
+        "        BRZ check\n"
+        "        JMP list\n"
+        "check:  LDA d\n"
+        "        ADD d\n"
+        "        STA step2\n"
+        "        LDX step2\n"
+        "        LDA flags,X\n"
+        "        BRZ first       ; d is prime\n"
+        "        JMP nextd\n"
+        "first:  LDA d\n"
+        "        MUL step2\n"
+        "        STA m2          ; from d * d\n"
+        "mark:   LDX m2\n"
+        "        LDA one\n"
+        "        STA flags,X\n"
+        "        LDA m2\n"
+        "        ADD step2\n"
+        "        STA m2\n"
+        "        CMP lim2\n"
+        "        BRN mark\n"
+        "        BRZ mark\n"
+        "nextd:  LDA d\n"
+        "        IAC\n"
+        "        STA d\n"
+        "        JMP outer\n"
+        "list:   LDA a\n"
+        "        STA n\n"
+        "        ADD a\n"
+        "        STA m2\n"
+        "        LDX m2\n"
+        "scan:   LDA b\n"
+        "        CMP n\n"
+        "        BRN end         ; B < n\n"
+        "        LDA flags,X\n"
+        "        BRZ prime\n"
+        "        JMP skip\n"
+        "prime:  PRT n\n"
+        "        PRC '\\n'\n"
+        "skip:   INX\n"
+        "        LDA n\n"
+        "        IAC\n"
+        "        STA n\n"
+        "        JMP scan\n"
+        "end:    HLT\n"
+        "flags:\n");
+
+    // loop bounds for the inputs of the WCET analysis
+    asmBound(asmSymbol("outer"), asmRootBound(asmInMax(1700))); // d * d <= B <= max
+    asmBound(asmSymbol("mark"), asmHalfBound(asmInMax(1700))); // m = 6, 8, ... B for d = 2
+
+#elif WORKLOAD == 3
+
+    // sieve of Eratosthenes, flag of n at bank n / 2048, offset 2 * (n % 2048)
+
+    assemble(
+        ".data 0100\n"
+        "a:      .word 0         ; input A\n"
+        "b:      .word 0         ; input B\n"
+        "n:      .word 0\n"
+        "d:      .word 0\n"
+        "m:      .word 0         ; multiple of d\n"
+        "m2:     .word 0         ; offset of m in its bank\n"
+        "mb:     .word 0         ; bank of m\n"
+        "step2:  .word 0         ; offset of d\n"
+        "nb:     .word 0         ; bank of n\n"
+        "t:      .word 0\n"
+        "zero:   .word 0\n"
+        "one:    .word 1\n"
+        "two:    .word 2\n"
+        "per:    .word 2048      ; flags per bank\n"
+        "size:   .word 4096      ; bank size\n"
+        "max:    .word 32000     ; largest B (16 banks)\n"
+        ".code 0200\n"
+        "main:   LDA b\n"
+        "        CMP max\n"
+        "        BRN inb\n"
+        "        LDA max\n"
+        "        STA b\n"
+        "inb:    LDA a\n"
+        "        CMP two\n"
+        "        BRN low         ; A < 2: start at 2\n"
+        "        JMP sieve\n"
+        "low:    LDA two\n"
+        "        STA a\n"
+        "sieve:  LDA two\n"
+        "        STA d\n"
+        "outer:  LDA d           ; for d while d * d <= B\n"
+        "        MUL d\n"
+        "        CMP b\n"
+        "        BRN check\n"
+        "        BRZ check\n"
+        "        JMP list\n"
+        "check:  LDA d\n"
+        "        DIV per\n"
+        "        STA t\n"
+        "        BNK t\n"
+        "        LDA d\n"
+        "        MOD per\n"
+        "        STA t\n"
+        "        ADD t\n"
+        "        STA t\n"
+        "        LDX t\n"
+        "        LDB 0,X\n"
+        "        BRZ first       ; d is prime\n"
+        "        JMP nextd\n"
+        "first:  LDA d\n"
+        "        ADD d\n"
+        "        STA step2\n"
+        "        LDA d\n"
+        "        MUL d\n"
+        "        STA m           ; from d * d\n"
+        "        DIV per\n"
+        "        STA mb\n"
+        "        BNK mb\n"
+        "        LDA m\n"
+        "        MOD per\n"
+        "        STA t\n"
+        "        ADD t\n"
+        "        STA m2\n"
+        "mark:   LDX m2\n"
+        "        LDA one\n"
+        "        STB 0,X\n"
+        "        LDA m\n"
+        "        ADD d\n"
+        "        STA m\n"
+        "        CMP b\n"
+        "        BRN next\n"
+        "        BRZ next\n"
+        "        JMP nextd\n"
+        "next:   LDA m2\n"
+        "        ADD step2\n"
+        "        STA m2\n"
+        "        CMP size\n"
+        "        BRN mark\n"
+        "        SUB size        ; next bank\n"
+        "        STA m2\n"
+        "        LDA mb\n"
+        "        IAC\n"
+        "        STA mb\n"
+        "        BNK mb\n"
+        "        JMP mark\n"
+        "nextd:  LDA d\n"
+        "        IAC\n"
+        "        STA d\n"
+        "        JMP outer\n"
+        "list:   LDA a\n"
+        "        STA n\n"
+        "        DIV per\n"
+        "        STA nb\n"
+        "        BNK nb\n"
+        "        LDA n\n"
+        "        MOD per\n"
+        "        STA t\n"
+        "        ADD t\n"
+        "        STA t\n"
+        "        LDX t\n"
+        "scan:   LDA b\n"
+        "        CMP n\n"
+        "        BRN end         ; B < n\n"
+        "        LDB 0,X\n"
+        "        BRZ prime\n"
+        "        JMP skip\n"
+        "prime:  PRT n\n"
+        "        PRC '\\n'\n"
+        "skip:   LDA n\n"
+        "        IAC\n"
+        "        STA n\n"
+        "        INX\n"
+        "        STX t\n"
+        "        LDA t\n"
+        "        CMP size\n"
+        "        BRN scan\n"
+        "        LDX zero        ; next bank\n"
+        "        LDA nb\n"
+        "        IAC\n"
+        "        STA nb\n"
+        "        BNK nb\n"
+        "        JMP scan\n"
+        "end:    HLT\n");
+
+    // loop bounds for the inputs of the WCET analysis
+    asmBound(asmSymbol("outer"), asmRootBound(asmInMax(32000))); // d * d <= B <= max
+    asmBound(asmSymbol("mark"), asmHalfBound(asmInMax(32000))); // m = 6, 8, ... B for d = 2
+
+#elif WORKLOAD == 4
+
+    // trial division on the base ISA: d = 2, 3, ... <= isqrt(n), n % d by the runtime library
+
+    assemble(
+        ".data 0100\n"
+        "a:      .word 0         ; input A\n"
+        "b:      .word 0         ; input B\n"
+        "n:      .word 0\n"
+        "d:      .word 0         ; divisor\n"
+        "r:      .word 0         ; isqrt(n)\n"
+        "two:    .word 2\n"
+        RT_DATA
+        ".code 0200\n"
+        "isPrime: LDA n          ; print n if prime (n >= 2)\n"
+        "        STA rt_a\n"
+        "        CAL rt_isqrt\n"
+        "        STA r\n"
+        "        LDA two\n"
+        "        STA d\n"
+        "test:   LDA r\n"
+        "        CMP d\n"
+        "        BRN prime       ; d > isqrt(n): no divisor left\n"
+        "        LDA d\n"
+        "        STA rt_b\n"
+        "        CAL rt_mod\n"
+        "        BRZ done        ; d divides n\n"
+        "        LDA d\n"
+        "        IAC\n"
+        "        STA d\n"
+        "        JMP test\n"
+        "prime:  PRT n\n"
+        "        PRC '\\n'\n"
+        "done:   RET\n"
+        "main:   LDA a\n"
+        "        CMP two\n"
+        "        BRN low         ; A < 2: start at 2\n"
+        "        JMP first\n"
+        "low:    LDA two\n"
+        "first:  STA n\n"
+        "next:   LDA b\n"
+        "        CMP n\n"
+        "        BRN end         ; B < n\n"
+        "        CAL isPrime\n"
+        "        LDA n\n"
+        "        IAC\n"
+        "        STA n\n"
+        "        JMP next\n"
+        "end:    HLT\n"
+        RT_CODE);
+
+    // loop bounds for the inputs of the WCET analysis
+    asmBound(asmSymbol("test"), asmRootBound(asmInMax(32767))); // d <= isqrt(n), n <= B
+
+#else
+
+    // DATA section ----------------------------------------
+
+
+
+    data_end = writeWords(data_bgn =
+                                  0x0100, 0x0000, // 0100: a = 0
+                          0x0000, // 0102: b= 0
+                          0x0000, // 0104: n
+                          0x0000, // 0106: flag
+                          0x0000, // 0108: flag_div
+                          0x0001, // 010A: i = 1
+                          0x0001,//  010C: j = 1
+                          0x0000, // 010E: div
+                          0x0000, // 0110: prime
+                          0x0001, // 0112: true = 1
+                          0x0000, // 0114: false = 0
+                          0x0002, // 0116: init = 2
+                          0x0001, // 0118: one = 1
+                          0x0000, // 011A: condition
+                          END_OF_ARG);
+
+
+
+    // CODE section ----------------------------------------
+
+
+
+    code_end = writeWords(code_bgn =
+                                  //#isDivisor
+                                  0x0200,0x1118, // 0200: LDA one
+                                  0x210C, // 0202: STA j
+                                  0x710E, // 0204: MUL div
+                          0x211A, // 0206: STA condition
+                          0x1104, // 0208: LDA n
+                          0x411A, // 020A: SUB condition
+                          0xA226, // 020C: BRN 226
+                          0x1102, // 020E: LDA n
+                          0x411A, // 0210: SUB condition
+                          0x9218, // 0212: BRZ 218
+                          0x1112, // 0214: LDA true
+                          0x2108, // 0216: STA flag_div
+                          0x110C, // 0218: LDA j
+                          0x8002, // 021A: IAC
+                          0x210C, // 021C: STA j
+                          0x110C, // 021E: LDA j
+                          0x710E, // 0220: MUL div
+                          0x211A, // 0222: STA condition
+                          0x5208, // 0224: JMP 208
+                          0x8005, // 0226: RET
+                                //#isPrime
+                          0x110A, // 0228: LDA i
+                          0x8002, // 022A: IAC
+                          0x210E, // 022C: STA div
+                          0x1104, // 022E: LDA n
+                          0x4118, // 0230: SUB one
+                          0x2110, // 0232: STA Prime
+                          0x1110, // 0234: LDA Prime
+                          0x410E, // 0236: SUB div
+                          0xA254, // 0238: BRN 254
+                          0x1114, // 023A: LDA false
+                          0x2108, // 023C: STA flag_div
+                          0x6200, // 023E: cal #isDivisor
+                          0x1108, // 0240: LDA flag_div
+                          0x4112, // 0242: SUB true
+                          0x924C, // 0244: BRZ 24C
+                          0x1112, // 0246: LDA true
+                          0x2106, // 0248: STA flag
+                          0x8005, // 024A: RET
+                          0x110E, // 024C: LDA div
+                          0x8002, // 024E: IAC
+                          0x210E, // 0250: STA div
+                          0x5234, // 0252: JMP 234
+                          0x8005, // 0254: RET
+                                //main
+                          0x1100, //0256: LDA a
+                          0x2104, //0258: STA n
+                          0x1116, //025A: LDA init
+                          0x4100, //025C: SUB a
+                          0xA264, //025E: BRN 264
+                          0x1116, //0260: LDA init
+                          0x2104, //0262: STA n
+                          0x1102, //0264: LDA b
+                          0x4104, //0266: SUB n
+                          0xA282, //0268: BRN 282
+                          0x1114, //026A: LDA false
+                          0x2106, //026C: STA flag
+                          0x6228, //026E: cal #isPrime
+                          0x1106, //0270: LDA flag
+                          0x4114, //0272: SUB false
+                          0xA27A, //0274: BRZ 27A
+                          0xB104, //0276: PRC (n)
+                          0xC00A, //0278: PRC '\n'
+                          0x1104, //027A: LDA n
+                          0x8002, //027C: IAC
+                          0x2104, //027E: STA n
+                          0x5264, //0280: JMP 264
+                          0x8000, //0282: HLT
+                          END_OF_ARG);
+
+    // loop bounds for the inputs of the WCET analysis: a raw image has no .bound
+    asmBound(0x0208, asmInMax(32767) / 2); // isDivisor: j * div <= n <= B, div >= 2
+
+#endif
+
+
+
+    // -----------------------------------------------------
+
+    // print memory for verify
+
+    printMemory("DATA", data_bgn, data_end);
+    printMemory("CODE", code_bgn, code_end);
+#if LIST_CODE
+    printListing("LIST", code_bgn, code_end);
+#endif
+
+#if WORKLOAD != 0
+    return asmSymbol("main");
+#else
+    return 0x0256; // return start address of program
+#endif
+}
+
+
+
+//========================================
+
+// Keyboard input for specific variables
+
+//========================================
+
+// - return 0 at end of input
+
+int inputData() {
+    int ok;
+    // print problem summary
+    printf("square list of A to B\n");
+    // input data
+    ok = inputNumber("0100: A = ", 0x0100);
+    ok = inputNumber("0102: B = ", 0x0102) && ok;
+    // print DATA section for verify
+    printMemory("DATA", data_bgn, data_end);
+    return ok;
+}
+
+
+
+//========================================
+
+// Definitions and Functions
+
+// for runProgram()
+
+//========================================
+
+
+
+//여기서 부터 코딩하면 된다.
+
+
+
+int c_num = 0;
+
+//fetch cycle 과 executuion cycle에 쓰일 변수
+
+
+
+//여기다 divided conquer가법으로 함수를 작성하는건 어떨까
+
+
+
+
+
+char out_buf[OUT_SIZE]; // program output (kept for the result cache)
+UINT out_len = 0; // # of chars printed by the program
+int out_quiet = 0; // 1: keep output in out_buf only
+
+
+
+// Print a char of program output
+
+void putOut(int ch) {
+    if (out_len < OUT_SIZE) out_buf[out_len] = (char)ch;
+    out_len++;
+    if (!out_quiet) putchar(ch);
+}
+
+
+
+// PRT (PRinT) instruction
+
+// print a AccCom number at mem[addr]
+
+void prt(UINT addr) {
+    UINT n = readWord(addr);
+    int i = accnum2cint(n);
+    char str[12];
+    char *p;
+    sprintf(str, "%d", i);
+    for (p = str; *p != '\0'; p++) putOut(*p);
+}
+
+
+
+// PRC (PRint Char) instruction
+
+// print a ASCII char
+
+void prc(int ch) {
+    putOut(ch);
+}
+
+
+
+// PRS (PRint String) instruction
+
+// print string at mem[addr]
+
+void prs(UINT addr) {
+    int ch = (int)readByte(addr);
+    while (ch != '\0') {
+        putOut(ch);
+        ch = (int)readByte(++addr);
+    }
+}
+
+
+
+UINT pc = 0;
+UINT acc = 0;
+UINT xr = 0; // index register
+
+int ST_RUN = 0;
+
+UINT64 inst_cnt = 0; // # of executed instructions
+
+
+
+// Print instruction count and call depth statistics
+
+void printRunStats() {
+    printf("[RUN]\n");
+    printf("instructions: %llu executed\n", inst_cnt);
+#if RET_STACK
+    printf("return stack: %d entries%s\n", RET_DEPTH, RET_MIRROR ? ", mirrored to memory" : "");
+#else
+    printf("return stack: %d entries in memory\n", STACK_END / 2);
+#endif
+    printf("max call depth: %d\n", tos_max / 2);
+}
+
+
+
+//========================================
+
+// Subroutine Memoization
+
+// - a CAL is skipped when the same subroutine was called before
+
+//   with the same ACC, PSW and DATA words it reads
+
+// - a subroutine doing I/O (and its callers) is impure
+
+// - a subroutine hit in less than 1/16 of its first MEMO_TRIAL calls
+
+//   is not recorded any more (it only costs time)
+
+//========================================
+
+#if USE_MEMO
+
+typedef struct {
+    UINT target; // subroutine address
+    UINT acc; // ACC, PSW, X at CAL
+    UINT psw;
+    UINT x;
+    UINT acc_out; // ACC, PSW, X at RET
+    UINT psw_out;
+    UINT x_out;
+    int n_rd; // read set: words read before written
+    UINT rd_addr[MEMO_SET];
+    UINT rd_val[MEMO_SET];
+    int n_wr; // write set: last value of written words
+    UINT wr_addr[MEMO_SET];
+    UINT wr_val[MEMO_SET];
+    int n_stk; // return addresses pushed by nested CALs
+    UINT stk_val[MEMO_STACK];
+    UINT64 n_inst; // # of instructions of the call (0: empty)
+} MEMO_ENTRY;
+
+typedef struct {
+    UINT target; // subroutine address
+    int impure; // 1: does I/O, never memoized
+    int cold; // 1: too few hits, not memoized
+    int n_sig; // read addresses hashed for lookup
+    UINT sig[MEMO_SET];
+    UINT64 calls; // # of CALs (0: empty)
+    UINT64 hits; // # of CALs skipped
+} MEMO_SUB;
+
+typedef struct {
+    MEMO_ENTRY e; // call being recorded
+    MEMO_SUB *sub; // called subroutine
+    UINT key; // hash of inputs at CAL
+    int tos; // tos after CAL
+    UINT64 start; // instruction count at CAL
+    int ok; // 0: not memoizable
+    UCHAR seen[MEM_SIZE / 16 + 1]; // bit per word: in read or write set
+    UCHAR wr_idx[MEM_SIZE / 2 + 1]; // per word: index + 1 in write set
+} MEMO_FRAME;
+
+MEMO_ENTRY memo_tbl[MEMO_SLOTS]; // recorded calls
+MEMO_SUB memo_sub[MEMO_SUBS]; // called subroutines
+MEMO_FRAME memo_frm[MEMO_DEPTH]; // calls being recorded
+int memo_depth = 0; // # of calls being recorded
+UINT memo_code = 0; // hash of CODE section the tables are valid for
+UINT memo_key; // key of the last CAL
+UINT64 inst_skip = 0; // # of instructions skipped by hits
+
+
+
+// Hash a call of target with given inputs (FNV-1a)
+
+UINT memoHash(UINT target, UINT acc_in, UINT psw_in, UINT x_in, int n, UINT *val) {
+    UINT h = 2166136261u;
+    int i;
+    h = (h ^ target) * 16777619u;
+    h = (h ^ acc_in) * 16777619u;
+    h = (h ^ psw_in) * 16777619u;
+    h = (h ^ x_in) * 16777619u;
+    for (i = 0; i < n; i++) h = (h ^ val[i]) * 16777619u;
+    return h;
+}
+
+
+
+// Find (or add) a subroutine
+
+MEMO_SUB *memoSub(UINT target) {
+    UINT i = (target >> 1) % MEMO_SUBS;
+    int n;
+    for (n = 0; n < MEMO_SUBS; n++) {
+        MEMO_SUB *s = &memo_sub[i];
+        if (s->calls == 0) {
+            s->target = target;
+            return s;
+        }
+        if (s->target == target) return s;
+        i = (i + 1) % MEMO_SUBS;
+    }
+    return NULL; // table full
+}
+
+
+
+// Start a new job: drop recorded calls if the CODE section changed
+
+void memoBegin() {
+    UINT h = memoHash(code_bgn, code_end, 0, 0, 0, NULL);
+    UINT addr;
+    for (addr = code_bgn; addr < code_end; addr++) h = (h ^ mem[addr]) * 16777619u;
+    if (h != memo_code) {
+        memset(memo_tbl, 0, sizeof(memo_tbl));
+        memset(memo_sub, 0, sizeof(memo_sub));
+        memo_code = h;
+    }
+    memo_depth = 0;
+}
+
+
+
+// Record a word read by an instruction
+
+void memoRead(UINT addr, UINT data) {
+    int d;
+    for (d = 0; d < memo_depth; d++) {
+        MEMO_FRAME *f = &memo_frm[d];
+        MEMO_ENTRY *e = &f->e;
+        UINT w = addr >> 1;
+        if (!f->ok) continue;
+        if (f->seen[w >> 3] & (1 << (w & 7))) continue; // written or already an input
+        f->seen[w >> 3] |= (UCHAR)(1 << (w & 7));
+        if (addr < STACK_END || (addr & 1) || e->n_rd == MEMO_SET) {
+            f->ok = 0;
+            continue;
+        }
+        e->rd_addr[e->n_rd] = addr;
+        e->rd_val[e->n_rd++] = data;
+    }
+}
+
+
+
+// Record a word written by an instruction
+
+void memoWrite(UINT addr, UINT data) {
+    int d;
+    if (addr + 1 >= code_bgn && addr < code_end) {
+        // self-modifying code: recorded calls are no longer valid
+        memo_code = 0;
+        memoBegin();
+        return;
+    }
+    for (d = 0; d < memo_depth; d++) {
+        MEMO_FRAME *f = &memo_frm[d];
+        MEMO_ENTRY *e = &f->e;
+        UINT w = addr >> 1;
+        if (!f->ok) continue;
+        if (f->wr_idx[w] != 0) {
+            e->wr_val[f->wr_idx[w] - 1] = data;
+            continue;
+        }
+        f->seen[w >> 3] |= (UCHAR)(1 << (w & 7));
+        if (addr < STACK_END || (addr & 1) || e->n_wr == MEMO_SET) {
+            f->ok = 0;
+            continue;
+        }
+        e->wr_addr[e->n_wr] = addr;
+        e->wr_val[e->n_wr++] = data;
+        f->wr_idx[w] = (UCHAR)e->n_wr;
+    }
+}
+
+
+
+// Record a return address pushed to stack at addr
+
+void memoStack(UINT addr, UINT data) {
+    int d;
+    for (d = 0; d < memo_depth; d++) {
+        MEMO_ENTRY *e = &memo_frm[d].e;
+        int k = (int)(addr - memo_frm[d].tos) / 2;
+        if (!memo_frm[d].ok) continue;
+        if (k >= MEMO_STACK) {
+            memo_frm[d].ok = 0;
+            continue;
+        }
+        e->stk_val[k] = data;
+        if (k >= e->n_stk) e->n_stk = k + 1;
+    }
+}
+
+
+
+// I/O instruction: all calls being recorded are impure
+
+void memoIO() {
+    int d;
+    for (d = 0; d < memo_depth; d++) {
+        memo_frm[d].sub->impure = 1;
+        memo_frm[d].ok = 0;
+    }
+}
+
+
+
+// CAL target: replay a recorded call with the same inputs
+
+// - return 1: hit (call done), 0: miss
+
+int memoCall(UINT target, UINT *psw) {
+    MEMO_SUB *s = memoSub(target);
+    MEMO_ENTRY *e;
+    UINT val[MEMO_SET];
+    int i;
+
+    if (s == NULL) return 0;
+    s->calls++;
+    if (s->impure || s->cold) return 0;
+    if (s->calls == MEMO_TRIAL && s->hits * 16 < s->calls) {
+        s->cold = 1;
+        return 0;
+    }
+
+    for (i = 0; i < s->n_sig; i++) val[i] = readWord(s->sig[i]);
+    memo_key = memoHash(target, acc, *psw, xr, s->n_sig, val);
+    e = &memo_tbl[memo_key % MEMO_SLOTS];
+    if (e->n_inst == 0 || e->target != target) return 0;
+    if (e->acc != acc || e->psw != *psw || e->x != xr) return 0;
+    for (i = 0; i < e->n_rd; i++) {
+        if (readWord(e->rd_addr[i]) != e->rd_val[i]) return 0;
+    }
+
+    // hit: leave the machine as if the call was run
+    for (i = 0; i < e->n_rd; i++) memoRead(e->rd_addr[i], e->rd_val[i]);
+    memoStack(tos, pc);
+    push(pc);
+#if STACK_IN_MEM
+    for (i = 0; i < e->n_stk; i++) {
+        writeWord(tos + 2*i, e->stk_val[i]);
+        memoStack(tos + 2*i, e->stk_val[i]);
+    }
+#endif
+    if (tos + 2*e->n_stk > tos_max) tos_max = tos + 2*e->n_stk;
+    pop();
+    for (i = 0; i < e->n_wr; i++) {
+        writeWord(e->wr_addr[i], e->wr_val[i]);
+        memoWrite(e->wr_addr[i], e->wr_val[i]);
+    }
+    acc = e->acc_out;
+    *psw = e->psw_out;
+    xr = e->x_out;
+
+    s->hits++;
+    inst_skip += e->n_inst;
+    return 1;
+}
+
+
+
+// CAL target (after push): start recording the call
+
+void memoEnter(UINT target, UINT psw) {
+    MEMO_SUB *s = memoSub(target);
+    MEMO_FRAME *f;
+
+    if (s == NULL || s->impure || s->cold || memo_depth == MEMO_DEPTH) return;
+    f = &memo_frm[memo_depth++];
+    f->e.target = target;
+    f->e.acc = acc;
+    f->e.psw = psw;
+    f->e.x = xr;
+    f->e.n_rd = 0;
+    f->e.n_wr = 0;
+    f->e.n_stk = 0;
+    f->sub = s;
+    f->key = memo_key;
+    f->tos = tos;
+    f->start = inst_cnt + inst_skip;
+    f->ok = 1;
+    memset(f->seen, 0, sizeof(f->seen));
+    memset(f->wr_idx, 0, sizeof(f->wr_idx));
+}
+
+
+
+// RET (after pop): save the recorded call
+
+void memoReturn(UINT psw) {
+    MEMO_FRAME *f;
+    MEMO_SUB *s;
+    int i;
+
+    // drop calls left without RET
+    while (memo_depth > 0 && memo_frm[memo_depth - 1].tos > tos + 2) memo_depth--;
+    if (memo_depth == 0 || memo_frm[memo_depth - 1].tos != tos + 2) return;
+
+    f = &memo_frm[--memo_depth];
+    s = f->sub;
+    if (!f->ok || s->impure) return;
+
+    if (s->n_sig == 0 && f->e.n_rd > 0) {
+        // first recorded call decides the read addresses to hash
+        s->n_sig = f->e.n_rd;
+        for (i = 0; i < f->e.n_rd; i++) s->sig[i] = f->e.rd_addr[i];
+        f->key = memoHash(f->e.target, f->e.acc, f->e.psw, f->e.x, f->e.n_rd, f->e.rd_val);
+    }
+    f->e.acc_out = acc;
+    f->e.psw_out = psw;
+    f->e.x_out = xr;
+    f->e.n_inst = inst_cnt + inst_skip - f->start;
+
+    // on a collision keep the call that saves more instructions
+    if (memo_tbl[f->key % MEMO_SLOTS].n_inst <= f->e.n_inst) memo_tbl[f->key % MEMO_SLOTS] = f->e;
+}
+
+
+
+// Print memo hit rates
+
+void printMemoStats() {
+    int i;
+    printf("[MEMO]\n");
+    for (i = 0; i < MEMO_SUBS; i++) {
+        MEMO_SUB *s = &memo_sub[i];
+        if (s->calls == 0) continue;
+        printf("%04X: %llu calls, %llu hits (%.1f%%)%s\n", s->target, s->calls, s->hits,
+               100.0 * s->hits / s->calls, s->impure ? ", impure" : s->cold ? ", cold" : "");
+    }
+    printf("instructions: %llu executed, %llu skipped\n", inst_cnt, inst_skip);
+}
+
+#define MEMO_READ(addr, data) do { if (memo_depth > 0) memoRead(addr, data); } while (0)
+#define MEMO_WRITE(addr, data) memoWrite(addr, data)
+#define MEMO_IO() do { if (memo_depth > 0) memoIO(); } while (0)
+
+#else
+
+#define MEMO_READ(addr, data) ((void)0)
+#define MEMO_WRITE(addr, data) ((void)0)
+#define MEMO_IO() ((void)0)
+
+#endif
+
+
+
+//========================================
+
+// Loop Acceleration
+
+// - loop: code from the target of a backward JMP to the JMP
+
+// - a loop using only LDA/STA/ADD/SUB/MUL/IAC/BRZ/BRN/JMP
+
+//   on a few DATA words runs natively with the words in host variables
+
+// - the loop ends when a branch leaves it, then written words are stored
+
+// - a word read by the loop counts as read for memoization
+
+//   even if the loop writes it first
+
+//========================================
+
+#if USE_LOOP_ACCEL
+
+typedef struct {
+    UINT op; // opcode (ir_i >> 12)
+    UINT a; // operand address (ir_a)
+    int var; // operand: index in var_addr[]
+} LOOP_OP;
+
+typedef struct {
+    UINT head; // address of first instruction
+    UINT end; // address after the backward JMP
+    int state; // 0: not analyzed, 1: native, -1: interpreted
+    int n_op;
+    LOOP_OP op[LOOP_OPS];
+    int n_var;
+    UINT var_addr[LOOP_VARS]; // DATA words used by the loop
+    UCHAR var_rd[LOOP_VARS]; // 1: read by the loop
+    UCHAR var_wr[LOOP_VARS]; // 1: written by the loop
+    UINT64 runs; // # of native runs
+    UINT64 n_inst; // # of instructions run natively
+} LOOP;
+
+LOOP loop_tbl[LOOP_SLOTS]; // analyzed loops
+
+
+
+// Start a new job: analyze loops again (CODE may have changed)
+
+void loopBegin() {
+    int i;
+    for (i = 0; i < LOOP_SLOTS; i++) loop_tbl[i].state = 0;
+}
+
+
+
+// Check that head ~ end is a loop to run natively
+
+// - return 1: native, -1: interpreted
+
+int loopAnalyze(LOOP *L) {
+    UINT addr;
+    int i;
+
+    L->n_op = 0;
+    L->n_var = 0;
+    if ((L->end - L->head) / 2 > LOOP_OPS) return -1;
+
+    for (addr = L->head; addr < L->end; addr += 2) {
+        UINT ir = readWord(addr);
+        LOOP_OP *o = &L->op[L->n_op++];
+        o->op = ir >> 12;
+        o->a = ir & 0x0FFF;
+        o->var = -1;
+
+        switch (o->op) {
+        case 0x1: case 0x2: case 0x3: case 0x4: case 0x7: // LDA STA ADD SUB MUL
+            if (o->a & 1 || o->a < STACK_END || o->a + 1 >= MEM_SIZE) return -1;
+            if (o->a + 1 >= code_bgn && o->a < code_end) return -1;
+            for (i = 0; i < L->n_var && L->var_addr[i] != o->a; i++);
+            if (i == L->n_var) {
+                if (L->n_var == LOOP_VARS) return -1;
+                L->var_addr[i] = o->a;
+                L->var_rd[i] = 0;
+                L->var_wr[i] = 0;
+                L->n_var++;
+            }
+            if (o->op == 0x2) L->var_wr[i] = 1;
+            else L->var_rd[i] = 1;
+            o->var = i;
+            break;
+        case 0x5: case 0x9: case 0xA: // JMP BRZ BRN
+            if (o->a & 1) return -1;
+            break;
+        case 0x8: // IAC only
+            if (o->a != 0x0002) return -1;
+            break;
+        default: // CAL, I/O, ...
+            return -1;
+        }
+    }
+    return 1;
+}
+
+
+
+// Backward JMP at end - 2 to head: run the loop natively
+
+// - DATA words are kept as C int while the loop runs
+
+// - a result out of the AccCom range leaves the loop after that instruction
+
+// - return 1: loop done (pc is set), 0: run it by runProgram()
+
+int loopRun(UINT head, UINT end, UINT *psw) {
+    LOOP *L = &loop_tbl[(head >> 1) % LOOP_SLOTS];
+    int var[LOOP_VARS];
+    int a; // ACC
+    int r; // result of ADD/SUB/MUL/IAC
+    UINT aw; // ACC as AccCom number when leaving
+    UINT p = *psw;
+    int flag = 0; // 1: PSW is to be set from ACC
+    int wrap = 0; // 1: leaving with a result out of range
+    UINT64 n = 0;
+    int i = 0;
+    int v;
+
+    if (L->state == 0 || L->head != head || L->end != end) {
+        if (L->head != head || L->end != end) {
+            L->runs = 0;
+            L->n_inst = 0;
+        }
+        L->head = head;
+        L->end = end;
+        L->state = loopAnalyze(L);
+    }
+    if (L->state < 0 || acc == 0x8000) return 0;
+
+    for (v = 0; v < L->n_var; v++) {
+        UINT w = readWord(L->var_addr[v]);
+        if (w == 0x8000) return 0; // -0 has no C int
+        var[v] = accnum2cint(w);
+    }
+    a = accnum2cint(acc);
+
+    for (;;) {
+        LOOP_OP *o = &L->op[i];
+        n++;
+
+        switch (o->op) {
+        case 0x1: // LDA
+            a = var[o->var];
+            flag = 1;
+            i++;
+            continue;
+        case 0x2: // STA
+            var[o->var] = a;
+            i++;
+            continue;
+        case 0x3: // ADD
+            r = a + var[o->var];
+            flag = 1;
+            break;
+        case 0x4: // SUB
+            r = a - var[o->var];
+            flag = 1;
+            break;
+        case 0x7: // MUL
+            r = a * var[o->var];
+            flag = 1;
+            break;
+        case 0x8: // IAC (PSW is not changed)
+            if (flag) p = (a < 0) ? 0x1000 : (a == 0) ? 0x0001 : 0x0000;
+            flag = 0;
+            r = a + 1;
+            break;
+        case 0x9: // BRZ
+            if (flag) p = (a < 0) ? 0x1000 : (a == 0) ? 0x0001 : 0x0000;
+            flag = 0;
+            if ((p & 0x0FFF) != 0x0001) {
+                i++;
+                continue;
+            }
+            goto jump;
+        case 0xA: // BRN
+            if (flag) p = (a < 0) ? 0x1000 : (a == 0) ? 0x0001 : 0x0000;
+            flag = 0;
+            if ((p & 0xF000) != 0x1000) {
+                i++;
+                continue;
+            }
+            goto jump;
+        default: // JMP
+            goto jump;
+        }
+
+        // ADD, SUB, MUL, IAC
+        i++;
+        if (r < -0x7FFF || r > 0x7FFF) {
+            wrap = 1;
+            aw = cint2accnum(r);
+            pc = head + 2*i;
+            break;
+        }
+        a = r;
+        continue;
+
+    jump:
+        if (o->a >= head && o->a < end) {
+            i = (o->a - head) / 2;
+            continue;
+        }
+        pc = o->a; // leave the loop
+        break;
+    }
+
+    for (v = 0; v < L->n_var; v++) {
+        UINT addr = L->var_addr[v];
+        if (L->var_rd[v]) MEMO_READ(addr, readWord(addr));
+        if (L->var_wr[v]) {
+            writeWord(addr, cint2accnum(var[v]));
+            MEMO_WRITE(addr, cint2accnum(var[v]));
+        }
+    }
+    if (!wrap) aw = cint2accnum(a);
+    if (flag) p = (aw > 0x8000) ? 0x1000 : (aw == 0x0000) ? 0x0001 : 0x0000;
+    acc = aw;
+    *psw = p;
+    inst_cnt += n;
+    L->runs++;
+    L->n_inst += n;
+    return 1;
+}
+
+
+
+// Print natively run loops
+
+void printLoopStats() {
+    int i;
+    printf("[LOOP]\n");
+    for (i = 0; i < LOOP_SLOTS; i++) {
+        LOOP *L = &loop_tbl[i];
+        if (L->state == 0) continue;
+        printf("%04X-%04X: %s", L->head, L->end - 2, L->state > 0 ? "native" : "interpreted");
+        if (L->state > 0) printf(", %llu runs, %llu instructions", L->runs, L->n_inst);
+        printf("\n");
+    }
+}
+
+#endif
+
+//========================================
+
+// Bus Cycle Timing
+
+// - a word transfer takes BUS_LATENCY cycles per BUS_WIDTH bytes,
+
+//   a byte transfer (PRS) BUS_LATENCY cycles
+
+// - phases: instruction fetch (with the address word of F instructions),
+
+//   operand read (with indirect pointers), write-back, stack push/pop
+
+// - the return stack (RET_STACK) is in the CPU: a push costs bus cycles
+
+//   only when mirrored to memory, a pop never
+
+// - an instruction also takes EXEC_CYCLES (MULDIV_CYCLES) internal cycles,
+
+//   the bus is idle in these cycles
+
+//========================================
+
+#if BUS_TIMING
+
+enum { BUS_FETCH, BUS_READ, BUS_WRITE, BUS_STACK, BUS_PHASES };
+enum { CLS_LDST, CLS_ALU, CLS_MULDIV, CLS_BRANCH, CLS_CALL, CLS_IO, CLS_HALT, BUS_CLASSES };
+
+const char *bus_phase_name[BUS_PHASES] = { "fetch", "operand read", "write-back", "stack push/pop" };
+const char *bus_class_name[BUS_CLASSES] = { "load/store", "alu", "mul/div", "jump/branch", "call/ret", "i/o", "halt" };
+
+UINT64 bus_phase[BUS_PHASES]; // bus cycles per phase
+UINT64 bus_cls_inst[BUS_CLASSES]; // instructions per class
+UINT64 bus_cls_cyc[BUS_CLASSES]; // cycles per class (bus + internal)
+UINT64 bus_exec = 0; // internal cycles
+UINT64 bus_total = 0; // all cycles
+UINT64 bus_inst_cyc = 0; // cycles of the current instruction
+int bus_cls = -1; // class of the current instruction (-1: none)
+
+#define BUS_WORD_CYC (BUS_LATENCY * (2 / BUS_WIDTH))
+
+
+
+// Close the current instruction and start one of class cls
+
+void busNext(int cls) {
+    if (bus_cls >= 0) {
+        bus_cls_inst[bus_cls]++;
+        bus_cls_cyc[bus_cls] += bus_inst_cyc;
+    }
+    bus_inst_cyc = 0;
+    bus_cls = cls;
+}
+
+
+
+// Add n cycles of phase ph (BUS_PHASES: internal) to the current instruction
+
+void busCycles(int ph, UINT64 n) {
+    if (ph == BUS_PHASES) bus_exec += n;
+    else bus_phase[ph] += n;
+    bus_inst_cyc += n;
+    bus_total += n;
+}
+
+
+
+// Print bus cycles per phase, cycles per instruction class and bus utilisation
+
+void printBusStats() {
+    UINT64 bus = 0;
+    UINT64 total;
+    int i;
+    busNext(-1);
+    for (i = 0; i < BUS_PHASES; i++) bus += bus_phase[i];
+    total = bus + bus_exec;
+    printf("[BUS]\n");
+    printf("latency %d cycles, width %d bytes, %d cycles per word\n", BUS_LATENCY, BUS_WIDTH, BUS_WORD_CYC);
+    for (i = 0; i < BUS_PHASES; i++)
+        printf("%-15s %12llu cycles (%5.1f%%)\n", bus_phase_name[i], bus_phase[i], total ? 100.0 * bus_phase[i] / total : 0.0);
+    printf("%-15s %12llu cycles (%5.1f%%)\n", "internal", bus_exec, total ? 100.0 * bus_exec / total : 0.0);
+    for (i = 0; i < BUS_CLASSES; i++) {
+        if (bus_cls_inst[i] == 0) continue;
+        printf("%-12s %12llu instructions %12llu cycles, CPI %.2f\n", bus_class_name[i],
+               bus_cls_inst[i], bus_cls_cyc[i], (double)bus_cls_cyc[i] / bus_cls_inst[i]);
+    }
+    printf("total: %llu cycles, CPI %.2f, bus utilisation %.1f%%\n", total,
+           inst_cnt ? (double)total / inst_cnt : 0.0, total ? 100.0 * bus / total : 0.0);
+}
+
+#define BUS_NEXT(cls) busNext(cls)
+#define BUS_CLASS(cls) bus_cls = cls
+#define BUS_WORD(ph) busCycles(ph, BUS_WORD_CYC)
+#define BUS_BYTES(ph, n) busCycles(ph, (UINT64)(n) * BUS_LATENCY)
+#define BUS_EXEC(n) busCycles(BUS_PHASES, n)
+
+#else
+
+#define BUS_NEXT(cls)
+#define BUS_CLASS(cls)
+#define BUS_WORD(ph)
+#define BUS_BYTES(ph, n)
+#define BUS_EXEC(n)
+
+#endif
+
+
+
+//========================================
+
+// WCET Analysis
+
+// - control flow from the start address: JMP/BRZ/BRN targets, RET,
+
+//   CAL targets are subroutines
+
+// - loops are found by back edges, a loop repeats at most its bound:
+
+//   a .bound annotation at the header, or inferred from a counter
+
+//   "head: LDA limit / SUB|CMP i / BRN out" where every way around the loop
+
+//   passes "LDA i / IAC|ADD step / STA i" and nothing else stores i or limit
+
+// - ranges of limit, i and step come from an interval analysis
+
+//   with inputs in WCET_IN_MIN ~ WCET_IN_MAX, narrowed per subroutine:
+
+//   a word it does not store keeps its range at every CAL of it (i of a
+
+//   caller's loop is at most the limit there), and a limit stored on every
+
+//   way from the entry has the ranges of ACC at those stores
+
+// - asmBound() in loadProgram() gives the bounds of raw images and those that
+
+//   follow WCET_IN_MAX
+
+
+// - worst case of a loop = bound * longest way around + longest way out,
+
+//   of a subroutine = longest way from its entry to RET (with callees)
+
+// - cycles follow the bus timing model, the runs measure each CAL ~ RET
+
+//========================================
+
+#if WCET
+
+#define WCET_INF (1LL << 60) // unbounded
+#define WCET_TERM (-2) // goal: RET or HLT
+#define ACC_MAX 32767 // largest AccCom number
+
+enum { WK_NEXT, WK_JMP, WK_BR, WK_CAL, WK_RET, WK_HLT };
+
+typedef struct {
+    UINT addr; // instruction address
+    UINT op; // 0x1000 ~ 0xE000, 0x8xxx or extended operation 0xF0xx
+    UINT ea; // effective address (END_OF_ARG: indexed or indirect)
+    UINT base; // address operand (END_OF_ARG: indirect)
+    int kind; // WK_xxx
+    int succ[2]; // next instructions (CAL: return point only)
+    int n_succ;
+    int callee; // CAL: subroutine
+    long long cyc; // cycles
+    int acc_ok; // 1: reached by the range analysis
+    int acc_lo; // range of ACC before the instruction
+    int acc_hi;
+    UCHAR acc_chg; // # of changes of the range
+} WCET_NODE;
+
+typedef struct {
+    UINT addr; // word
+    int lo; // range
+    int hi;
+} WCET_RANGE;
+
+typedef struct {
+    int node; // entry
+    int state; // 0: not analyzed, 1: in analysis, 2: done
+    long long inst; // worst case instructions (WCET_INF: unbounded)
+    long long cyc; // worst case cycles
+    UCHAR wild; // 1: may store to any address (with callees)
+    UCHAR wr[MEM_SIZE + 1]; // 1: may store to the word (with callees)
+    int n_ctx; // words narrowed at every CAL of it
+    WCET_RANGE ctx[WCET_CTX];
+    UINT64 calls; // measured calls (program: runs)
+    UINT64 max_inst; // measured maxima
+    UINT64 max_cyc;
+} WCET_SUB;
+
+typedef struct {
+    int head; // header node
+    UINT tail; // address of the last back edge
+    int size; // # of nodes in the body
+    int parent; // enclosing loop (-1: none)
+    int n_exit; // targets of edges leaving the loop
+    int exit[WCET_EXITS];
+    int term; // 1: the body has RET or HLT
+    long long bound; // max repeats per entry (WCET_INF: unknown)
+    long long exit_cost[2][WCET_EXITS]; // worst case instructions, cycles to each exit
+    long long term_cost[2]; // to RET or HLT in the loop (-1: none)
+} WCET_LOOP;
+
+typedef struct {
+    int sub; // subroutine of the loop
+    WCET_RANGE v; // counter: its range before the increment
+    UCHAR in[WCET_NODES]; // 1: node of the loop after the test, before any increment
+} WCET_COUNTER;
+
+typedef struct {
+    UINT head; // header address
+    UINT tail;
+    long long bound; // largest over the subroutines with the loop
+    char how[64]; // where the bound comes from
+} WCET_REPORT;
+
+WCET_NODE wcet_node[WCET_NODES]; // instructions
+int wcet_n_node = 0;
+short wcet_node_at[MEM_SIZE + 1]; // node of an address (-1: none)
+WCET_SUB wcet_sub[WCET_SUBS]; // subroutines, 0: program
+int wcet_n_sub = 0;
+short wcet_sub_at[MEM_SIZE + 1]; // subroutine of an entry address (-1: none)
+UCHAR wcet_member[WCET_SUBS][WCET_NODES]; // 1: node of the subroutine
+WCET_REPORT wcet_rep[WCET_LOOPS]; // loops for printWcetStats() and wcetSub()
+int wcet_n_rep = 0;
+WCET_COUNTER wcet_cnt[WCET_LOOPS]; // counters of inferred loops
+int wcet_n_cnt = 0;
+char wcet_err[64] = ""; // why the analysis stopped
+int wcet_done = 0; // 1: analyzed
+
+int wcet_mem_lo[MEM_SIZE + 1]; // range of the word at an address
+int wcet_mem_hi[MEM_SIZE + 1];
+UCHAR wcet_mem_chg[MEM_SIZE + 1];
+
+// per subroutine
+int wcet_list[WCET_NODES]; // nodes of the subroutine
+int wcet_n_list;
+UCHAR wcet_in_sub[WCET_NODES]; // 1: node of the subroutine
+int wcet_pred_at[WCET_NODES + 1]; // predecessors of node i: wcet_pred[wcet_pred_at[i] ~]
+int wcet_pred[2 * WCET_NODES];
+int wcet_pred_n[WCET_NODES]; // # of predecessors
+int wcet_head_loop[WCET_NODES]; // loop headed by the node (-1: none)
+WCET_LOOP wcet_loop[WCET_LOOPS];
+int wcet_n_loop;
+UCHAR wcet_body[WCET_LOOPS][WCET_NODES]; // 1: node in the loop
+UCHAR wcet_seen[WCET_NODES];
+long long wcet_back[WCET_NODES]; // longest way to a back edge (-1: none)
+long long wcet_exit[WCET_NODES]; // longest way out (-1: none)
+int wcet_goal; // exit node of the longest way out
+int wcet_sub_lo[WCET_NODES]; // range of ACC before the node in the subroutine
+int wcet_sub_hi[WCET_NODES];
+UCHAR wcet_sub_ok[WCET_NODES]; // 1: reached from its entry
+UCHAR wcet_sub_chg[WCET_NODES];
+
+// measurement
+struct {
+    int sub;
+    UINT64 inst;
+    UINT64 cyc;
+} wcet_stk[RET_DEPTH]; // open calls
+int wcet_sp = 0;
+UINT64 wcet_run_inst; // counters at the start of the run
+UINT64 wcet_run_cyc;
+
+
+
+long long wcetAdd(long long a, long long b) {
+    return (a >= WCET_INF || b >= WCET_INF) ? WCET_INF : a + b;
+}
+
+
+
+long long wcetMul(long long a, long long b) {
+    if (a == 0 || b == 0) return 0;
+    return (a >= WCET_INF || b >= WCET_INF || a > WCET_INF / b) ? WCET_INF : a * b;
+}
+
+
+
+// Stop the analysis with a message
+
+void wcetFail(const char *msg, UINT addr) {
+    if (wcet_err[0] == '\0') sprintf(wcet_err, "%s at %04X", msg, addr);
+}
+
+
+
+// Subroutine at entry address addr, added on first use
+
+int wcetSubAt(UINT addr, int node) {
+    WCET_SUB *S;
+    if (wcet_sub_at[addr] >= 0) return wcet_sub_at[addr];
+    if (wcet_n_sub == WCET_SUBS) {
+        wcetFail("too many subroutines", addr);
+        return 0;
+    }
+    S = &wcet_sub[wcet_n_sub];
+    memset(S, 0, sizeof(*S));
+    S->node = node;
+    wcet_sub_at[addr] = (short)wcet_n_sub;
+    return wcet_n_sub++;
+}
+
+
+
+// Node of the instruction at addr, decoded on first use
+
+// - succ[] holds addresses until wcetBuild() links the nodes
+
+// - return -1 on error
+
+int wcetNode(UINT addr) {
+    WCET_NODE *n;
+    UINT op;
+    UINT a;
+    long long w = BUS_LATENCY * (2 / BUS_WIDTH); // cycles per word
+    int len;
+
+    if (addr + 4 > MEM_SIZE) {
+        wcetFail("code out of memory", addr);
+        return -1;
+    }
+    if (wcet_node_at[addr] >= 0) return wcet_node_at[addr];
+    if (wcet_n_node == WCET_NODES) {
+        wcetFail("too many instructions", addr);
+        return -1;
+    }
+    n = &wcet_node[wcet_n_node];
+    memset(n, 0, sizeof(*n));
+    n->addr = addr;
+    len = decodeInst(addr, &op, &n->ea, &n->base);
+    n->cyc = EXEC_CYCLES + w * len;
+    if (len == 2 && (readWord(addr) & 0x0200)) n->cyc += w; // pointer
+    if (op == 0x8000 && n->ea == END_OF_ARG) {
+        wcetFail("computed operation", addr);
+        return -1;
+    }
+    n->op = op;
+    n->kind = WK_NEXT;
+    n->succ[0] = (int)(addr + 2 * len);
+    n->n_succ = 1;
+
+    switch (op) {
+    case 0x1000: case 0x3000: case 0x4000: case 0xB000: case 0xE000: // LDA ADD SUB PRT CMP
+    case 0x2000: case 0xF020: case 0xF021: // STA LDX STX
+#if BANKS
+    case 0xF030: case 0xF031: case 0xF032: // BNK LDB STB
+#endif
+        n->cyc += w; // operand
+        break;
+    case 0x7000: case 0xF010: case 0xF011: // MUL DIV MOD
+        n->cyc += w + MULDIV_CYCLES - EXEC_CYCLES;
+        break;
+    case 0xC000: case 0x8002: case 0x8003: // PRC IAC INX
+        break;
+    case 0xD000: // PRS: bytes of the string in the image
+        if (n->ea == END_OF_ARG) n->cyc += (long long)MEM_SIZE * BUS_LATENCY;
+        else {
+            for (a = n->ea; a < MEM_SIZE && readByte(a) != 0; a++);
+            n->cyc += (long long)(a - n->ea + 1) * BUS_LATENCY;
+        }
+        break;
+    case 0x5000: case 0x6000: case 0x9000: case 0xA000: // JMP CAL BRZ BRN
+        if (n->ea == END_OF_ARG) {
+            wcetFail("computed jump", addr);
+            return -1;
+        }
+        if (op == 0x5000) {
+            n->kind = WK_JMP;
+            n->succ[0] = (int)n->ea;
+        }
+        else if (op == 0x6000) {
+            n->kind = WK_CAL;
+#if STACK_IN_MEM
+            n->cyc += w;
+#endif
+        }
+        else {
+            n->kind = WK_BR;
+            n->succ[1] = (int)n->ea;
+            n->n_succ = 2;
+        }
+        break;
+    case 0x8005: // RET
+        n->kind = WK_RET;
+        n->n_succ = 0;
+#if !RET_STACK
+        n->cyc += w;
+#endif
+        break;
+    default: // HLT
+        n->kind = WK_HLT;
+        n->n_succ = 0;
+        break;
+    }
+    wcet_node_at[addr] = (short)wcet_n_node;
+    return wcet_n_node++;
+}
+
+
+
+// Decode all instructions reachable from addr (subroutine 0)
+
+int wcetBuild(UINT addr) {
+    int i, k;
+    memset(wcet_node_at, 0xFF, sizeof(wcet_node_at));
+    memset(wcet_sub_at, 0xFF, sizeof(wcet_sub_at));
+    wcet_n_node = 0;
+    wcet_n_sub = 0;
+    if (wcetNode(addr) < 0) return 0;
+    wcetSubAt(addr, 0);
+    for (i = 0; i < wcet_n_node; i++) {
+        WCET_NODE *n = &wcet_node[i];
+        for (k = 0; k < n->n_succ; k++) {
+            n->succ[k] = wcetNode((UINT)n->succ[k]);
+            if (n->succ[k] < 0) return 0;
+        }
+        if (n->kind == WK_CAL) {
+            int t = wcetNode(n->ea);
+            if (t < 0) return 0;
+            n->callee = wcetSubAt(n->ea, t);
+        }
+    }
+    return wcet_err[0] == '\0';
+}
+
+
+
+// Join range l ~ h into *lo ~ *hi, widened after WCET_WIDEN changes
+
+// - return 1 if changed
+
+int wcetJoin(int *lo, int *hi, UCHAR *chg, int l, int h) {
+    int c = 0;
+    if (l < *lo) {
+        *lo = (*chg >= WCET_WIDEN) ? -ACC_MAX : l;
+        c = 1;
+    }
+    if (h > *hi) {
+        *hi = (*chg >= WCET_WIDEN) ? ACC_MAX : h;
+        c = 1;
+    }
+    if (c && *chg < 255) (*chg)++;
+    return c;
+}
+
+
+
+// Join range l ~ h into ACC before node i
+
+int wcetAccJoin(int i, int l, int h) {
+    WCET_NODE *n = &wcet_node[i];
+    if (!n->acc_ok) {
+        n->acc_ok = 1;
+        n->acc_lo = l;
+        n->acc_hi = h;
+        return 1;
+    }
+    return wcetJoin(&n->acc_lo, &n->acc_hi, &n->acc_chg, l, h);
+}
+
+
+
+// 1: node n is STA or STX that may store to the word at addr
+
+// - an indexed store stays at or after its address operand (in its array)
+
+int wcetStoreHits(WCET_NODE *n, UINT addr) {
+    if (n->op != 0x2000 && n->op != 0xF021) return 0;
+    if (n->ea != END_OF_ARG) return n->ea + 1 >= addr && n->ea <= addr + 1;
+    return n->base == END_OF_ARG || addr + 1 >= n->base;
+}
+
+
+
+// Range of the word at addr before node x of subroutine s
+
+// - s = -1: as found by wcetRanges() for all instructions
+
+// - else narrowed by the context of s if s does not store the word, and by
+
+//   the loop counters of s
+
+void wcetWordAt(int s, int x, UINT addr, int *lo, int *hi) {
+    WCET_SUB *S;
+    WCET_RANGE *R;
+    int k;
+
+    *lo = wcet_mem_lo[addr];
+    *hi = wcet_mem_hi[addr];
+    if (s < 0) return;
+    S = &wcet_sub[s];
+    for (k = 0; k < S->n_ctx + wcet_n_cnt; k++) {
+        if (k < S->n_ctx) {
+            if (S->wild || S->wr[addr]) continue;
+            R = &S->ctx[k];
+        }
+        else {
+            WCET_COUNTER *C = &wcet_cnt[k - S->n_ctx];
+            if (C->sub != s || !C->in[x]) continue;
+            R = &C->v;
+        }
+        if (R->addr != addr) continue;
+        if (R->lo > *lo) *lo = R->lo;
+        if (R->hi < *hi) *hi = R->hi;
+    }
+}
+
+
+
+// ACC after node i from lo ~ hi before it, with words read as by wcetWordAt()
+
+void wcetAccStep(int s, int i, int *lo, int *hi) {
+    WCET_NODE *n = &wcet_node[i];
+    int l, h;
+
+    switch (n->op) {
+    case 0x1000: // LDA
+        if (n->ea == END_OF_ARG) *lo = -ACC_MAX, *hi = ACC_MAX;
+        else wcetWordAt(s, i, n->ea, lo, hi);
+        break;
+    case 0x3000: // ADD
+    case 0x4000: // SUB
+        if (n->ea == END_OF_ARG) {
+            *lo = -ACC_MAX, *hi = ACC_MAX;
+            break;
+        }
+        wcetWordAt(s, i, n->ea, &l, &h);
+        if (n->op == 0x3000) *lo += l, *hi += h;
+        else *lo -= h, *hi -= l;
+        break;
+    case 0x8002: // IAC
+        (*lo)++, (*hi)++;
+        break;
+    case 0x7000: case 0xF010: case 0xF011: case 0xF031: // MUL DIV MOD LDB
+        *lo = -ACC_MAX, *hi = ACC_MAX;
+        break;
+    }
+    // the magnitude wraps modulo 0x8000
+    if (*hi > ACC_MAX) {
+        *hi = ACC_MAX;
+        if (*lo > 0) *lo = 0;
+    }
+    if (*lo < -ACC_MAX) {
+        *lo = -ACC_MAX;
+        if (*hi < 0) *hi = 0;
+    }
+}
+
+
+
+// Interval analysis of ACC and memory words over all instructions
+
+void wcetRanges() {
+    UINT a;
+    int i, k, c;
+
+    for (a = 0; a <= MEM_SIZE; a++) {
+        wcet_mem_lo[a] = wcet_mem_hi[a] = (a + 1 < MEM_SIZE) ? accnum2cint(readWord(a)) : 0;
+        wcet_mem_chg[a] = 0;
+#if STACK_IN_MEM
+        if (a < STACK_END + 1) {
+            wcet_mem_lo[a] = -ACC_MAX;
+            wcet_mem_hi[a] = ACC_MAX;
+        }
+#endif
+    }
+    for (i = 0; i < n_in_addr; i++) {
+        wcet_mem_lo[in_addr[i]] = WCET_IN_MIN;
+        wcet_mem_hi[in_addr[i]] = WCET_IN_MAX;
+    }
+    wcetAccJoin(0, 0, 0);
+
+    do {
+        c = 0;
+        for (i = 0; i < wcet_n_node; i++) {
+            WCET_NODE *n = &wcet_node[i];
+            int lo = n->acc_lo, hi = n->acc_hi;
+            if (!n->acc_ok) continue;
+            if (n->op == 0x2000 || n->op == 0xF021) { // STA STX
+                for (a = 0; a <= MEM_SIZE; a++) {
+                    if (!wcetStoreHits(n, a)) continue;
+                    if (a == n->ea && n->op == 0x2000) c |= wcetJoin(&wcet_mem_lo[a], &wcet_mem_hi[a], &wcet_mem_chg[a], lo, hi);
+                    else c |= wcetJoin(&wcet_mem_lo[a], &wcet_mem_hi[a], &wcet_mem_chg[a], -ACC_MAX, ACC_MAX);
+                }
+            }
+            wcetAccStep(-1, i, &lo, &hi);
+            if (n->kind == WK_CAL) {
+                c |= wcetAccJoin(wcet_sub[n->callee].node, lo, hi);
+                lo = -ACC_MAX, hi = ACC_MAX; // ACC of the callee at RET
+            }
+            for (k = 0; k < n->n_succ; k++) c |= wcetAccJoin(n->succ[k], lo, hi);
+        }
+    } while (c);
+}
+
+
+
+// Collect nodes and predecessors of subroutine s
+
+void wcetCollect(int s) {
+    int i, k, t;
+    memset(wcet_in_sub, 0, sizeof(wcet_in_sub));
+    wcet_n_list = 0;
+    wcet_list[wcet_n_list++] = wcet_sub[s].node;
+    wcet_in_sub[wcet_sub[s].node] = 1;
+    for (i = 0; i < wcet_n_list; i++) {
+        WCET_NODE *n = &wcet_node[wcet_list[i]];
+        for (k = 0; k < n->n_succ; k++) {
+            t = n->succ[k];
+            if (!wcet_in_sub[t]) {
+                wcet_in_sub[t] = 1;
+                wcet_list[wcet_n_list++] = t;
+            }
+        }
+    }
+
+    memset(wcet_pred_at, 0, sizeof(wcet_pred_at));
+    for (i = 0; i < wcet_n_list; i++) {
+        WCET_NODE *n = &wcet_node[wcet_list[i]];
+        for (k = 0; k < n->n_succ; k++) wcet_pred_at[n->succ[k] + 1]++;
+    }
+    for (i = 0; i < wcet_n_node; i++) wcet_pred_at[i + 1] += wcet_pred_at[i];
+    memset(wcet_pred_n, 0, sizeof(wcet_pred_n));
+    for (i = 0; i < wcet_n_list; i++) {
+        WCET_NODE *n = &wcet_node[wcet_list[i]];
+        for (k = 0; k < n->n_succ; k++) {
+            t = n->succ[k];
+            wcet_pred[wcet_pred_at[t] + wcet_pred_n[t]++] = wcet_list[i];
+        }
+    }
+}
+
+
+
+// Words each subroutine may store with its callees, and its nodes
+
+// - repeated until no set grows, for recursive calls
+
+void wcetWrites() {
+    static UCHAR own[MEM_SIZE + 1];
+    int s, i, k, c, wild;
+
+    do {
+        c = 0;
+        for (s = 0; s < wcet_n_sub; s++) {
+            WCET_SUB *S = &wcet_sub[s];
+            wcetCollect(s);
+            memcpy(wcet_member[s], wcet_in_sub, sizeof(wcet_member[s]));
+            memset(own, 0, sizeof(own));
+            wild = 0;
+            for (i = 0; i < wcet_n_list; i++) {
+                WCET_NODE *n = &wcet_node[wcet_list[i]];
+                if (n->op == 0x2000 || n->op == 0xF021) {
+                    if (n->base == END_OF_ARG) wild = 1;
+                    else if (n->ea != END_OF_ARG) own[n->ea] = 1;
+                    else memset(own + n->base, 1, MEM_SIZE + 1 - n->base);
+                }
+            }
+            for (k = MEM_SIZE; k > 0; k--) own[k] |= own[k - 1]; // overlapping words
+            for (k = 0; k < MEM_SIZE; k++) own[k] |= own[k + 1];
+            for (i = 0; i < wcet_n_list; i++) {
+                WCET_NODE *n = &wcet_node[wcet_list[i]];
+                if (n->kind != WK_CAL) continue;
+                wild |= wcet_sub[n->callee].wild;
+                for (k = 0; k <= MEM_SIZE; k++) own[k] |= wcet_sub[n->callee].wr[k];
+            }
+            if (wild && !S->wild) S->wild = c = 1;
+            for (k = 0; k <= MEM_SIZE; k++) {
+                if (own[k] && !S->wr[k]) S->wr[k] = c = 1;
+            }
+        }
+    } while (c);
+}
+
+
+
+// Join range l ~ h into ACC before node i in the subroutine
+
+int wcetSubJoin(int i, int l, int h) {
+    if (!wcet_sub_ok[i]) {
+        wcet_sub_ok[i] = 1;
+        wcet_sub_lo[i] = l;
+        wcet_sub_hi[i] = h;
+        return 1;
+    }
+    return wcetJoin(&wcet_sub_lo[i], &wcet_sub_hi[i], &wcet_sub_chg[i], l, h);
+}
+
+
+
+// Interval analysis of ACC over subroutine s collected by wcetCollect(),
+
+// from ACC at its entry and with words read as by wcetWordAt()
+
+void wcetSubRanges(int s) {
+    int i, k, c, x = wcet_list[0];
+
+    for (i = 0; i < wcet_n_list; i++) {
+        wcet_sub_ok[wcet_list[i]] = 0;
+        wcet_sub_chg[wcet_list[i]] = 0;
+    }
+    if (!wcet_node[x].acc_ok) return;
+    wcetSubJoin(x, wcet_node[x].acc_lo, wcet_node[x].acc_hi);
+
+    do {
+        c = 0;
+        for (i = 0; i < wcet_n_list; i++) {
+            WCET_NODE *n = &wcet_node[x = wcet_list[i]];
+            int lo = wcet_sub_lo[x], hi = wcet_sub_hi[x];
+            if (!wcet_sub_ok[x]) continue;
+            wcetAccStep(s, x, &lo, &hi);
+            if (n->kind == WK_CAL) lo = -ACC_MAX, hi = ACC_MAX; // ACC of the callee at RET
+            for (k = 0; k < n->n_succ; k++) c |= wcetSubJoin(n->succ[k], lo, hi);
+        }
+    } while (c);
+}
+
+
+
+// Add the word at addr to the context of subroutine s if its range at
+
+// every CAL of s is narrower than the interval analysis found
+
+void wcetNarrow(int s, UINT addr) {
+    WCET_SUB *S = &wcet_sub[s];
+    int c, i, k, lo = 0, hi = 0, l, h, any = 0;
+
+    for (k = 0; k < S->n_ctx; k++) {
+        if (S->ctx[k].addr == addr) return;
+    }
+    if (S->n_ctx == WCET_CTX) return;
+    for (i = 0; i < wcet_n_node; i++) {
+        WCET_NODE *n = &wcet_node[i];
+        if (n->kind != WK_CAL || n->callee != s || !n->acc_ok) continue;
+        for (c = 0; c < wcet_n_sub; c++) {
+            if (!wcet_member[c][i]) continue;
+            wcetWordAt(c, i, addr, &l, &h);
+            if (!any || l < lo) lo = l;
+            if (!any || h > hi) hi = h;
+            any = 1;
+        }
+    }
+    if (!any || (lo <= wcet_mem_lo[addr] && hi >= wcet_mem_hi[addr])) return;
+    S->ctx[S->n_ctx].addr = addr;
+    S->ctx[S->n_ctx].lo = lo;
+    S->ctx[S->n_ctx++].hi = hi;
+}
+
+
+
+// Context of subroutine s from the counters of the loops and the contexts
+
+// of the subroutines analyzed so far
+
+void wcetContext(int s) {
+    int c, k;
+
+    wcet_sub[s].n_ctx = 0;
+    if (s == 0) return; // the program is entered at the start address too
+    for (k = 0; k < wcet_n_cnt; k++) wcetNarrow(s, wcet_cnt[k].v.addr);
+    for (c = 0; c < wcet_n_sub; c++) {
+        for (k = 0; k < wcet_sub[c].n_ctx; k++) wcetNarrow(s, wcet_sub[c].ctx[k].addr);
+    }
+}
+
+// - return 0 if a loop has more than one entry
+
+int wcetFindLoops() {
+    static int stk[WCET_NODES], nxt[WCET_NODES], work[WCET_NODES];
+    static UCHAR color[WCET_NODES];
+    int sp = 0, i, j, k, x, t, L;
+
+    wcet_n_loop = 0;
+    for (i = 0; i < wcet_n_list; i++) {
+        wcet_head_loop[wcet_list[i]] = -1;
+        color[wcet_list[i]] = 0;
+    }
+
+    // depth first search, an edge to a node on the stack is a back edge
+    stk[sp] = wcet_list[0];
+    nxt[sp++] = 0;
+    color[wcet_list[0]] = 1;
+    while (sp > 0) {
+        x = stk[sp - 1];
+        if (nxt[sp - 1] == wcet_node[x].n_succ) {
+            color[x] = 2;
+            sp--;
+            continue;
+        }
+        t = wcet_node[x].succ[nxt[sp - 1]++];
+        if (color[t] == 0) {
+            color[t] = 1;
+            stk[sp] = t;
+            nxt[sp++] = 0;
+        }
+        else if (color[t] == 1) {
+            // back edge x -> t: add the nodes reaching x to the loop of t
+            int n_work = 0;
+            L = wcet_head_loop[t];
+            if (L < 0) {
+                if (wcet_n_loop == WCET_LOOPS) {
+                    wcetFail("too many loops", wcet_node[t].addr);
+                    return 0;
+                }
+                L = wcet_head_loop[t] = wcet_n_loop++;
+                memset(wcet_body[L], 0, sizeof(wcet_body[L]));
+                wcet_loop[L].head = t;
+                wcet_loop[L].tail = 0;
+                wcet_body[L][t] = 1;
+            }
+            if (wcet_node[x].addr > wcet_loop[L].tail) wcet_loop[L].tail = wcet_node[x].addr;
+            if (!wcet_body[L][x]) {
+                wcet_body[L][x] = 1;
+                work[n_work++] = x;
+            }
+            while (n_work > 0) {
+                int y = work[--n_work];
+                for (k = wcet_pred_at[y]; k < wcet_pred_at[y + 1]; k++) {
+                    int p = wcet_pred[k];
+                    if (!wcet_body[L][p]) {
+                        wcet_body[L][p] = 1;
+                        work[n_work++] = p;
+                    }
+                }
+            }
+        }
+    }
+
+    for (L = 0; L < wcet_n_loop; L++) {
+        WCET_LOOP *P = &wcet_loop[L];
+        P->size = 0;
+        P->parent = -1;
+        P->n_exit = 0;
+        P->term = 0;
+        for (i = 0; i < wcet_n_list; i++) {
+            WCET_NODE *n;
+            x = wcet_list[i];
+            if (!wcet_body[L][x]) continue;
+            P->size++;
+            n = &wcet_node[x];
+            if (x != P->head) {
+                for (k = wcet_pred_at[x]; k < wcet_pred_at[x + 1]; k++) {
+                    if (!wcet_body[L][wcet_pred[k]]) {
+                        wcetFail("loop entered not at its head", n->addr);
+                        return 0;
+                    }
+                }
+            }
+            if (n->kind == WK_RET || n->kind == WK_HLT) P->term = 1;
+            for (k = 0; k < n->n_succ; k++) {
+                t = n->succ[k];
+                if (wcet_body[L][t]) continue;
+                for (j = 0; j < P->n_exit && P->exit[j] != t; j++);
+                if (j < P->n_exit) continue;
+                if (P->n_exit == WCET_EXITS) {
+                    wcetFail("too many loop exits", n->addr);
+                    return 0;
+                }
+                P->exit[P->n_exit++] = t;
+            }
+        }
+    }
+    for (L = 0; L < wcet_n_loop; L++) {
+        for (j = 0; j < wcet_n_loop; j++) {
+            if (j == L || !wcet_body[j][wcet_loop[L].head]) continue;
+            if (wcet_loop[L].parent < 0 || wcet_loop[j].size < wcet_loop[wcet_loop[L].parent].size)
+                wcet_loop[L].parent = j;
+        }
+    }
+    return 1;
+}
+
+
+
+// Check "LDA v / IAC|ADD step / STA v" at STA node x
+
+// - return step, 0 if not an increment
+
+int wcetStep(int x, UINT v) {
+    WCET_NODE *n = &wcet_node[x];
+    WCET_NODE *p1, *p0;
+    int step;
+    if (n->op != 0x2000 || n->ea != v || wcet_pred_n[x] != 1) return 0;
+    p1 = &wcet_node[wcet_pred[wcet_pred_at[x]]];
+    if (p1->op == 0x8002) step = 1;
+    else if (p1->op == 0x3000 && p1->ea != END_OF_ARG && wcet_mem_lo[p1->ea] > 0) step = wcet_mem_lo[p1->ea];
+    else return 0;
+    x = wcet_pred[wcet_pred_at[x]];
+    if (wcet_pred_n[x] != 1) return 0;
+    p0 = &wcet_node[wcet_pred[wcet_pred_at[x]]];
+    return (p0->op == 0x1000 && p0->ea == v && p0->kind == WK_NEXT) ? step : 0;
+}
+
+
+
+// 1: loop L or a subroutine it calls may store the word at addr
+
+int wcetStores(int L, UINT addr) {
+    int i;
+    for (i = 0; i < wcet_n_list; i++) {
+        WCET_NODE *n = &wcet_node[wcet_list[i]];
+        if (!wcet_body[L][wcet_list[i]]) continue;
+        if (wcetStoreHits(n, addr)) return 1;
+        if (n->kind == WK_CAL && (wcet_sub[n->callee].wild || wcet_sub[n->callee].wr[addr])) return 1;
+    }
+    return 0;
+}
+
+
+
+// Range of limit at the head of loop L of subroutine s, which does not store it
+
+// - if the only stores of limit in s and its callees are "STA limit" in s
+
+//   and every way from the entry to the head passes one: ACC at those stores
+
+// - else the word at the head, see wcetWordAt()
+
+void wcetLimit(int s, int L, UINT lim, int *lo, int *hi) {
+    static int work[WCET_NODES];
+    static UCHAR seen[WCET_NODES];
+    int h = wcet_loop[L].head;
+    int i, k, x, t, n_work = 0, l = 0, u = 0, any = 0;
+
+    wcetWordAt(s, h, lim, lo, hi);
+    for (i = 0; i < wcet_n_list; i++) {
+        WCET_NODE *n = &wcet_node[x = wcet_list[i]];
+        seen[x] = 0;
+        if (n->kind == WK_CAL && (wcet_sub[n->callee].wild || wcet_sub[n->callee].wr[lim])) return;
+        if (!wcetStoreHits(n, lim) || !wcet_sub_ok[x]) continue;
+        if (n->op != 0x2000 || n->ea != lim) return;
+        seen[x] = 1; // a way ends at a store
+        if (!any || wcet_sub_lo[x] < l) l = wcet_sub_lo[x];
+        if (!any || wcet_sub_hi[x] > u) u = wcet_sub_hi[x];
+        any = 1;
+    }
+    if (!any || wcet_list[0] == h) return;
+
+    // the head is not reached from the entry without a store
+    x = wcet_list[0];
+    if (!seen[x]) {
+        seen[x] = 1;
+        work[n_work++] = x;
+    }
+    while (n_work > 0) {
+        WCET_NODE *n = &wcet_node[work[--n_work]];
+        for (k = 0; k < n->n_succ; k++) {
+            t = n->succ[k];
+            if (t == h) return;
+            if (seen[t]) continue;
+            seen[t] = 1;
+            work[n_work++] = t;
+        }
+    }
+    if (l > *lo) *lo = l;
+    if (u < *hi) *hi = u;
+}
+
+
+
+// Infer the bound of loop L of subroutine s from its counter
+
+// - return WCET_INF if the loop does not match
+
+// - the counter is recorded in wcet_cnt[] for the CALs in the loop
+
+long long wcetInfer(int s, int L, char *how) {
+    static int work[WCET_NODES];
+    static UCHAR seen[WCET_NODES];
+    int h = wcet_loop[L].head;
+    WCET_NODE *n0 = &wcet_node[h], *n1, *n2;
+    WCET_COUNTER *C;
+    UINT lim, v;
+    int i, k, x, t, n_work = 0, step = 0, lo, hi;
+    long long lim_hi, v_lo;
+
+    // head: LDA limit / SUB|CMP v / BRN out
+    if (n0->op != 0x1000 || n0->ea == END_OF_ARG || n0->kind != WK_NEXT) return WCET_INF;
+    x = n0->succ[0];
+    n1 = &wcet_node[x];
+    if ((n1->op != 0x4000 && n1->op != 0xE000) || n1->ea == END_OF_ARG || wcet_pred_n[x] != 1 || !wcet_body[L][x])
+        return WCET_INF;
+    x = n1->succ[0];
+    n2 = &wcet_node[x];
+    if (n2->op != 0xA000 || wcet_pred_n[x] != 1 || !wcet_body[L][x]) return WCET_INF;
+    if (wcet_body[L][n2->succ[1]] || !wcet_body[L][n2->succ[0]]) return WCET_INF;
+    lim = n0->ea;
+    v = n1->ea;
+    if (lim == v || wcetStores(L, lim)) return WCET_INF;
+
+    // every store of v in the loop is an increment, nothing else stores v
+    for (i = 0; i < wcet_n_list; i++) {
+        WCET_NODE *n = &wcet_node[wcet_list[i]];
+        if (!wcet_body[L][wcet_list[i]]) continue;
+        if (n->op == 0x2000 && n->ea == v) {
+            k = wcetStep(wcet_list[i], v);
+            if (k == 0) return WCET_INF;
+            if (step == 0 || k < step) step = k;
+        }
+        else if (wcetStoreHits(n, v))
+            return WCET_INF;
+        else if (n->kind == WK_CAL && (wcet_sub[n->callee].wild || wcet_sub[n->callee].wr[v]))
+            return WCET_INF;
+    }
+    if (step == 0) return WCET_INF;
+
+    // no way around the loop without an increment
+    for (i = 0; i < wcet_n_list; i++) seen[wcet_list[i]] = 0;
+    seen[h] = 1;
+    work[n_work++] = h;
+    while (n_work > 0) {
+        WCET_NODE *n = &wcet_node[work[--n_work]];
+        for (k = 0; k < n->n_succ; k++) {
+            t = n->succ[k];
+            if (t == h) return WCET_INF;
+            if (seen[t] || !wcet_body[L][t]) continue;
+            seen[t] = 1;
+            if (wcet_node[t].op == 0x2000 && wcet_node[t].ea == v) continue;
+            work[n_work++] = t;
+        }
+    }
+
+    // v at entry: initial value or stored outside the loop
+    v_lo = accnum2cint(readWord(v));
+    for (i = 0; i < n_in_addr; i++) {
+        if (in_addr[i] == v) v_lo = WCET_IN_MIN;
+    }
+    for (i = 0; i < wcet_n_node; i++) {
+        WCET_NODE *n = &wcet_node[i];
+        if (!wcetStoreHits(n, v) || wcet_body[L][i] || !n->acc_ok) continue;
+        if (n->op != 0x2000 || n->ea != v) return WCET_INF;
+        if (n->acc_lo < v_lo) v_lo = n->acc_lo;
+    }
+
+    // v <= limit on each repeat, without wrapping
+    wcetLimit(s, L, lim, &lo, &hi);
+    lim_hi = hi;
+    if (lim_hi + step > ACC_MAX || (n1->op == 0x4000 && lim_hi - v_lo > ACC_MAX)) return WCET_INF;
+
+    // at most one increment on a way around, none after it: v_lo <= v <= limit
+    if (wcet_n_cnt == WCET_LOOPS) return WCET_INF;
+    C = &wcet_cnt[wcet_n_cnt];
+    for (i = 0; i < wcet_n_list; i++) {
+        x = wcet_list[i];
+        C->in[x] = wcet_body[L][x];
+        if (C->in[x] && wcet_node[x].op == 0x2000 && wcet_node[x].ea == v) work[n_work++] = x;
+    }
+    C->in[h] = C->in[n0->succ[0]] = C->in[n1->succ[0]] = 0; // the test: v <= limit + step
+    while (n_work > 0) {
+        WCET_NODE *n = &wcet_node[work[--n_work]];
+        for (k = 0; k < n->n_succ; k++) {
+            t = n->succ[k];
+            if (t == h || !C->in[t]) continue;
+            if (wcet_node[t].op == 0x2000 && wcet_node[t].ea == v) return WCET_INF;
+            C->in[t] = 0;
+            work[n_work++] = t;
+        }
+    }
+    C->sub = s;
+    C->v.addr = v;
+    C->v.lo = (int)v_lo;
+    C->v.hi = (int)lim_hi;
+    wcet_n_cnt++;
+    sprintf(how, "inferred: %04X from %lld to %04X <= %lld, step %d", v, v_lo, lim, lim_hi, step);
+    return (lim_hi < v_lo) ? 0 : (lim_hi - v_lo) / step + 1;
+}
+
+
+
+void wcetPath(int x, int L, int m);
+
+
+
+// Extend the longest ways by w and the edge to node t
+
+void wcetEdge(int t, long long w, int L, int m, long long *back, long long *out) {
+    long long b = -1, o = -1;
+    if (L >= 0 && t == wcet_loop[L].head) b = 0;
+    else if (L >= 0 && !wcet_body[L][t]) {
+        if (t == wcet_goal) o = 0;
+    }
+    else {
+        wcetPath(t, L, m);
+        b = wcet_back[t];
+        o = wcet_exit[t];
+    }
+    if (b >= 0 && wcetAdd(b, w) > *back) *back = wcetAdd(b, w);
+    if (o >= 0 && wcetAdd(o, w) > *out) *out = wcetAdd(o, w);
+}
+
+
+
+// Longest ways from node x in loop L (-1: the subroutine) for metric m
+
+// - m = 0: instructions, 1: cycles
+
+// - wcet_back[x]: to a back edge of L, wcet_exit[x]: out of L to wcet_goal
+
+//   (WCET_TERM: ending at RET or HLT), -1 if none
+
+void wcetPath(int x, int L, int m) {
+    int inner = wcet_head_loop[x];
+    long long back = -1, out = -1;
+    int k;
+
+    if (wcet_seen[x]) return;
+    wcet_seen[x] = 1;
+    if (inner >= 0 && inner != L) {
+        // a nested loop is one step with a cost per exit
+        WCET_LOOP *I = &wcet_loop[inner];
+        if (wcet_goal == WCET_TERM) out = I->term_cost[m];
+        for (k = 0; k < I->n_exit; k++) {
+            if (I->exit_cost[m][k] >= 0) wcetEdge(I->exit[k], I->exit_cost[m][k], L, m, &back, &out);
+        }
+    }
+    else {
+        WCET_NODE *n = &wcet_node[x];
+        long long w = m ? n->cyc : 1;
+        if (n->kind == WK_CAL) w = wcetAdd(w, m ? wcet_sub[n->callee].cyc : wcet_sub[n->callee].inst);
+        if ((n->kind == WK_RET || n->kind == WK_HLT) && wcet_goal == WCET_TERM) out = w;
+        for (k = 0; k < n->n_succ; k++) wcetEdge(n->succ[k], w, L, m, &back, &out);
+    }
+    wcet_back[x] = back;
+    wcet_exit[x] = out;
+}
+
+
+
+// Longest ways from node x in loop L (-1: the subroutine) to goal
+
+void wcetPaths(int x, int L, int m, int goal) {
+    int i;
+    for (i = 0; i < wcet_n_list; i++) wcet_seen[wcet_list[i]] = 0;
+    wcet_goal = goal;
+    wcetPath(x, L, m);
+}
+
+
+
+// Cost of loop L: bound * longest way around + longest way out, per exit
+
+void wcetLoopCost(int L, int m) {
+    WCET_LOOP *P = &wcet_loop[L];
+    long long around;
+    int k, out = 0;
+
+    wcetPaths(P->head, L, m, WCET_TERM);
+    around = wcetMul(P->bound, wcet_back[P->head] < 0 ? 0 : wcet_back[P->head]);
+    P->term_cost[m] = (wcet_exit[P->head] < 0) ? -1 : wcetAdd(around, wcet_exit[P->head]);
+    out |= P->term_cost[m] >= 0;
+    for (k = 0; k < P->n_exit; k++) {
+        wcetPaths(P->head, L, m, P->exit[k]);
+        P->exit_cost[m][k] = (wcet_exit[P->head] < 0) ? -1 : wcetAdd(around, wcet_exit[P->head]);
+        out |= P->exit_cost[m][k] >= 0;
+    }
+    if (!out) P->term_cost[m] = WCET_INF; // no way out
+}
+
+
+
+// Bounds of the loops of subroutine s into wcet_rep[]
+
+void wcetBounds(int s) {
+    int k, L;
+
+    wcetCollect(s);
+    wcetContext(s);
+    wcetSubRanges(s);
+    if (!wcetFindLoops()) return;
+    for (L = 0; L < wcet_n_loop; L++) {
+        WCET_LOOP *P = &wcet_loop[L];
+        UINT addr = wcet_node[P->head].addr;
+        char how[64];
+        P->bound = WCET_INF;
+        strcpy(how, "no bound");
+        for (k = 0; k < asm_n_bound; k++) {
+            if (asm_bound[k].addr == addr) {
+                P->bound = asm_bound[k].n;
+                strcpy(how, "annotated");
+            }
+        }
+        if (P->bound == WCET_INF) P->bound = wcetInfer(s, L, how);
+        for (k = 0; k < wcet_n_rep && wcet_rep[k].head != addr; k++);
+        if (k == WCET_LOOPS) continue;
+        if (k == wcet_n_rep) {
+            wcet_rep[k].head = addr;
+            wcet_rep[k].tail = P->tail;
+            wcet_rep[k].bound = -1;
+            wcet_n_rep++;
+        }
+        if (P->bound > wcet_rep[k].bound) { // a loop in two subroutines: the larger
+            wcet_rep[k].bound = P->bound;
+            strcpy(wcet_rep[k].how, how);
+        }
+    }
+}
+
+
+
+// 1: every subroutine with a CAL of s but s itself has its bounds
+
+int wcetCallersDone(int s, UCHAR *done) {
+    int c, i;
+    for (i = 0; i < wcet_n_node; i++) {
+        if (wcet_node[i].kind != WK_CAL || wcet_node[i].callee != s) continue;
+        for (c = 0; c < wcet_n_sub; c++) {
+            if (c != s && wcet_member[c][i] && !done[c]) return 0;
+        }
+    }
+    return 1;
+}
+
+
+
+// Worst case of subroutine s, callees first
+
+void wcetSub(int s) {
+    WCET_SUB *S = &wcet_sub[s];
+    int callee[WCET_SUBS];
+    int order[WCET_LOOPS];
+    int n_callee = 0, i, j, k, L, m;
+    long long cost;
+
+    S->state = 1;
+    S->inst = S->cyc = WCET_INF; // until done (recursion)
+    wcetCollect(s);
+    for (i = 0; i < wcet_n_list; i++) {
+        WCET_NODE *n = &wcet_node[wcet_list[i]];
+        if (n->kind != WK_CAL) continue;
+        for (k = 0; k < n_callee && callee[k] != n->callee; k++);
+        if (k == n_callee) callee[n_callee++] = n->callee;
+    }
+    for (k = 0; k < n_callee; k++) {
+        if (wcet_sub[callee[k]].state == 0) wcetSub(callee[k]);
+    }
+    if (wcet_err[0] != '\0') return;
+    wcetCollect(s);
+    if (!wcetFindLoops()) return;
+
+    // bounds from wcetBounds(), then costs from the innermost loop
+    for (L = 0; L < wcet_n_loop; L++) {
+        WCET_LOOP *P = &wcet_loop[L];
+        UINT addr = wcet_node[P->head].addr;
+        P->bound = WCET_INF;
+        for (k = 0; k < wcet_n_rep; k++) {
+            if (wcet_rep[k].head == addr) P->bound = wcet_rep[k].bound;
+        }
+        for (j = L; j > 0 && wcet_loop[order[j - 1]].size > P->size; j--) order[j] = order[j - 1];
+        order[j] = L;
+    }
+    for (m = 0; m < 2; m++) {
+        for (j = 0; j < wcet_n_loop; j++) wcetLoopCost(order[j], m);
+        wcetPaths(wcet_list[0], -1, m, WCET_TERM);
+        cost = (wcet_exit[wcet_list[0]] < 0) ? WCET_INF : wcet_exit[wcet_list[0]];
+        if (m == 0) S->inst = cost;
+        else S->cyc = cost;
+    }
+    S->state = 2;
+}
+
+
+
+// Analyze the program at addr with the inputs just read
+
+void wcetAnalyze(UINT addr) {
+    UCHAR done[WCET_SUBS];
+    int s, k;
+    wcet_done = 1;
+    if (!wcetBuild(addr)) return;
+    wcetRanges();
+    wcetWrites();
+
+    // bounds with callers first: their counters narrow the words at each CAL
+    memset(done, 0, sizeof(done));
+    for (k = 0; k < wcet_n_sub && wcet_err[0] == '\0'; k++) {
+        for (s = 0; s < wcet_n_sub && (done[s] || !wcetCallersDone(s, done)); s++);
+        if (s == wcet_n_sub) for (s = 0; done[s]; s++); // calls in a cycle
+        done[s] = 1;
+        wcetBounds(s);
+    }
+    for (s = 0; s < wcet_n_sub && wcet_err[0] == '\0'; s++) {
+        if (wcet_sub[s].state == 0) wcetSub(s);
+    }
+}
+
+
+
+// Measure a run: begin, CAL of addr, RET, end
+
+void wcetBegin() {
+    wcet_sp = 0;
+    wcet_run_inst = inst_cnt;
+    wcet_run_cyc = bus_total;
+}
+
+
+
+void wcetMax(WCET_SUB *S, UINT64 inst, UINT64 cyc) {
+    S->calls++;
+    if (inst > S->max_inst) S->max_inst = inst;
+    if (cyc > S->max_cyc) S->max_cyc = cyc;
+}
+
+
+
+void wcetCall(UINT addr) {
+    if (wcet_sp < RET_DEPTH) {
+        wcet_stk[wcet_sp].sub = wcet_sub_at[addr];
+        wcet_stk[wcet_sp].inst = inst_cnt;
+        wcet_stk[wcet_sp].cyc = bus_total;
+    }
+    wcet_sp++;
+}
+
+
+
+void wcetReturn() {
+    if (wcet_sp == 0) return;
+    wcet_sp--;
+    if (wcet_sp < RET_DEPTH && wcet_stk[wcet_sp].sub >= 0)
+        wcetMax(&wcet_sub[wcet_stk[wcet_sp].sub], inst_cnt - wcet_stk[wcet_sp].inst, bus_total - wcet_stk[wcet_sp].cyc);
+}
+
+
+
+void wcetEnd() {
+    if (wcet_n_sub > 0) wcetMax(&wcet_sub[0], inst_cnt - wcet_run_inst, bus_total - wcet_run_cyc);
+}
+
+
+
+// Print loop bounds and worst cases against measured maxima
+
+void printWcetStats() {
+    int i;
+    printf("[WCET]\n");
+    if (wcet_err[0] != '\0') {
+        printf("analysis stopped: %s\n", wcet_err);
+        return;
+    }
+    printf("inputs %d ~ %d\n", WCET_IN_MIN, WCET_IN_MAX);
+    for (i = 0; i < wcet_n_rep; i++) {
+        WCET_REPORT *r = &wcet_rep[i];
+        printf("loop %04X-%04X: ", r->head, r->tail);
+        if (r->bound >= WCET_INF) printf("%s\n", r->how);
+        else printf("bound %lld (%s)\n", r->bound, r->how);
+    }
+    for (i = 0; i < wcet_n_sub; i++) {
+        WCET_SUB *S = &wcet_sub[i];
+        printf("%s %04X: ", i ? "sub" : "program", wcet_node[S->node].addr);
+        if (S->inst >= WCET_INF) printf("unbounded");
+        else printf("%lld instructions, %lld cycles", S->inst, S->cyc);
+        if (S->calls == 0) {
+            printf("\n");
+            continue;
+        }
+        printf("; measured %llu, %llu in %llu %s", S->max_inst, S->max_cyc, S->calls, i ? "calls" : "runs");
+        if (S->inst < WCET_INF) {
+            int ok = S->max_inst <= (UINT64)S->inst && S->max_cyc <= (UINT64)S->cyc;
+            printf(" (%.1f%%, %.1f%%)%s", 100.0 * S->max_inst / S->inst, 100.0 * S->max_cyc / S->cyc,
+                   ok ? "" : " EXCEEDED");
+        }
+        printf("\n");
+    }
+}
+
+#define WCET_BEGIN() wcetBegin()
+#define WCET_CALL(addr) wcetCall(addr)
+#define WCET_RET() wcetReturn()
+#define WCET_END() wcetEnd()
+
+#else
+
+#define WCET_BEGIN()
+#define WCET_CALL(addr)
+#define WCET_RET()
+#define WCET_END()
+
+#endif
+
+
+
+//========================================
+
+// Run program
+
+// - addr: start address of program
+
+// - return exit state = 0: normal exit
+
+// 1: error exit
+
+//========================================
+
+// Fetch and execute from addr until HLT or a fault
+
+// - its locals live in registers: a guard page fault leaves this frame
+
+//   by siglongjmp() to runProgram()
+
+int runCycles(UINT addr) {
+
+    int status = ST_RUN;
+    UINT mar;
+    UINT mbr;
+    UINT ir;
+    UINT ir_i;
+    UINT ir_a;
+    UINT psw = 0;
+
+
+
+    pc = addr;
+    WCET_BEGIN();
+
+
+
+    while (status == ST_RUN) {
+        //-------fetch cycle ------------/
+        mar = pc;
+        //printf("%04x\n",pc);
+        mbr = readWord(mar);
+        BUS_NEXT(CLS_HALT);
+        BUS_WORD(BUS_FETCH);
+        BUS_EXEC(EXEC_CYCLES);
+        ir = mbr;
+        ir_i = ir & 0xF000;
+        ir_a = ir & 0x0FFF;
+
+        pc += (UINT)2;
+        inst_cnt++;
+
+
+
+        //----execution cycle---------------/
+        if (ir_i == 0xf000) //extended: mode, operation, address in next word
+        {
+            mar = readWord(pc);
+            BUS_WORD(BUS_FETCH);
+            pc += 2;
+            if (ir & 0x0200) //indirect
+            {
+                mar &= 0x0FFF;
+                mbr = readWord(mar);
+                BUS_WORD(BUS_READ);
+                MEMO_READ(mar, mbr);
+                mar = mbr;
+            }
+            if (ir & 0x0100) mar += xr; //indexed
+            mar &= 0x0FFF;
+            if ((ir & 0x00FF) < 0x0010) //base instruction at the effective address
+            {
+                ir_i = (ir & 0x000F) << 12;
+                ir_a = mar;
+            }
+        }
+
+        if (ir_i == 0x0000) {
+            break;
+        }
+
+        else if (ir_i == 0x1000) //LDA
+        {
+            mar = ir_a;
+            mbr = readWord(mar);
+            BUS_CLASS(CLS_LDST);
+            BUS_WORD(BUS_READ);
+            MEMO_READ(mar, mbr);
+            acc = mbr;
+            if (acc > 0x8000) psw = 0x1000;
+            else if (acc == 0x0000) psw = 0x0001;
+            else psw = 0x0000;
+        }
+
+        else if (ir_i == 0x2000) //STA
+        {
+            mar = ir_a;
+            writeWord(mar, acc);
+            BUS_CLASS(CLS_LDST);
+            BUS_WORD(BUS_WRITE);
+            MEMO_WRITE(mar, acc);
+#if USE_LOOP_ACCEL
+            if (mar + 1 >= code_bgn && mar < code_end) loopBegin(); // code changed
+#endif
+        }
+
+        else if (ir_i == 0x3000) //ADD
+        {
+            mar = ir_a;
+            mbr = readWord(mar);
+            BUS_CLASS(CLS_ALU);
+            BUS_WORD(BUS_READ);
+            MEMO_READ(mar, mbr);
+            c_num = accnum2cint(acc) + accnum2cint(mbr);
+            acc = cint2accnum(c_num);
+            if (acc > 0x8000) psw = 0x1000;
+            else if (acc == 0x0000) psw = 0x0001;
+            else psw = 0x0000;
+        }
+
+        else if (ir_i == 0x4000) //SUB
+        {
+            mar = ir_a;
+            mbr = readWord(mar);
+            BUS_CLASS(CLS_ALU);
+            BUS_WORD(BUS_READ);
+            MEMO_READ(mar, mbr);
+            c_num = accnum2cint(acc) - accnum2cint(mbr);
+            acc = cint2accnum(c_num);
+            if (acc > 0x8000) psw = 0x1000;
+            else if (acc == 0x0000) psw = 0x0001;
+            else psw = 0x0000;
+        }
+
+        else if (ir_i == 0x5000) //JMP
+        {
+            mar = ir_a;
+            BUS_CLASS(CLS_BRANCH);
+#if USE_LOOP_ACCEL
+            if (ir_a < pc && loopRun(ir_a, pc, &psw)) continue;
+#endif
+            pc = mar;
+        }
+        else if(ir_i == 0x6000)//CAL
+        {
+            mar = ir_a;
+#if USE_MEMO
+            if (memoCall(ir_a, &psw)) continue;
+            if (memo_depth > 0) memoStack(tos, pc);
+#endif
+            push(pc);
+            BUS_CLASS(CLS_CALL);
+#if STACK_IN_MEM
+            BUS_WORD(BUS_STACK);
+#endif
+            WCET_CALL(ir_a);
+            pc = ir_a;
+#if USE_MEMO
+            memoEnter(ir_a, psw);
+#endif
+        }
+        else if (ir_i == 0x7000)//MUL
+        {
+            mar = ir_a;
+            mbr = readWord(mar);
+            BUS_CLASS(CLS_MULDIV);
+            BUS_WORD(BUS_READ);
+            BUS_EXEC(MULDIV_CYCLES - EXEC_CYCLES);
+            MEMO_READ(mar, mbr);
+            c_num = accnum2cint(acc) * accnum2cint(mbr);
+            acc = cint2accnum(c_num);
+            if (acc > 0x8000) psw = 0x1000;
+            else if (acc == 0x0000) psw = 0x0001;
+            else psw = 0x0000;
+
+        }
+        else if(ir_i == 0x9000){
+            BUS_CLASS(CLS_BRANCH);
+            if((psw & 0x0FFF) == 0x0001)
+            {
+                mar = ir_a;
+                pc = mar;
+            }
+            else{
+                continue;
+            }
+        }
+        else if (ir_i == 0xa000) //BRN
+        {
+            BUS_CLASS(CLS_BRANCH);
+            if ((psw & 0xF000) == 0x1000) //음수일 경우 지정한곳으로 분기해야한다.
+            {
+                mar = ir_a;
+                pc = mar;
+            }
+
+            else {
+                continue;
+            }
+        }
+
+        else if (ir_i == 0xb000) {
+            mar = ir_a;
+            MEMO_IO();
+            prt(mar);
+            BUS_CLASS(CLS_IO);
+            BUS_WORD(BUS_READ);
+        }
+
+        else if (ir_i == 0xc000) {
+            mar = ir_a;
+            MEMO_IO();
+            prc(mar);
+            BUS_CLASS(CLS_IO);
+        }
+
+        else if (ir_i == 0xd000) {
+            mar = ir_a;
+            MEMO_IO();
+#if BUS_TIMING
+            {
+                UINT len = out_len;
+                prs(mar);
+                BUS_CLASS(CLS_IO);
+                BUS_BYTES(BUS_READ, out_len - len + 1); // chars and terminating NUL
+            }
+#else
+            prs(mar);
+#endif
+        }
+
+        else if (ir_i == 0xe000) //CMP
+        {
+            mar = ir_a;
+            mbr = readWord(mar);
+            BUS_CLASS(CLS_ALU);
+            BUS_WORD(BUS_READ);
+            MEMO_READ(mar, mbr);
+            c_num = accnum2cint(acc) - accnum2cint(mbr);
+            if (c_num < 0) psw = 0x1000;
+            else if (c_num == 0) psw = 0x0001;
+            else psw = 0x0000;
+        }
+
+        else if (ir_i == 0xf000) //DIV, MOD, LDX, STX at the effective address
+        {
+            UINT op = ir & 0x00FF;
+            if (op == 0x0010 || op == 0x0011) //DIV, MOD
+            {
+                int d;
+                mbr = readWord(mar);
+                BUS_CLASS(CLS_MULDIV);
+                BUS_WORD(BUS_READ);
+                BUS_EXEC(MULDIV_CYCLES - EXEC_CYCLES);
+                MEMO_READ(mar, mbr);
+                d = accnum2cint(mbr);
+                if (d == 0) {
+                    printf("\nFault: divide by zero at PC %04X\n", pc - 4);
+#if USE_GUARD_PAGES
+                    fault_armed = 0;
+#endif
+                    return 1;
+                }
+                c_num = (op == 0x0010) ? accnum2cint(acc) / d : accnum2cint(acc) % d;
+                acc = cint2accnum(c_num);
+                if (acc > 0x8000) psw = 0x1000;
+                else if (acc == 0x0000) psw = 0x0001;
+                else psw = 0x0000;
+            }
+            else if (op == 0x0020) //LDX
+            {
+                mbr = readWord(mar);
+                BUS_CLASS(CLS_LDST);
+                BUS_WORD(BUS_READ);
+                MEMO_READ(mar, mbr);
+                xr = mbr;
+            }
+            else if (op == 0x0021) //STX
+            {
+                writeWord(mar, xr);
+                BUS_CLASS(CLS_LDST);
+                BUS_WORD(BUS_WRITE);
+                MEMO_WRITE(mar, xr);
+#if USE_LOOP_ACCEL
+                if (mar + 1 >= code_bgn && mar < code_end) loopBegin(); // code changed
+#endif
+            }
+#if BANKS
+            else if (op == 0x0030) //BNK
+            {
+                mbr = readWord(mar);
+                BUS_CLASS(CLS_LDST);
+                BUS_WORD(BUS_READ);
+                MEMO_IO(); // bank state is not memoized
+                if (!selectBank(mbr)) {
+                    printf("\nFault: bank %u out of memory at PC %04X\n", mbr, pc - 4);
+#if USE_GUARD_PAGES
+                    fault_armed = 0;
+#endif
+                    return 1;
+                }
+            }
+            else if (op == 0x0031) //LDB
+            {
+                MEMO_IO();
+                acc = readBankWord(mar);
+                BUS_CLASS(CLS_LDST);
+                BUS_WORD(BUS_READ);
+                if (acc > 0x8000) psw = 0x1000;
+                else if (acc == 0x0000) psw = 0x0001;
+                else psw = 0x0000;
+            }
+            else if (op == 0x0032) //STB
+            {
+                MEMO_IO();
+                writeBankWord(mar, acc);
+                BUS_CLASS(CLS_LDST);
+                BUS_WORD(BUS_WRITE);
+            }
+#endif
+            else ST_RUN = 1;
+        }
+
+        else if (ir_i == 0x8000) {
+            if(ir_a == 0x0005)
+            {
+                pc = pop();
+                BUS_CLASS(CLS_CALL);
+#if !RET_STACK
+                BUS_WORD(BUS_STACK);
+#endif
+                WCET_RET();
+#if USE_MEMO
+                memoReturn(psw);
+#endif
+                // printf("!!!!!! %04x\n",pc);
+                continue;
+            }
+            else if (ir_a == 0x0002)
+            {
+                acc = cint2accnum(accnum2cint(acc) + 1);
+                BUS_CLASS(CLS_ALU);
+            }
+            else if (ir_a == 0x0003) //INX
+            {
+                xr = (xr + 2) & 0xFFFF;
+                BUS_CLASS(CLS_ALU);
+            }
+            else ST_RUN = 1;
+        }
+    }
+    WCET_END();
+#if USE_GUARD_PAGES
+    fault_armed = 0;
+#endif
+    return 0;
+}
+
+
+
+int runProgram(UINT addr) {
+    pc = addr;
+
+#if USE_GUARD_PAGES
+    if (sigsetjmp(fault_jmp, 1)) {
+        // fault in fetch cycle: at pc, otherwise in the instruction at pc - 2
+        UINT fault_pc = (fault_addr == (long)pc || fault_addr == (long)pc + 1) ? pc : pc - 2;
+        printf("\nFault: address %04lX out of memory at PC %04X\n", fault_addr, fault_pc);
+        return 1;
+    }
+    fault_armed = 1;
+#endif
+    return runCycles(addr);
+}
+
+
+
+//========================================
+
+// Result Cache
+
+// - key: hash of memory image after inputData()
+
+// - value: output and final DATA section of the run
+
+// - an entry also keeps the image it was run from, a hit must match it
+
+// - the file is locked while an entry is read or written (flock),
+
+//   so concurrent runs never see a half-written entry
+
+//========================================
+
+#if USE_RESULT_CACHE
+
+#define CACHE_MAGIC 0x414343434F4D0001ULL // "ACCCOM" + version
+
+
+
+typedef struct {
+    UINT64 key; // image hash (0: empty slot)
+    UINT regs[5]; // sections and start address of the run
+    UCHAR image[MEM_SIZE]; // memory image the run started from
+    int exit_code; // exit code of the run
+    UINT out_len; // length of out[]
+    UINT data_bgn; // DATA section of the run
+    UINT data_end;
+    char out[OUT_SIZE]; // output bytes
+    UCHAR data[MEM_SIZE]; // final DATA section
+} CACHE_ENTRY;
+
+typedef struct {
+    UINT64 magic; // CACHE_MAGIC ^ sizeof(CACHE_ENTRY)
+    CACHE_ENTRY slot[CACHE_SLOTS];
+} CACHE_STORE;
+
+CACHE_STORE *cache = NULL; // mmap'd cache file
+int cache_fd = -1; // cache file, for flock()
+UINT cache_regs[5]; // sections and start address of this run
+UCHAR cache_image[MEM_SIZE]; // memory image before this run
+
+
+
+// Hash memory image, sections and start address (FNV-1a)
+
+// - keeps a copy of them to check a hit and to store with the result
+
+UINT64 hashImage(UINT start_addr) {
+    UINT64 h = 0xCBF29CE484222325ULL;
+    int i;
+    UINT addr;
+
+    cache_regs[0] = data_bgn; cache_regs[1] = data_end;
+    cache_regs[2] = code_bgn; cache_regs[3] = code_end;
+    cache_regs[4] = start_addr;
+    for (i = 0; i < 5; i++) h = (h ^ cache_regs[i]) * 0x100000001B3ULL;
+    for (addr = 0; addr < MEM_SIZE; addr++) h = (h ^ mem[addr]) * 0x100000001B3ULL;
+    memcpy(cache_image, mem, MEM_SIZE);
+    return h ? h : 1;
+}
+
+
+
+// Open (or create) the cache file
+
+void openCache() {
+    size_t size = sizeof(CACHE_STORE);
+    UINT64 magic = CACHE_MAGIC ^ sizeof(CACHE_ENTRY);
+    void *p;
+    int fd = open(CACHE_FILE, O_RDWR | O_CREAT, 0644);
+
+    if (fd < 0) return;
+    flock(fd, LOCK_EX);
+    if (ftruncate(fd, (off_t)size) == 0) {
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) cache = (CACHE_STORE *)p;
+    }
+
+    // file made by another build: start over
+    if (cache != NULL && cache->magic != magic) {
+        memset(cache, 0, size);
+        cache->magic = magic;
+    }
+    flock(fd, LOCK_UN);
+    if (cache == NULL) close(fd);
+    else cache_fd = fd;
+}
+
+
+
+// Replay a cached run
+
+// - return 1: hit, 0: miss
+
+int lookupCache(UINT64 key, int *exit_code) {
+    CACHE_ENTRY *e;
+    UINT addr;
+
+    if (cache == NULL) return 0;
+    e = &cache->slot[key % CACHE_SLOTS];
+    flock(cache_fd, LOCK_SH);
+    if (e->key != key || memcmp(e->regs, cache_regs, sizeof(cache_regs)) != 0
+        || memcmp(e->image, cache_image, MEM_SIZE) != 0) {
+        flock(cache_fd, LOCK_UN);
+        return 0; // other image, or one with the same hash
+    }
+
+    fwrite(e->out, 1, e->out_len, stdout);
+    for (addr = e->data_bgn; addr < e->data_end; addr += 2) {
+        writeWord(addr, (e->data[addr - e->data_bgn] << 8) | e->data[addr - e->data_bgn + 1]);
+    }
+    *exit_code = e->exit_code;
+    flock(cache_fd, LOCK_UN);
+    return 1;
+}
+
+
+
+// Save the output and DATA section of a finished run
+
+void storeCache(UINT64 key, int exit_code) {
+    CACHE_ENTRY *e;
+    UINT addr;
+
+    if (cache == NULL || out_len > OUT_SIZE) return;
+    e = &cache->slot[key % CACHE_SLOTS];
+    flock(cache_fd, LOCK_EX);
+
+    e->key = 0; // slot is invalid while being written
+    memcpy(e->regs, cache_regs, sizeof(cache_regs));
+    memcpy(e->image, cache_image, MEM_SIZE);
+    e->exit_code = exit_code;
+    e->out_len = out_len;
+    e->data_bgn = data_bgn;
+    e->data_end = data_end;
+    memcpy(e->out, out_buf, out_len);
+    for (addr = data_bgn; addr < data_end; addr += 2) {
+        e->data[addr - data_bgn] = (UCHAR)(readWord(addr) >> 8);
+        e->data[addr - data_bgn + 1] = (UCHAR)readWord(addr);
+    }
+    e->key = key;
+    flock(cache_fd, LOCK_UN);
+}
+
+#endif
+
+
+
+//========================================
+
+// Rewrite Rules
+
+// - "target => replacement | flags", one rule per line, '#' starts a comment
+
+// - instructions separated by '/': LDA STA ADD SUB MUL CMP with an operand, IAC
+
+// - operand Vn: a variable word (different n: different words),
+
+//   #k: a word that always holds the AccCom number k
+
+// - flags: psw: only where PSW is not used after the target,
+
+//   edges: verified on boundary values of two or more inputs, not on all
+
+//========================================
+
+#if SUPEROPT || (USE_PEEPHOLE && PEEP_RULES)
+
+#define RULE_CONST 0x10000 // operand RULE_CONST + w: constant word w
+
+typedef struct {
+    UINT op; // 0x1000 ~ 0xE000 or IAC 0x8002
+    int arg; // -1: none, 0 ~: variable Vn, RULE_CONST ~: constant
+} RULE_INST;
+
+typedef struct {
+    int n; // # of target instructions
+    int m; // # of replacement instructions
+    RULE_INST from[RULE_LEN];
+    RULE_INST to[RULE_LEN];
+    int psw; // 1: PSW must not be used after the target
+    int edges; // 1: not verified on every input
+} RULE;
+
+RULE rule[RULES]; // rewrite rules
+int n_rule = 0;
+
+
+
+// Print n rule instructions as "LDA V0 / IAC"
+
+void ruleText(char *str, RULE_INST *in, int n) {
+    int i, j;
+
+    str[0] = '\0';
+    for (i = 0; i < n; i++) {
+        for (j = 0; asm_op[j].name != NULL && asm_op[j].code != in[i].op; j++);
+        str += sprintf(str, "%s%s", i ? " / " : "", asm_op[j].name ? asm_op[j].name : "???");
+        if (in[i].arg >= RULE_CONST) str += sprintf(str, " #%d", accnum2cint(in[i].arg - RULE_CONST));
+        else if (in[i].arg >= 0) str += sprintf(str, " V%d", in[i].arg);
+    }
+}
+
+
+
+// Parse rule instructions "LDA V0 / IAC"
+
+// - return # of instructions, -1 if malformed
+
+int ruleParse(char *str, RULE_INST *in) {
+    char *tok;
+    int n = 0, j;
+
+    for (tok = strtok(str, " \t\r\n"); tok != NULL; tok = strtok(NULL, " \t\r\n")) {
+        if (strcmp(tok, "/") == 0) continue;
+        if (n == RULE_LEN) return -1;
+        for (j = 0; asm_op[j].name != NULL && strcmp(asm_op[j].name, tok) != 0; j++);
+        if (asm_op[j].name == NULL) return -1;
+        in[n].op = asm_op[j].code;
+        in[n].arg = -1;
+        if (in[n].op != 0x8002) {
+            if (in[n].op < 0x1000 || in[n].op > 0xE000) return -1;
+            tok = strtok(NULL, " \t\r\n");
+            if (tok == NULL) return -1;
+            if (tok[0] == 'V') in[n].arg = atoi(tok + 1);
+            else if (tok[0] == '#') in[n].arg = RULE_CONST + (int)cint2accnum(atoi(tok + 1));
+            else return -1;
+        }
+        n++;
+    }
+    return n;
+}
+
+
+
+// Read RULE_FILE into rule[]
+
+// - return # of rules (0 if there is no file)
+
+int readRules() {
+    FILE *f = fopen(RULE_FILE, "r");
+    char line[256];
+    char *to, *flags;
+
+    n_rule = 0;
+    if (f == NULL) return 0;
+    while (n_rule < RULES && fgets(line, sizeof(line), f) != NULL) {
+        RULE *r = &rule[n_rule];
+        if (line[0] == '#' || (to = strstr(line, "=>")) == NULL) continue;
+        *to = '\0';
+        to += 2;
+        flags = strchr(to, '|');
+        r->psw = r->edges = 0;
+        if (flags != NULL) {
+            *flags++ = '\0';
+            r->psw = strstr(flags, "psw") != NULL;
+            r->edges = strstr(flags, "edges") != NULL;
+        }
+        r->n = ruleParse(line, r->from);
+        r->m = ruleParse(to, r->to);
+        if (r->n > 0 && r->m >= 0 && r->m < r->n) n_rule++;
+    }
+    fclose(f);
+    return n_rule;
+}
+
+#endif
+
+
+
+//========================================
+
+// Peephole Optimizer
+
+// - rewrites the CODE section of the loaded image before the run
+
+// - control flow: JMP/BRZ/BRN to the target, CAL to the subroutine,
+
+//   RET to every return point (instruction after a CAL)
+
+// - removes unreachable instructions, instructions whose results are never
+
+//   used (liveness of ACC, PSW and memory words), LDA/STA of the value ACC
+
+//   already holds and JMP/BRZ/BRN to the next instruction
+
+// - rewrites ADD/SUB/MUL with a known result to LDA of a constant,
+
+//   IAC / IAC to ADD of a constant 2 and jumps to a JMP to its target
+
+// - PEEP_RULES: also applies the rewrite rules of RULE_FILE
+
+//   (PEEP_EDGES: also the ones verified on boundary values only)
+
+// - constants: DATA words that are never stored and are not inputs
+
+// - gives up on computed jumps and on operands that are indirect or in CODE,
+
+//   indexed operands are assumed to stay inside the section of their base
+
+//========================================
+
+#if USE_PEEPHOLE
+
+#define PEEP_ACC 0 // live set bits: ACC, PSW, then memory words
+#define PEEP_PSW 1
+#define PEEP_WORDS ((MEM_SIZE + 2) / 2) // # of memory words in a live set
+#define PEEP_SET ((PEEP_WORDS + 2 + 63) / 64) // # of UINT64 in a live set
+
+enum { PK_NEXT, PK_JMP, PK_BR, PK_CAL, PK_RET, PK_HLT };
+
+typedef struct {
+    UINT addr; // original address
+    UINT op; // 0x1000 ~ 0xE000, 0x8xxx or extended operation 0xF0xx
+    UINT ea; // effective address (END_OF_ARG: indexed)
+    UINT base; // address operand
+    int len; // # of words
+    int kind; // PK_xxx
+    int tgt; // JMP/BR/CAL: target instruction
+    UCHAR kill; // 1: removed
+    UCHAR edit; // 1: rewritten as op | ea
+} PEEP_INST;
+
+typedef struct {
+    int seen; // 1: reached by the analysis
+    int var; // ACC equals the word at var (-1: none)
+    int val; // value of ACC (-1: unknown)
+    int psw; // 1: PSW follows ACC
+} PEEP_VAL;
+
+PEEP_INST peep[PEEP_INSTS]; // instructions of the CODE section
+int peep_n;
+int peep_n_cal; // # of CAL instructions
+int peep_start; // instruction at the start address
+short peep_at[MEM_SIZE + 1]; // instruction at an address (-1: none)
+UINT64 peep_live[PEEP_INSTS][PEEP_SET]; // live before the instruction
+PEEP_VAL peep_val[PEEP_INSTS]; // known before the instruction
+UCHAR peep_const[MEM_SIZE + 1]; // 1: word is a constant
+char peep_err[64] = ""; // why the code was not optimized
+int peep_removed; // changes of the last image
+int peep_rewritten;
+int peep_retargeted;
+int peep_rule_hits; // # of applied rewrite rules
+int peep_rules_read = 0; // 1: RULE_FILE was read
+UINT peep_old_end; // CODE end before and after
+UINT peep_new_end;
+#if PEEP_CHECK
+UCHAR peep_mem[MEM_SIZE]; // memory image before optimizing
+UINT peep_orig_start; // start address of the original code
+UINT64 peep_cnt; // inst_cnt before the run
+UINT64 peep_inst_opt = 0; // executed instructions of all runs
+UINT64 peep_inst_orig = 0;
+int peep_runs = 0; // # of checked runs
+int peep_diff = 0; // # of runs with different results
+char peep_out[OUT_SIZE]; // output of the optimized code
+UCHAR peep_data[MEM_SIZE]; // DATA section after the optimized code
+#endif
+
+#define PEEP_HAS(s, b) (((s)[(b) >> 6] >> ((b) & 63)) & 1)
+#define PEEP_ADD(s, b) ((s)[(b) >> 6] |= 1ULL << ((b) & 63))
+
+
+
+// Stop the optimizer with a reason
+
+int peepFail(char *msg, UINT addr) {
+    sprintf(peep_err, msg, addr);
+    return 0;
+}
+
+
+
+// First instruction at or after i that is not removed (peep_n: none)
+
+int peepSkip(int i) {
+    while (i < peep_n && peep[i].kill) i++;
+    return i;
+}
+
+
+
+// Instruction executed after i when it does not jump
+
+int peepNext(int i) {
+    return peepSkip(i + 1);
+}
+
+
+
+// 1: the operand of p is a main memory word
+
+int peepMemOp(UINT op) {
+    switch (op) {
+    case 0x1000: case 0x2000: case 0x3000: case 0x4000: case 0x7000: // LDA STA ADD SUB MUL
+    case 0xB000: case 0xD000: case 0xE000: // PRT PRS CMP
+    case 0xF010: case 0xF011: case 0xF020: case 0xF021: // DIV MOD LDX STX
+#if BANKS
+    case 0xF030: // BNK
+#endif
+        return 1;
+    }
+    return 0;
+}
+
+
+
+// 1: p reads or writes a fixed word that cannot fault
+
+int peepDirect(PEEP_INST *p) {
+    return p->ea != END_OF_ARG && p->ea + 1 < MEM_SIZE;
+}
+
+
+
+// Decode the CODE section into peep[] and find the constants
+
+// - return 0 if the code is not safe to optimize
+
+int peepBuild(UINT start_addr) {
+    UINT addr;
+    PEEP_INST *p;
+    int i;
+
+    peep_n = peep_n_cal = 0;
+    memset(peep_at, 0xFF, sizeof(peep_at));
+    for (addr = code_bgn; addr < code_end; addr += 2 * p->len) {
+        if (peep_n == PEEP_INSTS) return peepFail("more than %d instructions", PEEP_INSTS);
+        p = &peep[peep_n];
+        p->addr = addr;
+        p->len = decodeInst(addr, &p->op, &p->ea, &p->base);
+        p->kill = p->edit = 0;
+        p->tgt = -1;
+        if (p->op == 0x5000) p->kind = PK_JMP;
+        else if (p->op == 0x6000) p->kind = PK_CAL;
+        else if (p->op == 0x9000 || p->op == 0xA000) p->kind = PK_BR;
+        else if (p->op == 0x8005) p->kind = PK_RET;
+        else if (p->op == 0x8002 || p->op == 0x8003 || peepMemOp(p->op) || p->op == 0xC000) p->kind = PK_NEXT;
+#if BANKS
+        else if (p->op == 0xF031 || p->op == 0xF032) p->kind = PK_NEXT;
+#endif
+        else if (p->op == 0x8000 && p->ea == END_OF_ARG) return peepFail("computed operation at %04X", addr);
+        else p->kind = PK_HLT;
+
+        if (p->kind == PK_JMP || p->kind == PK_CAL || p->kind == PK_BR) {
+            if (p->ea == END_OF_ARG) return peepFail("computed jump at %04X", addr);
+        }
+        if (p->kind == PK_CAL) peep_n_cal++;
+        if (peepMemOp(p->op)) {
+            if (p->base == END_OF_ARG) return peepFail("indirect operand at %04X", addr);
+            if (p->base + 1 >= code_bgn && p->base < code_end) return peepFail("operand in CODE at %04X", addr);
+#if STACK_IN_MEM
+            if (p->base < STACK_END) return peepFail("operand in stack at %04X", addr);
+#endif
+        }
+        peep_at[addr] = (short)peep_n++;
+    }
+    if (peep_n == 0) return peepFail("no CODE", 0);
+    if (peep[peep_n - 1].kind != PK_JMP && peep[peep_n - 1].kind != PK_RET && peep[peep_n - 1].kind != PK_HLT)
+        return peepFail("CODE runs past its end at %04X", peep[peep_n - 1].addr);
+
+    for (i = 0; i < peep_n; i++) {
+        p = &peep[i];
+        if (p->kind != PK_JMP && p->kind != PK_CAL && p->kind != PK_BR) continue;
+        if (p->ea >= MEM_SIZE || peep_at[p->ea] < 0) return peepFail("jump out of CODE at %04X", p->addr);
+        p->tgt = peep_at[p->ea];
+    }
+    if (start_addr >= MEM_SIZE || peep_at[start_addr] < 0) return peepFail("start %04X not in CODE", start_addr);
+    peep_start = peep_at[start_addr];
+
+    // constants: DATA words never stored by STA/STX, not inputs
+    memset(peep_const, 0, sizeof(peep_const));
+    for (addr = data_bgn & ~1; addr < data_end && addr + 1 < MEM_SIZE; addr += 2) peep_const[addr] = 1;
+    for (i = 0; i < n_in_addr; i++) peep_const[in_addr[i] & ~1] = peep_const[(in_addr[i] + 1) & ~1] = 0;
+    for (i = 0; i < peep_n; i++) {
+        p = &peep[i];
+        if (p->op != 0x2000 && p->op != 0xF021) continue;
+        if (p->ea != END_OF_ARG) peep_const[p->ea & ~1] = peep_const[(p->ea + 1) & ~1] = 0;
+        else memset(&peep_const[p->base & ~1], 0, MEM_SIZE + 1 - (p->base & ~1));
+    }
+    for (addr = code_bgn & ~1; addr < code_end && addr < MEM_SIZE; addr += 2) peep_const[addr] = 0;
+#if STACK_IN_MEM
+    memset(peep_const, 0, STACK_END);
+#endif
+    return 1;
+}
+
+
+
+// Address of a constant word with value v (-1: none)
+
+int peepFind(UINT v) {
+    UINT addr;
+    for (addr = data_bgn & ~1; addr < data_end && addr + 1 < MEM_SIZE; addr += 2) {
+        if (peep_const[addr] && readWord(addr) == v) return (int)addr;
+    }
+    return -1;
+}
+
+
+
+// Add the memory word(s) read at the operand of p to a live set
+
+void peepUseWord(UINT64 *s, PEEP_INST *p) {
+    int b;
+    if (!peepDirect(p)) {
+        for (b = 2; b < PEEP_WORDS + 2; b++) PEEP_ADD(s, b);
+        return;
+    }
+    PEEP_ADD(s, 2 + (p->ea >> 1));
+    if (p->ea & 1) PEEP_ADD(s, 2 + ((p->ea + 1) >> 1));
+}
 
-//여기서 부터 코딩하면 된다.
 
 
+// Uses and definitions of an instruction
+
+// - instructions that may end the run use all memory
+
+void peepUseDef(PEEP_INST *p, UINT64 *use, UINT64 *def) {
+    PEEP_INST all = *p;
+    all.ea = END_OF_ARG;
+
+    memset(use, 0, sizeof(UINT64) * PEEP_SET);
+    memset(def, 0, sizeof(UINT64) * PEEP_SET);
+    switch (p->op) {
+    case 0x1000: // LDA
+        peepUseWord(use, p);
+        PEEP_ADD(def, PEEP_ACC);
+        PEEP_ADD(def, PEEP_PSW);
+        break;
+    case 0x2000: // STA
+    case 0xF021: // STX
+        if (p->op == 0x2000) PEEP_ADD(use, PEEP_ACC);
+        if (peepDirect(p) && !(p->ea & 1)) PEEP_ADD(def, 2 + (p->ea >> 1));
+        break;
+    case 0xF010: // DIV
+    case 0xF011: // MOD
+        peepUseWord(use, &all); // divide by zero
+        // fall through
+    case 0x3000: // ADD
+    case 0x4000: // SUB
+    case 0x7000: // MUL
+        peepUseWord(use, p);
+        PEEP_ADD(use, PEEP_ACC);
+        PEEP_ADD(def, PEEP_ACC);
+        PEEP_ADD(def, PEEP_PSW);
+        break;
+    case 0xE000: // CMP
+        peepUseWord(use, p);
+        PEEP_ADD(use, PEEP_ACC);
+        PEEP_ADD(def, PEEP_PSW);
+        break;
+    case 0x8002: // IAC
+        PEEP_ADD(use, PEEP_ACC);
+        PEEP_ADD(def, PEEP_ACC);
+        break;
+    case 0x9000: // BRZ
+    case 0xA000: // BRN
+        PEEP_ADD(use, PEEP_PSW);
+        break;
+    case 0xB000: // PRT
+    case 0xF020: // LDX
+        peepUseWord(use, p);
+        break;
+    case 0xD000: // PRS: string
+        peepUseWord(use, &all);
+        break;
+#if BANKS
+    case 0xF030: // BNK: bank fault
+        peepUseWord(use, &all);
+        break;
+    case 0xF031: // LDB
+        PEEP_ADD(def, PEEP_ACC);
+        PEEP_ADD(def, PEEP_PSW);
+        break;
+    case 0xF032: // STB
+        PEEP_ADD(use, PEEP_ACC);
+        break;
+#endif
+    default:
+        if (p->kind == PK_HLT || (p->kind == PK_RET && peep_n_cal == 0)) peepUseWord(use, &all);
+        break;
+    }
+}
+
+
+
+// Add the live set before instruction s to out
+
+void peepOr(UINT64 *out, int s) {
+    int k;
+    if (s >= peep_n) return;
+    for (k = 0; k < PEEP_SET; k++) out[k] |= peep_live[s][k];
+}
+
+
+
+// Live set after instruction i (union over its successors)
+
+void peepOut(int i, UINT64 *out) {
+    PEEP_INST *p = &peep[i];
+    int j;
+
+    memset(out, 0, sizeof(UINT64) * PEEP_SET);
+    if (p->kind == PK_RET) {
+        for (j = 0; j < peep_n; j++) {
+            if (!peep[j].kill && peep[j].kind == PK_CAL) peepOr(out, peepNext(j));
+        }
+        return;
+    }
+    if (p->kind == PK_NEXT || p->kind == PK_BR) peepOr(out, peepNext(i));
+    if (p->kind == PK_JMP || p->kind == PK_BR || p->kind == PK_CAL) peepOr(out, peepSkip(p->tgt));
+}
+
+
+
+// Backward liveness of ACC, PSW and memory words
+
+void peepLiveness() {
+    UINT64 out[PEEP_SET], use[PEEP_SET], def[PEEP_SET];
+    int i, k, chg;
+
+    memset(peep_live, 0, sizeof(peep_live));
+    do {
+        chg = 0;
+        for (i = peep_n - 1; i >= 0; i--) {
+            if (peep[i].kill) continue;
+            peepOut(i, out);
+            peepUseDef(&peep[i], use, def);
+            for (k = 0; k < PEEP_SET; k++) {
+                UINT64 in = use[k] | (out[k] & ~def[k]);
+                if (in != peep_live[i][k]) {
+                    peep_live[i][k] = in;
+                    chg = 1;
+                }
+            }
+        }
+    } while (chg);
+}
+
+
+
+// Result of ADD/SUB/MUL as runProgram() computes it
+
+UINT peepFold(UINT op, UINT a, UINT b) {
+    int x = accnum2cint(a);
+    int y = accnum2cint(b);
+    if (op == 0x3000) return cint2accnum(x + y);
+    if (op == 0x4000) return cint2accnum(x - y);
+    return cint2accnum(x * y);
+}
+
+
+
+// Value of the constant operand of p (-1: not a constant)
+
+int peepConst(PEEP_INST *p) {
+    if (!peepDirect(p) || !peep_const[p->ea]) return -1;
+    return (int)readWord(p->ea);
+}
+
+
+
+// What is known after instruction p, given s before it
+
+PEEP_VAL peepStep(PEEP_INST *p, PEEP_VAL s) {
+    int c = peepConst(p);
+
+    switch (p->op) {
+    case 0x1000: // LDA
+        s.var = (peepDirect(p) && !(p->ea & 1)) ? (int)p->ea : -1;
+        s.val = c;
+        s.psw = 1;
+        break;
+    case 0x2000: // STA
+    case 0xF021: // STX
+        if (p->ea == END_OF_ARG) s.var = -1;
+        else if (p->op == 0x2000 && !(p->ea & 1)) s.var = (int)p->ea;
+        else if (s.var + 1 >= (int)p->ea && s.var <= (int)p->ea + 1) s.var = -1;
+        break;
+    case 0x3000: // ADD
+    case 0x4000: // SUB
+    case 0x7000: // MUL
+        s.val = (s.val >= 0 && c >= 0) ? (int)peepFold(p->op, (UINT)s.val, (UINT)c) : -1;
+        s.var = -1;
+        s.psw = 1;
+        break;
+    case 0xF010: // DIV
+    case 0xF011: // MOD
+    case 0xF031: // LDB
+        s.var = s.val = -1;
+        s.psw = 1;
+        break;
+    case 0xE000: // CMP
+        s.psw = 0;
+        break;
+    case 0x8002: // IAC
+        s.val = (s.val >= 0) ? (int)cint2accnum(accnum2cint((UINT)s.val) + 1) : -1;
+        s.var = -1;
+        s.psw = 0;
+        break;
+    }
+    return s;
+}
+
+
+
+// Merge s into what is known before instruction i
+
+// - return 1 if it changed
+
+int peepMeet(int i, PEEP_VAL s) {
+    PEEP_VAL *d;
+    PEEP_VAL old;
+
+    if (i >= peep_n) return 0;
+    d = &peep_val[i];
+    old = *d;
+    if (!d->seen) {
+        *d = s;
+        d->seen = 1;
+        return 1;
+    }
+    if (d->var != s.var) d->var = -1;
+    if (d->val != s.val) d->val = -1;
+    d->psw &= s.psw;
+    return memcmp(d, &old, sizeof(old)) != 0;
+}
+
+
+
+// Forward analysis of the value in ACC
+
+// - nothing is known at the start, at subroutines and at return points
+
+void peepValues() {
+    PEEP_VAL none = { 1, -1, -1, 0 };
+    PEEP_INST *p;
+    int i, chg;
+
+    memset(peep_val, 0, sizeof(peep_val));
+    peepMeet(peepSkip(peep_start), none);
+    for (i = 0; i < peep_n; i++) {
+        p = &peep[i];
+        if (p->kill || p->kind != PK_CAL) continue;
+        peepMeet(peepSkip(p->tgt), none);
+        peepMeet(peepNext(i), none);
+    }
+    do {
+        chg = 0;
+        for (i = 0; i < peep_n; i++) {
+            PEEP_VAL s;
+            p = &peep[i];
+            if (p->kill || !peep_val[i].seen) continue;
+            s = peepStep(p, peep_val[i]);
+            if (p->kind == PK_NEXT || p->kind == PK_BR) chg |= peepMeet(peepNext(i), s);
+            if (p->kind == PK_JMP || p->kind == PK_BR) chg |= peepMeet(peepSkip(p->tgt), s);
+        }
+    } while (chg);
+}
+
+
+
+// Remove unreachable instructions and every LDA/STA/ADD/SUB/MUL/CMP/IAC
+
+// whose results are not live
+
+// - return # of removed instructions
+
+int peepDead() {
+    UINT64 out[PEEP_SET], use[PEEP_SET], def[PEEP_SET];
+    int i, k, n = 0;
+
+    for (i = 0; i < peep_n; i++) {
+        PEEP_INST *p = &peep[i];
+        int any = 0, live = 0;
+        if (p->kill) continue;
+        if (!peep_val[i].seen) {
+            p->kill = 1;
+            n++;
+            continue;
+        }
+        if (p->op != 0x1000 && p->op != 0x2000 && p->op != 0x3000 && p->op != 0x4000 &&
+            p->op != 0x7000 && p->op != 0xE000 && p->op != 0x8002) continue;
+        if (p->op != 0x8002 && !peepDirect(p)) continue;
+        peepOut(i, out);
+        peepUseDef(p, use, def);
+        for (k = 0; k < PEEP_SET; k++) {
+            any |= def[k] != 0;
+            live |= (def[k] & out[k]) != 0;
+        }
+        if (any && !live) {
+            p->kill = 1;
+            n++;
+        }
+    }
+    peep_removed += n;
+    return n;
+}
+
+
+
+// 1: a jump, a CAL or a return lands on instruction j
+
+int peepLanding(int j) {
+    int i;
+    if (j == peepSkip(peep_start)) return 1;
+    for (i = 0; i < peep_n; i++) {
+        PEEP_INST *p = &peep[i];
+        if (p->kill) continue;
+        if (p->tgt >= 0 && peepSkip(p->tgt) == j) return 1;
+        if (p->kind == PK_CAL && peepNext(i) == j) return 1;
+    }
+    return 0;
+}
+
+
+
+#if PEEP_RULES
+
+// Apply rule r to the instructions from i
+
+// - return 1 if it matched
+
+// - rules not verified on every input are skipped unless PEEP_EDGES
+
+int peepRule(int i, RULE *r) {
+    UINT64 out[PEEP_SET];
+    int at[RULE_LEN];
+    int var[RULE_LEN]; // address bound to Vn (-1: none)
+    int ea[RULE_LEN]; // operands of the replacement
+    int k, j = i, v;
+
+    if (r->edges && !PEEP_EDGES) return 0;
+    for (k = 0; k < RULE_LEN; k++) var[k] = -1;
+    for (k = 0; k < r->n; k++) {
+        PEEP_INST *p = &peep[j];
+        RULE_INST *in = &r->from[k];
+        if (j >= peep_n || p->op != in->op || (k > 0 && peepLanding(j))) return 0;
+        if (in->arg >= RULE_CONST) {
+            if (peepConst(p) != in->arg - RULE_CONST) return 0;
+        }
+        else if (in->arg >= 0) {
+            if (in->arg >= RULE_LEN || !peepDirect(p) || (p->ea & 1)) return 0;
+            if (var[in->arg] < 0) {
+                for (v = 0; v < RULE_LEN; v++) {
+                    if (var[v] == (int)p->ea) return 0; // Vn are different words
+                }
+                var[in->arg] = (int)p->ea;
+            }
+            else if (var[in->arg] != (int)p->ea) return 0;
+        }
+        at[k] = j;
+        j = peepNext(j);
+    }
+    if (r->psw) {
+        peepOut(at[r->n - 1], out);
+        if (PEEP_HAS(out, PEEP_PSW)) return 0;
+    }
+    for (k = 0; k < r->m; k++) {
+        RULE_INST *in = &r->to[k];
+        if (in->arg >= RULE_CONST) v = peepFind((UINT)(in->arg - RULE_CONST));
+        else if (in->arg >= 0) v = (in->arg < RULE_LEN) ? var[in->arg] : -1;
+        else v = 0;
+        if (v < 0) return 0;
+        ea[k] = v;
+    }
+
+    for (k = 0; k < r->n; k++) {
+        PEEP_INST *p = &peep[at[k]];
+        if (k >= r->m) {
+            p->kill = 1;
+            peep_removed++;
+            continue;
+        }
+        p->op = r->to[k].op;
+        p->ea = p->base = (UINT)ea[k];
+        p->edit = 1;
+    }
+    peep_rule_hits++;
+    return 1;
+}
+
+#endif
+
+
+
+// Apply the first change that the known ACC values allow
+
+// - return 1 if something changed
+
+int peepValue() {
+    UINT64 out[PEEP_SET];
+    int i, j, c;
+
+    for (i = 0; i < peep_n; i++) {
+        PEEP_INST *p = &peep[i];
+        PEEP_VAL *s = &peep_val[i];
+        if (p->kill || !s->seen) continue;
+        j = peepNext(i);
+        peepOut(i, out);
+
+        // LDA x: ACC already holds x, PSW follows ACC or is not used
+        if (p->op == 0x1000 && peepDirect(p) && (s->psw || !PEEP_HAS(out, PEEP_PSW)) &&
+            (s->var == (int)p->ea || (s->val >= 0 && peepConst(p) == s->val))) {
+            p->kill = 1;
+            peep_removed++;
+            return 1;
+        }
+
+        // STA x: x already holds ACC
+        if (p->op == 0x2000 && peepDirect(p) && s->var == (int)p->ea) {
+            p->kill = 1;
+            peep_removed++;
+            return 1;
+        }
+
+        // ADD/SUB/MUL x with a known result r: LDA of a constant r
+        if ((p->op == 0x3000 || p->op == 0x4000 || p->op == 0x7000) && peepDirect(p)) {
+            int r = -1;
+            if (p->op == 0x4000 && s->var == (int)p->ea) r = 0;
+            else if (s->val >= 0 && (c = peepConst(p)) >= 0) r = (int)peepFold(p->op, (UINT)s->val, (UINT)c);
+            if (r >= 0 && (c = peepFind((UINT)r)) >= 0) {
+                p->op = 0x1000;
+                p->ea = p->base = (UINT)c;
+                p->edit = 1;
+                peep_rewritten++;
+                return 1;
+            }
+        }
+
+        // IAC / IAC: ADD of a constant 2 if PSW is not used
+        if (p->op == 0x8002 && j < peep_n && peep[j].op == 0x8002 && !peepLanding(j)) {
+            UINT64 out2[PEEP_SET];
+            peepOut(j, out2);
+            if (!PEEP_HAS(out2, PEEP_PSW) && (c = peepFind(0x0002)) >= 0) {
+                p->op = 0x3000;
+                p->ea = p->base = (UINT)c;
+                p->edit = 1;
+                peep[j].kill = 1;
+                peep_rewritten++;
+                peep_removed++;
+                return 1;
+            }
+        }
+
+#if PEEP_RULES
+        // rewrite rules of RULE_FILE
+        for (c = 0; c < n_rule; c++) {
+            if (peepRule(i, &rule[c])) return 1;
+        }
+#endif
+
+        // JMP/BRZ/BRN to the next instruction
+        if ((p->kind == PK_JMP || p->kind == PK_BR) && peepSkip(p->tgt) == j) {
+            p->kill = 1;
+            peep_removed++;
+            return 1;
+        }
+
+        // jump to a JMP: to its target (not to another JMP, so cycles stay)
+        if (p->tgt >= 0) {
+            int t = peepSkip(p->tgt);
+            if (t < peep_n && peep[t].kind == PK_JMP && peepSkip(peep[t].tgt) != t &&
+                peep[peepSkip(peep[t].tgt)].kind != PK_JMP) {
+                p->tgt = peep[t].tgt;
+                peep_retargeted++;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+
+
+// Write the remaining instructions back to the CODE section
+
+// - return the new start address
+
+UINT peepEmit(UINT start_addr) {
+    static UINT new_addr[PEEP_INSTS + 1];
+    static WORD word[2 * PEEP_INSTS];
+    UINT addr = code_bgn;
+    int i, n = 0;
+
+    for (i = 0; i < peep_n; i++) {
+        new_addr[i] = addr;
+        if (!peep[i].kill) addr += peep[i].edit ? 2 : 2 * peep[i].len;
+    }
+    new_addr[peep_n] = addr;
+    for (i = peep_n - 1; i >= 0; i--) {
+        if (peep[i].kill) new_addr[i] = new_addr[i + 1];
+    }
 
-int c_num = 0;
+    for (i = 0; i < peep_n; i++) {
+        PEEP_INST *p = &peep[i];
+        UINT ir = readWord(p->addr);
+        if (p->kill) continue;
+        if (p->edit) {
+            word[n++] = (WORD)(p->op | p->ea);
+            continue;
+        }
+        if (p->tgt >= 0 && p->len == 1) ir = (ir & 0xF000) | new_addr[p->tgt];
+        word[n++] = (WORD)ir;
+        if (p->len == 2) word[n++] = (WORD)(p->tgt >= 0 ? new_addr[p->tgt] : readWord(p->addr + 2));
+    }
 
-//fetch cycle 과 executuion cycle에 쓰일 변수
+    for (i = 0; i < n; i++) writeWord(code_bgn + 2 * i, word[i]);
+    for (addr = code_bgn + 2 * n; addr < code_end; addr += 2) writeWord(addr, 0x0000);
+    code_end = peep_new_end = code_bgn + 2 * n;
+#if LIST_CODE
+    printListing("OPT", code_bgn, code_end);
+#endif
+    return new_addr[peep_at[start_addr]];
+}
 
 
 
-//여기다 divided conquer가법으로 함수를 작성하는건 어떨까
+// Optimize the CODE section of the loaded image
 
+// - return the start address of the optimized code
 
+UINT peephole(UINT start_addr) {
+    int round;
 
+#if PEEP_CHECK
+    memcpy(peep_mem, mem, MEM_SIZE);
+    peep_orig_start = start_addr;
+    peep_cnt = inst_cnt;
+#endif
+    peep_err[0] = '\0';
+    peep_removed = peep_rewritten = peep_retargeted = peep_rule_hits = 0;
+#if PEEP_RULES
+    if (!peep_rules_read) readRules();
+    peep_rules_read = 1;
+#endif
+    peep_old_end = peep_new_end = code_end;
+    if (!peepBuild(start_addr)) return start_addr;
 
+    // liveness removals do not disturb each other, value changes may: one per round
+    for (round = 0; round < 4 * PEEP_INSTS; round++) {
+        peepLiveness();
+        peepValues();
+        if (peepDead() == 0 && !peepValue()) break;
+    }
+    return peepEmit(start_addr);
+}
 
-// PRT (PRinT) instruction
 
-// print a AccCom number at mem[addr]
 
-void prt(UINT addr) {
-    UINT n = readWord(addr);
-    int i = accnum2cint(n);
-    printf("%d", i);
+#if PEEP_CHECK
+
+// Run the original code quietly and compare with the optimized run
+
+// - output, exit state and DATA section must be the same
+
+void peepCheck(int exit_code) {
+    UINT len = out_len;
+    UINT64 cnt = inst_cnt;
+    int code;
+
+    memcpy(peep_out, out_buf, len < OUT_SIZE ? len : OUT_SIZE);
+    memcpy(peep_data, mem, MEM_SIZE);
+    memcpy(mem, peep_mem, MEM_SIZE);
+#if USE_DIRTY_PAGES
+    mem_clean = 0;
+#endif
+#if BANKS
+    resetBanks();
+    selectBank(0);
+#endif
+    tos = 0;
+    acc = 0;
+    xr = 0;
+    ST_RUN = 0;
+    out_len = 0;
+    out_quiet = 1;
+    code = runProgram(peep_orig_start);
+    out_quiet = 0;
+
+    peep_inst_opt += cnt - peep_cnt;
+    peep_inst_orig += inst_cnt - cnt;
+    inst_cnt = cnt;
+    peep_runs++;
+    if (code != exit_code || out_len != len || memcmp(peep_out, out_buf, len < OUT_SIZE ? len : OUT_SIZE) ||
+        memcmp(&peep_data[data_bgn], &mem[data_bgn], data_end - data_bgn)) {
+        printf("\nCheck: the original code gives a different result\n");
+        peep_diff++;
+    }
 }
 
+#endif
 
 
-// PRC (PRint Char) instruction
 
-// print a ASCII char
+// Print the changes to the code and the executed instructions before and after
 
-void prc(int ch) {
-    printf("%c", ch);
+void printPeepStats() {
+    printf("[OPT]\n");
+    if (peep_err[0] != '\0') printf("not optimized: %s\n", peep_err);
+    else printf("code %04X ~ %04X -> %04X ~ %04X: %d removed, %d rewritten, %d retargeted\n", code_bgn,
+                peep_old_end, code_bgn, peep_new_end, peep_removed, peep_rewritten, peep_retargeted);
+#if PEEP_RULES
+    if (n_rule > 0) printf("rules: %d in %s, %d applied\n", n_rule, RULE_FILE, peep_rule_hits);
+#endif
+#if PEEP_CHECK
+    if (peep_runs == 0) return;
+    printf("instructions: %llu original, %llu optimized (%.1f%% fewer)\n", peep_inst_orig, peep_inst_opt,
+           peep_inst_orig ? 100.0 * ((double)peep_inst_orig - (double)peep_inst_opt) / peep_inst_orig : 0.0);
+    printf("check: %d runs, %d with a different result\n", peep_runs, peep_diff);
+#endif
 }
 
+#endif
 
 
-// PRS (PRint String) instruction
 
-// print string at mem[addr]
+//========================================
 
-void prs(UINT addr) {
-    int ch = (int)mem[addr];
-    while (ch != '\0') {
-        printf("%c", ch);
-        ch = (int)mem[++addr];
-    }
-}
+// Superoptimizer
 
+// - enumerates sequences of LDA/STA/ADD/SUB/MUL/CMP/IAC over SOPT_VARS
 
+//   variable words and the constant words SOPT_CONSTS, shortest first
 
-UINT pc = 0;
-UINT acc = 0;
+// - a sequence is a target if no part of it is already a rule target,
 
-int ST_RUN = 0;
+//   its fingerprint (results on SOPT_TESTS states) is looked up among
 
-//========================================
+//   the shorter sequences, with and without PSW
 
-// Run program
+// - a candidate is run on the interpreter with SOPT_RUNS random states,
 
-// - addr: start address of program
+//   then compared on all 65536 words of one input and on boundary values
 
-// - return exit state = 0: normal exit
+//   of further inputs
 
-// 1: error exit
+// - the rules are written to RULE_FILE for USE_PEEPHOLE
 
 //========================================
 
-int runProgram(UINT addr) {
+#if SUPEROPT
 
-    int status = ST_RUN;
-    UINT mar;
-    UINT mbr;
-    UINT ir;
-    UINT ir_i;
-    UINT ir_a;
-    UINT psw;
+#define SOPT_PSW0 0x5555 // PSW before a sequence (no instruction sets it)
+#define SOPT_SET 16384 // # of entries of a rule target set
 
+typedef struct {
+    UINT acc;
+    UINT psw;
+    UINT v[SOPT_VARS];
+} SOPT_STATE;
+
+typedef struct {
+    UINT64 fp; // fingerprint (0: empty)
+    UCHAR len;
+    UCHAR seq[RULE_LEN]; // instructions (index to sopt_alpha[])
+} SOPT_ENTRY;
+
+RULE_INST sopt_alpha[64]; // instructions of the search
+int sopt_n_alpha = 0;
+int sopt_k[] = { SOPT_CONSTS }; // values of the constant words
+#define SOPT_NK ((int)(sizeof(sopt_k) / sizeof(sopt_k[0])))
+SOPT_STATE sopt_test[SOPT_TESTS]; // states of a fingerprint
+SOPT_ENTRY sopt_tab[2][SOPT_TABLE]; // shortest sequence of a fingerprint: 0 with PSW, 1 without
+int sopt_n_tab = 0;
+UINT64 sopt_set[2][SOPT_SET]; // rule targets: 0 always, 1 where PSW is not used
+UINT sopt_edge[128]; // boundary values
+int sopt_n_edge = 0;
+UINT64 sopt_seqs = 0; // # of targets
+UINT64 sopt_cands = 0; // # of candidates with the same fingerprint
+UINT64 sopt_fails = 0; // # of candidates that are not equivalent
+
+
+
+// A random word: a boundary value or any 16 bits
+
+UINT soptWord() {
+    if (rand() % 4 == 0) return sopt_edge[rand() % sopt_n_edge];
+    return (UINT)(rand() & 0xFFFF);
+}
 
 
-    pc = addr;
 
+// A random state
 
+void soptRandom(SOPT_STATE *s) {
+    int i;
+    s->acc = soptWord();
+    s->psw = SOPT_PSW0;
+    for (i = 0; i < SOPT_VARS; i++) s->v[i] = soptWord();
+}
 
-    while (status == ST_RUN) {
-        //-------fetch cycle ------------/
-        mar = pc;
-        //printf("%04x\n",pc);
-        mbr = readWord(mar);
-        ir = mbr;
-        ir_i = ir & 0xF000;
-        ir_a = ir & 0x0FFF;
 
-        pc += (UINT)2;
 
+// Build the instructions, boundary values and fingerprint states
 
+void soptInit() {
+    UINT ops[] = { 0x1000, 0x3000, 0x4000, 0x7000, 0xE000 }; // LDA ADD SUB MUL CMP
+    UINT mag[64];
+    int n = 0, i, j;
 
-        //----execution cycle---------------/
-        if (ir_i == 0x0000) {
-            break;
+    for (i = 0; i < 5; i++) {
+        for (j = 0; j < SOPT_VARS + SOPT_NK; j++) {
+            sopt_alpha[sopt_n_alpha].op = ops[i];
+            sopt_alpha[sopt_n_alpha++].arg = j < SOPT_VARS ? j : RULE_CONST + (int)cint2accnum(sopt_k[j - SOPT_VARS]);
         }
+    }
+    for (j = 0; j < SOPT_VARS; j++) {
+        sopt_alpha[sopt_n_alpha].op = 0x2000; // STA
+        sopt_alpha[sopt_n_alpha++].arg = j;
+    }
+    sopt_alpha[sopt_n_alpha].op = 0x8002; // IAC
+    sopt_alpha[sopt_n_alpha++].arg = -1;
+
+    // magnitudes 0 ~ 8, 2^k - 1 ~ 2^k + 1, square root and top of the range, both signs
+    for (i = 0; i <= 8; i++) mag[n++] = i;
+    for (i = 4; i <= 14; i++) {
+        mag[n++] = (1 << i) - 1;
+        mag[n++] = 1 << i;
+        mag[n++] = (1 << i) + 1;
+    }
+    mag[n++] = 181;
+    mag[n++] = 182;
+    mag[n++] = 32766;
+    mag[n++] = 32767;
+    for (i = 0; i < n; i++) {
+        sopt_edge[sopt_n_edge++] = mag[i];
+        sopt_edge[sopt_n_edge++] = mag[i] | 0x8000;
+    }
+    srand(1);
+    for (i = 0; i < SOPT_TESTS; i++) soptRandom(&sopt_test[i]);
+}
 
-        else if (ir_i == 0x1000) //LDA
-        {
-            mar = ir_a;
-            mbr = readWord(mar);
-            acc = mbr;
-            if (acc > 0x8000) psw = 0x1000;
-            else if (acc == 0x0000) psw = 0x0001;
-            else psw = 0x0000;
-        }
 
-        else if (ir_i == 0x2000) //STA
-        {
-            mar = ir_a;
-            writeWord(mar, acc);
-        }
 
-        else if (ir_i == 0x3000) //ADD
-        {
-            mar = ir_a;
-            mbr = readWord(mar);
-            c_num = accnum2cint(acc) + accnum2cint(mbr);
-            acc = cint2accnum(c_num);
-            if (acc > 0x8000) psw = 0x1000;
-            else if (acc == 0x0000) psw = 0x0001;
-            else psw = 0x0000;
-        }
+// Run seq on state s as runProgram() does
 
-        else if (ir_i == 0x4000) //SUB
-        {
-            mar = ir_a;
-            mbr = readWord(mar);
-            c_num = accnum2cint(acc) - accnum2cint(mbr);
-            acc = cint2accnum(c_num);
-            if (acc > 0x8000) psw = 0x1000;
-            else if (acc == 0x0000) psw = 0x0001;
-            else psw = 0x0000;
-        }
+void soptRun(SOPT_STATE *s, UCHAR *seq, int len) {
+    int i;
 
-        else if (ir_i == 0x5000) //JMP
-        {
-            mar = ir_a;
-            pc = mar;
-        }
-        else if(ir_i == 0x6000)//CAL
-        {
-            mar = ir_a;
-            push(pc);
-            pc = ir_a;
+    for (i = 0; i < len; i++) {
+        RULE_INST *in = &sopt_alpha[seq[i]];
+        UINT w = (in->arg >= RULE_CONST) ? (UINT)(in->arg - RULE_CONST) : (in->arg >= 0) ? s->v[in->arg] : 0;
+        int c;
+        switch (in->op) {
+        case 0x1000: s->acc = w; break; // LDA
+        case 0x2000: s->v[in->arg] = s->acc; continue; // STA
+        case 0x3000: s->acc = cint2accnum(accnum2cint(s->acc) + accnum2cint(w)); break; // ADD
+        case 0x4000: s->acc = cint2accnum(accnum2cint(s->acc) - accnum2cint(w)); break; // SUB
+        case 0x7000: s->acc = cint2accnum(accnum2cint(s->acc) * accnum2cint(w)); break; // MUL
+        case 0xE000: // CMP
+            c = accnum2cint(s->acc) - accnum2cint(w);
+            s->psw = (c < 0) ? 0x1000 : (c == 0) ? 0x0001 : 0x0000;
+            continue;
+        case 0x8002: s->acc = cint2accnum(accnum2cint(s->acc) + 1); continue; // IAC
         }
-        else if (ir_i == 0x7000)//MUL
-        {
-            mar = ir_a;
-            mbr = readWord(mar);
-            c_num = accnum2cint(acc) * accnum2cint(mbr);
-            acc = cint2accnum(c_num);
-            if (acc > 0x8000) psw = 0x1000;
-            else if (acc == 0x0000) psw = 0x0001;
-            else psw = 0x0000;
+        if (s->acc > 0x8000) s->psw = 0x1000;
+        else if (s->acc == 0x0000) s->psw = 0x0001;
+        else s->psw = 0x0000;
+    }
+}
 
+
+
+// 1: same results (PSW only if psw)
+
+int soptSame(SOPT_STATE *a, SOPT_STATE *b, int psw) {
+    return a->acc == b->acc && (!psw || a->psw == b->psw) && memcmp(a->v, b->v, sizeof(a->v)) == 0;
+}
+
+
+
+// Fingerprint of seq: results on the test states
+
+// - nopsw: the same without PSW
+
+UINT64 soptPrint(UCHAR *seq, int len, UINT64 *nopsw) {
+    UINT64 h = 14695981039346656037ULL;
+    UINT64 h2 = h;
+    int t, i;
+
+    for (t = 0; t < SOPT_TESTS; t++) {
+        SOPT_STATE s = sopt_test[t];
+        soptRun(&s, seq, len);
+        h = (h ^ s.acc) * 1099511628211ULL;
+        h2 = (h2 ^ s.acc) * 1099511628211ULL;
+        h = (h ^ s.psw) * 1099511628211ULL;
+        for (i = 0; i < SOPT_VARS; i++) {
+            h = (h ^ s.v[i]) * 1099511628211ULL;
+            h2 = (h2 ^ s.v[i]) * 1099511628211ULL;
         }
-        else if(ir_i == 0x9000){
-            if((psw & 0x0FFF) == 0x0001)
-            {
-                mar = ir_a;
-                pc = mar;
-            }
-            else{
-                continue;
-            }
-        }
-        else if (ir_i == 0xa000) //BRN
-        {
-            if ((psw & 0xF000) == 0x1000) //음수일 경우 지정한곳으로 분기해야한다.
-            {
-                mar = ir_a;
-                pc = mar;
-            }
+    }
+    *nopsw = h2 | 1;
+    return h | 1;
+}
 
-            else {
-                continue;
+
+
+// Table entry of fingerprint fp (fp 0: free)
+
+SOPT_ENTRY *soptFind(SOPT_ENTRY *tab, UINT64 fp) {
+    UINT i = (UINT)(fp >> 17) & (SOPT_TABLE - 1);
+    while (tab[i].fp != 0 && tab[i].fp != fp) i = (i + 1) & (SOPT_TABLE - 1);
+    return &tab[i];
+}
+
+
+
+// Key of a sequence for the rule target sets
+
+UINT64 soptKey(UCHAR *seq, int len) {
+    UINT64 key = (UINT64)len;
+    int i;
+    for (i = 0; i < len; i++) key |= (UINT64)(seq[i] + 1) << (8 + 8 * i);
+    return key;
+}
+
+
+
+// Find key in a rule target set, add it if add
+
+int soptSet(UINT64 *set, UINT64 key, int add) {
+    UINT i = (UINT)((key * 0x9E3779B97F4A7C15ULL) >> 50) & (SOPT_SET - 1);
+    while (set[i] != 0 && set[i] != key) i = (i + 1) & (SOPT_SET - 1);
+    if (set[i] == key) return 1;
+    if (add) set[i] = key;
+    return 0;
+}
+
+
+
+// 1: the variables of seq first appear in the order V0, V1, ...
+
+int soptCanonical(UCHAR *seq, int len) {
+    int next = 0, i, a;
+    for (i = 0; i < len; i++) {
+        a = sopt_alpha[seq[i]].arg;
+        if (a < 0 || a >= RULE_CONST) continue;
+        if (a > next) return 0;
+        if (a == next) next++;
+    }
+    return 1;
+}
+
+
+
+// 1: a part of seq is the target of a rule that applies there
+
+// - a PSW rule applies if a later instruction sets PSW (nothing in between uses it)
+
+int soptReducible(UCHAR *seq, int len) {
+    int a, w, k;
+
+    for (w = 1; w < len; w++) {
+        for (a = 0; a + w <= len; a++) {
+            UINT64 key = soptKey(seq + a, w);
+            if (soptSet(sopt_set[0], key, 0)) return 1;
+            if (!soptSet(sopt_set[1], key, 0)) continue;
+            for (k = a + w; k < len; k++) {
+                UINT op = sopt_alpha[seq[k]].op;
+                if (op != 0x2000 && op != 0x8002) return 1;
             }
         }
+    }
+    return 0;
+}
 
-        else if (ir_i == 0xb000) {
-            mar = ir_a;
-            prt(mar);
+
+
+// Run seq on the interpreter from state s
+
+// - ACC is loaded from a word (PSW follows ACC), then CMP with cmp unless cmp < 0
+
+// - PSW is read back with BRZ/BRN and PRC
+
+void soptInterp(SOPT_STATE *s, int cmp, UCHAR *seq, int len) {
+    UINT addr = 0x0200;
+    int i, k;
+
+    resetMemory();
+    for (i = 0; i < SOPT_VARS; i++) writeWord(0x0100 + 2 * i, s->v[i]);
+    for (k = 0; k < SOPT_NK; k++) writeWord(0x0110 + 2 * k, cint2accnum(sopt_k[k]));
+    writeWord(0x0120, s->acc);
+    writeWord(0x0122, (UINT)cmp);
+    addr = writeWords(addr, 0x1120, END_OF_ARG); // LDA acc
+    if (cmp >= 0) addr = writeWords(addr, 0xE122, END_OF_ARG); // CMP cmp
+    for (i = 0; i < len; i++) {
+        RULE_INST *in = &sopt_alpha[seq[i]];
+        UINT a = 0;
+        if (in->arg >= RULE_CONST) {
+            for (k = 0; cint2accnum(sopt_k[k]) != (UINT)(in->arg - RULE_CONST); k++);
+            a = 0x0110 + 2 * k;
         }
+        else if (in->arg >= 0) a = 0x0100 + 2 * in->arg;
+        addr = writeWords(addr, in->op | a, END_OF_ARG);
+    }
+    // STA out / BRZ z / BRN n / PRC 'P' / HLT / z: PRC 'Z' / HLT / n: PRC 'N' / HLT
+    writeWords(addr, 0x2124, 0x9000 | (addr + 10), 0xA000 | (addr + 14), 0xC000 | 'P', 0x8000,
+               0xC000 | 'Z', 0x8000, 0xC000 | 'N', 0x8000, END_OF_ARG);
+
+    tos = 0;
+    acc = 0;
+    xr = 0;
+    ST_RUN = 0;
+    out_len = 0;
+    out_quiet = 1;
+    runProgram(0x0200);
+    out_quiet = 0;
+    s->acc = readWord(0x0124);
+    s->psw = (out_buf[0] == 'Z') ? 0x0001 : (out_buf[0] == 'N') ? 0x1000 : 0x0000;
+    for (i = 0; i < SOPT_VARS; i++) s->v[i] = readWord(0x0100 + 2 * i);
+}
 
-        else if (ir_i == 0xc000) {
-            mar = ir_a;
-            prc(mar);
+
+
+// Add the words seq reads before writing them to in[] (-1: ACC, n: Vn)
+
+// - return # of inputs
+
+int soptInputs(UCHAR *seq, int len, int *in, int n) {
+    int def[SOPT_VARS + 1] = { 0 }; // 0: ACC, 1 + n: Vn written
+    int i, j, x;
+
+    for (i = 0; i < len; i++) {
+        RULE_INST *op = &sopt_alpha[seq[i]];
+        for (j = 0; j < 2; j++) {
+            if (j == 0) x = (op->op != 0x1000 && !def[0]) ? -1 : -2; // all but LDA read ACC
+            else x = (op->arg >= 0 && op->arg < RULE_CONST && op->op != 0x2000 && !def[1 + op->arg]) ? op->arg : -2;
+            if (x != -2) {
+                int k;
+                for (k = 0; k < n && in[k] != x; k++);
+                if (k == n) in[n++] = x;
+            }
         }
+        if (op->op == 0x2000) def[1 + op->arg] = 1;
+        else if (op->op != 0xE000) def[0] = 1;
+    }
+    return n;
+}
 
-        else if (ir_i == 0xd000) {
-            mar = ir_a;
-            prs(mar);
+
+
+// Compare a and b on the inputs they read: every word of a single input,
+
+// all combinations of boundary values and SOPT_SAMPLES random words of more
+
+// - return 1 if equal, *edges = 1 if not every input was tried
+
+int soptVerify(UCHAR *a, int na, UCHAR *b, int nb, int psw, int *edges) {
+    int in[SOPT_VARS + 1];
+    int idx[SOPT_VARS + 1] = { 0 };
+    int size[SOPT_VARS + 1];
+    SOPT_STATE base, s0, s1;
+    int n_in = 0, d, t;
+
+    n_in = soptInputs(a, na, in, n_in);
+    n_in = soptInputs(b, nb, in, n_in);
+    for (d = 0; d < n_in; d++) size[d] = (n_in == 1) ? 0x10000 : sopt_n_edge;
+    *edges = n_in > 1;
+
+    base.acc = 0x1234;
+    base.psw = SOPT_PSW0;
+    for (d = 0; d < SOPT_VARS; d++) base.v[d] = 0x2345 + 0x0111 * d;
+    for (;;) {
+        s0 = base;
+        for (d = 0; d < n_in; d++) {
+            UINT w = (d == 0) ? (UINT)idx[d] : sopt_edge[idx[d]];
+            if (in[d] < 0) s0.acc = w;
+            else s0.v[in[d]] = w;
+        }
+        s1 = s0;
+        soptRun(&s0, a, na);
+        soptRun(&s1, b, nb);
+        if (!soptSame(&s0, &s1, psw)) return 0;
+        for (d = 0; d < n_in && ++idx[d] == size[d]; d++) idx[d] = 0;
+        if (d == n_in) break;
+    }
+    for (t = 0; *edges && t < SOPT_SAMPLES; t++) {
+        s0 = base;
+        for (d = 0; d < n_in; d++) {
+            UINT w = (UINT)(rand() & 0xFFFF);
+            if (in[d] < 0) s0.acc = w;
+            else s0.v[in[d]] = w;
         }
+        s1 = s0;
+        soptRun(&s0, a, na);
+        soptRun(&s1, b, nb);
+        if (!soptSame(&s0, &s1, psw)) return 0;
+    }
+    return 1;
+}
 
-        else if (ir_i == 0x8000) {
-            if(ir_a == 0x0005)
-            {
-                pc = pop();
-                // printf("!!!!!! %04x\n",pc);
-                continue;
+
+
+// Check candidate c for seq: random states on the interpreter, then soptVerify()
+
+int soptCheck(UCHAR *seq, int len, SOPT_ENTRY *c, int psw, int *edges) {
+    SOPT_STATE s0, s1;
+    int t, cmp;
+
+    for (t = 0; t < SOPT_RUNS; t++) {
+        soptRandom(&s0);
+        s1 = s0;
+        cmp = (t & 1) ? (int)soptWord() : -1;
+        soptInterp(&s0, cmp, seq, len);
+        soptInterp(&s1, cmp, c->seq, c->len);
+        if (!soptSame(&s0, &s1, psw)) return 0;
+    }
+    return soptVerify(seq, len, c->seq, c->len, psw, edges);
+}
+
+
+
+// Add the rule seq => c
+
+void soptRule(UCHAR *seq, int len, SOPT_ENTRY *c, int psw, int edges) {
+    RULE *r;
+    int i;
+
+    soptSet(sopt_set[psw ? 1 : 0], soptKey(seq, len), 1);
+    if (n_rule == RULES) return;
+    r = &rule[n_rule++];
+    r->n = len;
+    r->m = c->len;
+    for (i = 0; i < len; i++) r->from[i] = sopt_alpha[seq[i]];
+    for (i = 0; i < c->len; i++) r->to[i] = sopt_alpha[c->seq[i]];
+    r->psw = psw;
+    r->edges = edges;
+}
+
+
+
+// Write rule[] to RULE_FILE
+
+void writeRules() {
+    FILE *f = fopen(RULE_FILE, "w");
+    char from[128], to[128];
+    int i;
+
+    if (f == NULL) {
+        printf("Error: cannot write %s\n", RULE_FILE);
+        return;
+    }
+    fprintf(f, "# AccCom rewrite rules: up to %d instructions, %d variables, constants", SOPT_LEN, SOPT_VARS);
+    for (i = 0; i < SOPT_NK; i++) fprintf(f, " %d", sopt_k[i]);
+    fprintf(f, "\n# target => replacement | psw: PSW not used after, edges: boundary values only\n");
+    for (i = 0; i < n_rule; i++) {
+        ruleText(from, rule[i].from, rule[i].n);
+        ruleText(to, rule[i].to, rule[i].m);
+        fprintf(f, "%s =>%s%s%s%s%s\n", from, to[0] ? " " : "", to, (rule[i].psw || rule[i].edges) ? " |" : "",
+                rule[i].psw ? " psw" : "", rule[i].edges ? " edges" : "");
+    }
+    fclose(f);
+}
+
+
+
+// Search rules for all sequences up to SOPT_LEN and write RULE_FILE
+
+void superopt() {
+    UCHAR seq[RULE_LEN];
+    UINT64 fp[2];
+    int len, i, t, found, edges;
+
+    soptInit();
+    printf("*** Superoptimizer ***\n");
+    printf("%d instructions, %d variables, %d constants\n", sopt_n_alpha, SOPT_VARS, SOPT_NK);
+    for (len = 0; len <= SOPT_LEN; len++) {
+        UINT64 total = 1, k;
+        int rules = n_rule;
+        UINT64 seqs = sopt_seqs;
+
+        for (i = 0; i < len; i++) total *= sopt_n_alpha;
+        for (k = 0; k < total; k++) {
+            UINT64 x = k;
+            for (i = 0; i < len; i++) {
+                seq[i] = (UCHAR)(x % sopt_n_alpha);
+                x /= sopt_n_alpha;
             }
-            else if (ir_a == 0x0002)
-            {
-                acc = cint2accnum(accnum2cint(acc) + 1);
+            if (!soptCanonical(seq, len) || soptReducible(seq, len)) continue;
+            sopt_seqs++;
+            fp[0] = soptPrint(seq, len, &fp[1]);
+
+            // shorter equivalent: always, else where PSW is not used
+            found = 0;
+            for (t = 0; t < 2 && !found; t++) {
+                SOPT_ENTRY *c = soptFind(sopt_tab[t], fp[t]);
+                if (c->fp == 0 || c->len >= len) continue;
+                sopt_cands++;
+                if (soptCheck(seq, len, c, t == 0, &edges)) {
+                    soptRule(seq, len, c, t == 1, edges);
+                    found = (t == 0);
+                }
+                else sopt_fails++;
+            }
+            if (found || len == SOPT_LEN || sopt_n_tab >= SOPT_TABLE / 2) continue;
+            for (t = 0; t < 2; t++) {
+                SOPT_ENTRY *c = soptFind(sopt_tab[t], fp[t]);
+                if (c->fp != 0) continue;
+                c->fp = fp[t];
+                c->len = (UCHAR)len;
+                memcpy(c->seq, seq, len);
+                sopt_n_tab++;
             }
-            else ST_RUN = 1;
         }
+        printf("length %d: %llu targets, %d rules\n", len, sopt_seqs - seqs, n_rule - rules);
     }
-    return 0;
+    printf("candidates: %llu, %llu not equivalent\n", sopt_cands, sopt_fails);
+    writeRules();
+    printf("%d rules written to %s\n", n_rule, RULE_FILE);
 }
 
+#endif
+
 
 
 //========================================
@@ -602,6 +5843,12 @@ int main() {
     int exit_code; // 0: normal exit, 1: error exit
 
     UINT start_addr; // start address of program
+#if WCET_RUNS
+    int runs = 0; // # of runs with random inputs
+#endif
+#if USE_RESULT_CACHE
+    UINT64 key; // result cache key
+#endif
 
 
 
@@ -615,24 +5862,99 @@ int main() {
 
 
 
-    printf("*** Load ***\n");
+#if USE_GUARD_PAGES
+    initMemory();
+#endif
+#if BANKS
+    initBanks();
+#endif
+#if USE_RESULT_CACHE
+    openCache();
+#endif
+#if SUPEROPT
+    superopt();
+    return 0;
+#endif
+
 
-    start_addr = loadProgram();
 
+    do {
+        printf("*** Load ***\n");
 
+        start_addr = loadProgram();
 
-    printf("*** Input ***\n");
 
-    inputData();
 
+        printf("*** Input ***\n");
 
+        if (!inputData() && BATCH_MODE) break;
+#if WCET
+        if (!wcet_done) wcetAnalyze(start_addr);
+#endif
+#if USE_PEEPHOLE
+        start_addr = peephole(start_addr);
+#endif
 
-    printf("*** Run ***\n");
 
-    exit_code = runProgram(start_addr);
 
+        printf("*** Run ***\n");
 
+        tos = 0;
+        acc = 0;
+        xr = 0;
+#if BANKS
+        selectBank(0);
+#endif
+        ST_RUN = 0;
+        out_len = 0;
+#if USE_MEMO
+        memoBegin();
+#endif
+#if USE_LOOP_ACCEL
+        loopBegin();
+#endif
 
-    printf("*** Exit %d ***\n", exit_code);
+#if USE_RESULT_CACHE
+        key = hashImage(start_addr);
+        if (!lookupCache(key, &exit_code)) {
+            exit_code = runProgram(start_addr);
+            storeCache(key, exit_code);
+        }
+#else
+        exit_code = runProgram(start_addr);
+#endif
+#if USE_PEEPHOLE && PEEP_CHECK
+        peepCheck(exit_code);
+#endif
+
+
+
+        printf("*** Exit %d ***\n", exit_code);
+#if WCET_RUNS
+    } while (++runs < WCET_RUNS);
+#else
+    } while (BATCH_MODE);
+#endif
+
+
+
+#if RUN_STATS
+    printRunStats();
+#endif
+#if USE_MEMO
+    printMemoStats();
+#endif
+#if USE_LOOP_ACCEL
+    printLoopStats();
+#endif
+#if BUS_TIMING
+    printBusStats();
+#endif
+#if WCET
+    printWcetStats();
+#endif
+#if USE_PEEPHOLE
+    printPeepStats();
+#endif
 
 }
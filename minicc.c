@@ -0,0 +1,2375 @@
+/*
+ * minicc.c - C Subset Compiler for AccCom and picoMIPS
+ *
+ * Compiles C like prime_list_c_version to assembler source for the
+ * assemblers of hw3.c (AccCom) and picomips.c (picoMIPS)
+ *
+ *	gcc -o minicc minicc.c
+ *	./minicc [-pico] [-O0] < prime_list_c_version > prime.s
+ *	gcc -DASM_FILE='"prime.s"' -o hw3 hw3.c
+ *	gcc -DASM_FILE='"prime.s"' -DTRACE=0 -o picomips picomips.c	(-pico)
+ *
+ * - int globals with constant initializers, int locals and parameters
+ * - int and void functions, no recursion: locals are static
+ * - if/else, while, return, = + - * / % == != < <= > >= && || ! and calls
+ * - printf with %d, %c and other chars; scanf("%d", &x) reads A, then B,
+ *   which the simulators take at 0100 and 0102
+ * - picoMIPS has no call instruction: every call is inlined, and its
+ *   division is unsigned
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+//========================================
+// Global Definitions
+//========================================
+
+typedef unsigned long long UINT64;
+
+#define MAX_VARS	1024	// variables, temporaries and constant registers
+#define MAX_FUNCS	64		// functions
+#define MAX_PARAMS	8		// parameters of a function
+#define MAX_QUADS	8192	// IR instructions of a function
+#define MAX_LABELS	8192	// IR labels of the program
+#define MAX_FACTS	2048	// copies or expressions an analysis tracks
+#define MAX_CODE	0x40000	// bytes of assembler output
+#define N_INPUTS	2		// input numbers A, B
+#define DATA_ADDR	0x0100	// DATA section: A, B, then variables
+#define CODE_ADDR	0x0200	// CODE section, moved up if DATA is longer
+#define N_REGS		8		// picoMIPS registers, r0 is kept 0
+#define MAX_ROUNDS	100		// optimizer rounds
+
+#define NONE		(-1)
+#define CON_BIT		0x10000000				// operand is a constant
+#define CON(n)		(CON_BIT | ((n) & 0xFFFF))
+#define IS_CON(x)	((x) >= 0 && ((x) & CON_BIT))
+#define IS_VAR(x)	((x) >= 0 && !((x) & CON_BIT))
+#define CVAL(x)		((short)((x) & 0xFFFF))
+
+#define BIT(s, i)	((s)[(i) >> 6] >> ((i) & 63) & 1)
+#define SET(s, i)	((s)[(i) >> 6] |= 1ULL << ((i) & 63))
+#define CLR(s, i)	((s)[(i) >> 6] &= ~(1ULL << ((i) & 63)))
+
+int pico = 0;		// 1: picoMIPS, 0: AccCom
+int opt = 1;		// 1: optimize
+
+// Tokens: a char or one of these
+enum { T_EOF = 256, T_NUM, T_ID, T_STR, T_INT, T_VOID, T_IF, T_ELSE, T_WHILE, T_RETURN,
+       T_EQ, T_NE, T_LE, T_GE, T_AND, T_OR };
+
+// Syntax tree
+enum { N_NUM, N_VAR, N_BIN, N_NOT, N_NEG, N_ASSIGN, N_CALL,
+       N_EXPR, N_IF, N_WHILE, N_RET, N_BLOCK, N_PRINTF, N_SCANF };
+
+typedef struct NODE {
+    int kind;				// N_...
+    int op;					// operator token of N_BIN, value of N_NUM
+    int sym;				// variable of N_VAR, N_ASSIGN, N_SCANF, function of N_CALL
+    struct NODE *a, *b, *c;	// operands; condition, then, else; first statement of N_BLOCK
+    struct NODE *next;		// next statement or argument
+    char *str;				// format of N_PRINTF
+} NODE;
+
+// IR: three-address instructions
+enum { Q_NOP, Q_MOV, Q_ADD, Q_SUB, Q_MUL, Q_DIV, Q_MOD, Q_AND, Q_BR, Q_JMP, Q_LABEL,
+       Q_CALL, Q_RET, Q_HALT, Q_PRT, Q_PRC };
+enum { CC_EQ, CC_NE, CC_LT, CC_LE, CC_GT, CC_GE };
+
+typedef struct {
+    int op;		// Q_...
+    int cc;		// Q_BR: branch if a cc b
+    int d;		// destination variable or NONE
+    int a, b;	// operands: variable, CON(n) or NONE
+    int lab;	// label of Q_LABEL, target of Q_JMP and Q_BR, function of Q_CALL
+} QUAD;
+
+enum { V_GLOBAL, V_LOCAL, V_TEMP };
+
+typedef struct {
+    char name[32];	// C name, "" for temporaries
+    int kind;		// V_GLOBAL, V_LOCAL (and parameters), V_TEMP
+    int func;		// owner function, -1: global
+    int init;		// initial value of a global, value of a constant register
+    int input;		// input slot + 1 (the words at 0100, 0102), 0: none
+    int written;	// assigned by the program (a global that is not is a constant)
+    int is_const;	// 1: picoMIPS register holding the constant init
+    int reg;		// picoMIPS register, -1: in memory
+    int addr;		// picoMIPS DATA address
+    double weight;	// uses weighted by loop depth
+} VAR;
+
+typedef struct {
+    char name[32];
+    int is_int;		// 1: returns int
+    int defined;	// 1: body seen
+    int n_param;
+    int param[MAX_PARAMS];
+    int ret_var;	// holds the return value
+    int sites;		// # of calls to it
+    int line;		// line of first use
+    NODE *body;
+    QUAD *q;		// IR
+    int n_q;
+} FUNC;
+
+VAR var[MAX_VARS];
+int n_var = 0;
+FUNC func[MAX_FUNCS];
+int n_func = 0;
+int main_func = -1;
+int n_label = 0;
+int n_inputs = 0;
+int slot_var[N_INPUTS];	// variables of the words at 0100, 0102
+
+//========================================
+// Lexer
+//========================================
+char *src;			// source text
+char *src_p;		// next char
+int line = 1;		// line of the current token
+int tok;			// current token
+int tok_val;		// value of T_NUM
+char tok_str[256];	// name of T_ID, text of T_STR
+
+// Print an error at the current line and exit
+void error(const char *fmt, ...) {
+    va_list ap;
+
+    fprintf(stderr, "Error: line %d: ", line);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+// Read an escaped char after '\'
+int escape() {
+    char c = *src_p++;
+
+    switch (c) {
+    case 'n': return '\n';
+    case 't': return '\t';
+    case 'r': return '\r';
+    case '0': return '\0';
+    default: return c;
+    }
+}
+
+// Read the next token
+void next() {
+    static struct { char *name; int tok; } keyword[] = {
+        {"int", T_INT}, {"void", T_VOID}, {"if", T_IF}, {"else", T_ELSE},
+        {"while", T_WHILE}, {"return", T_RETURN}, {NULL, 0}
+    };
+    static char *op2[] = { "==", "!=", "<=", ">=", "&&", "||" };
+    char *p;
+    int i;
+
+    for (;;) {	// white space, comments, preprocessor lines
+        if (*src_p == '\n') line++;
+        if (*src_p == ' ' || *src_p == '\t' || *src_p == '\r' || *src_p == '\n') src_p++;
+        else if (*src_p == '#' || (src_p[0] == '/' && src_p[1] == '/'))
+            while (*src_p != '\0' && *src_p != '\n') src_p++;
+        else if (src_p[0] == '/' && src_p[1] == '*') {
+            for (src_p += 2; *src_p != '\0' && !(src_p[0] == '*' && src_p[1] == '/'); src_p++)
+                if (*src_p == '\n') line++;
+            if (*src_p != '\0') src_p += 2;
+        }
+        else break;
+    }
+
+    if (*src_p == '\0') {
+        tok = T_EOF;
+        return;
+    }
+    if (*src_p >= '0' && *src_p <= '9') {
+        tok = T_NUM;
+        tok_val = (int)strtol(src_p, &src_p, 0);
+        return;
+    }
+    if (*src_p == '_' || ((*src_p | 0x20) >= 'a' && (*src_p | 0x20) <= 'z')) {
+        for (i = 0; *src_p == '_' || ((*src_p | 0x20) >= 'a' && (*src_p | 0x20) <= 'z') ||
+             (*src_p >= '0' && *src_p <= '9'); src_p++)
+            if (i < (int)sizeof(tok_str) - 1) tok_str[i++] = *src_p;
+        tok_str[i] = '\0';
+        tok = T_ID;
+        for (i = 0; keyword[i].name != NULL; i++)
+            if (strcmp(keyword[i].name, tok_str) == 0) tok = keyword[i].tok;
+        return;
+    }
+    if (*src_p == '\'') {
+        src_p++;
+        tok_val = (*src_p == '\\') ? (src_p++, escape()) : *src_p++;
+        if (*src_p++ != '\'') error("bad char constant");
+        tok = T_NUM;
+        return;
+    }
+    if (*src_p == '"') {
+        for (src_p++, p = tok_str; *src_p != '"'; ) {
+            if (*src_p == '\0' || *src_p == '\n') error("unterminated string");
+            if (p == tok_str + sizeof(tok_str) - 1) error("string too long");
+            *p++ = (*src_p == '\\') ? (src_p++, (char)escape()) : *src_p++;
+        }
+        *p = '\0';
+        src_p++;
+        tok = T_STR;
+        return;
+    }
+    for (i = 0; i < 6; i++)
+        if (src_p[0] == op2[i][0] && src_p[1] == op2[i][1]) {
+            src_p += 2;
+            tok = T_EQ + i;
+            return;
+        }
+    tok = *src_p++;
+}
+
+// Skip an expected token
+void expect(int t) {
+    if (tok != t) error("'%c' expected", t);
+    next();
+}
+
+//========================================
+// Parser
+//========================================
+int cur_func = -1;	// function being parsed or compiled
+
+// New tree node
+NODE *node(int kind, NODE *a, NODE *b) {
+    NODE *n = calloc(1, sizeof(NODE));
+
+    n->kind = kind;
+    n->a = a;
+    n->b = b;
+    return n;
+}
+
+NODE *num(int v) {
+    NODE *n = node(N_NUM, NULL, NULL);
+
+    n->op = (short)v;
+    return n;
+}
+
+// New variable
+int newVar(const char *name, int kind, int f) {
+    if (n_var == MAX_VARS) error("too many variables");
+    memset(&var[n_var], 0, sizeof(VAR));
+    strcpy(var[n_var].name, name);
+    var[n_var].kind = kind;
+    var[n_var].func = f;
+    var[n_var].reg = -1;
+    return n_var++;
+}
+
+// Find a local of the current function, then a global
+int findVar(const char *name) {
+    int i;
+
+    for (i = 0; i < n_var; i++)
+        if (var[i].kind == V_LOCAL && var[i].func == cur_func && strcmp(var[i].name, name) == 0) return i;
+    for (i = 0; i < n_var; i++)
+        if (var[i].kind == V_GLOBAL && !var[i].input && strcmp(var[i].name, name) == 0) return i;
+    return -1;
+}
+
+// Find a function, add it if not seen yet
+int findFunc(const char *name) {
+    int i;
+
+    for (i = 0; i < n_func; i++)
+        if (strcmp(func[i].name, name) == 0) return i;
+    if (n_func == MAX_FUNCS) error("too many functions");
+    strcpy(func[n_func].name, name);
+    func[n_func].ret_var = NONE;
+    func[n_func].line = line;
+    return n_func++;
+}
+
+// Quotient or remainder as the target computes it: picoMIPS divides unsigned
+int divide(int x, int y, int rem) {
+    if (pico) return rem ? (short)((unsigned short)x % (unsigned short)y) : (short)((unsigned short)x / (unsigned short)y);
+    return rem ? (short)(x % y) : (short)(x / y);
+}
+
+// Evaluate an operator on constants
+int evalOp(int op, int x, int y) {
+    if ((op == '/' || op == '%') && y == 0) error("division by zero");
+    switch (op) {
+    case '+': return (short)(x + y);
+    case '-': return (short)(x - y);
+    case '*': return (short)(x * y);
+    case '/': return divide(x, y, 0);
+    case '%': return divide(x, y, 1);
+    case T_EQ: return x == y;
+    case T_NE: return x != y;
+    case '<': return x < y;
+    case T_LE: return x <= y;
+    case '>': return x > y;
+    case T_GE: return x >= y;
+    case T_AND: return x && y;
+    case T_OR: return x || y;
+    }
+    return 0;
+}
+
+// Binary operator precedence, 0: not one
+int prec(int t) {
+    switch (t) {
+    case T_OR: return 1;
+    case T_AND: return 2;
+    case T_EQ: case T_NE: return 3;
+    case '<': case T_LE: case '>': case T_GE: return 4;
+    case '+': case '-': return 5;
+    case '*': case '/': case '%': return 6;
+    }
+    return 0;
+}
+
+NODE *parseExpr();
+
+NODE *parsePrimary() {
+    NODE *n, **arg;
+    int v;
+
+    if (tok == T_NUM) {
+        n = num(tok_val);
+        next();
+        return n;
+    }
+    if (tok == '(') {
+        next();
+        n = parseExpr();
+        expect(')');
+        return n;
+    }
+    if (tok != T_ID) error("expression expected");
+    next();
+    if (tok == '(') {	// call
+        n = node(N_CALL, NULL, NULL);
+        n->sym = findFunc(tok_str);
+        next();
+        for (arg = &n->a; tok != ')'; arg = &(*arg)->next) {
+            *arg = parseExpr();
+            if (tok != ')') expect(',');
+        }
+        next();
+        return n;
+    }
+    if ((v = findVar(tok_str)) < 0) error("undefined variable %s", tok_str);
+    n = node(N_VAR, NULL, NULL);
+    n->sym = v;
+    return n;
+}
+
+NODE *parseUnary() {
+    NODE *n;
+
+    if (tok == '-' || tok == '!' || tok == '+') {
+        int t = tok;
+        next();
+        n = parseUnary();
+        if (t == '+') return n;
+        if (n->kind == N_NUM) return num(t == '-' ? -n->op : !n->op);
+        return node(t == '-' ? N_NEG : N_NOT, n, NULL);
+    }
+    return parsePrimary();
+}
+
+NODE *parseBinary(int min) {
+    NODE *n = parseUnary(), *r;
+    int p, op;
+
+    while ((p = prec(tok)) >= min) {
+        op = tok;
+        next();
+        r = parseBinary(p + 1);
+        if (n->kind == N_NUM && r->kind == N_NUM) n = num(evalOp(op, n->op, r->op));	// constant folding
+        else {
+            n = node(N_BIN, n, r);
+            n->op = op;
+        }
+    }
+    return n;
+}
+
+NODE *parseExpr() {
+    NODE *n = parseBinary(1);
+
+    if (tok == '=') {
+        if (n->kind != N_VAR) error("variable expected before =");
+        next();
+        var[n->sym].written = 1;
+        n->kind = N_ASSIGN;
+        n->a = parseExpr();
+    }
+    return n;
+}
+
+NODE *parseStmt();
+
+// Statements up to '}'
+NODE *parseBlock() {
+    NODE *n = node(N_BLOCK, NULL, NULL), **s;
+
+    expect('{');
+    for (s = &n->a; tok != '}'; ) {
+        if (tok == T_EOF) error("'}' expected");
+        *s = parseStmt();
+        while (*s != NULL) s = &(*s)->next;
+    }
+    next();
+    return n;
+}
+
+// printf("format", args) or scanf("%d", &global)
+NODE *parseIO(int is_printf) {
+    static int n_scanf = 0;
+    NODE *n = node(is_printf ? N_PRINTF : N_SCANF, NULL, NULL), **arg;
+    int v;
+
+    expect('(');
+    if (tok != T_STR) error("format string expected");
+    n->str = strdup(tok_str);
+    next();
+    if (is_printf) {
+        for (arg = &n->a; tok == ','; arg = &(*arg)->next) {
+            next();
+            *arg = parseExpr();
+        }
+    }
+    else {
+        expect(',');
+        expect('&');
+        if (strcmp(n->str, "%d") != 0) error("scanf format must be \"%%d\"");
+        if (tok != T_ID || (v = findVar(tok_str)) < 0 || var[v].kind != V_GLOBAL)
+            error("scanf needs a global variable");
+        if (++n_scanf > N_INPUTS) error("more than %d inputs", N_INPUTS);
+        n->sym = v;
+        var[v].written = 1;
+        next();
+    }
+    expect(')');
+    expect(';');
+    return n;
+}
+
+NODE *parseStmt() {
+    NODE *n, *first = NULL, **s = &first;
+    int v;
+
+    switch (tok) {
+    case '{':
+        return parseBlock();
+    case ';':
+        next();
+        return NULL;
+    case T_INT:	// locals, initializers are assignments
+        do {
+            next();
+            if (tok != T_ID) error("name expected");
+            if ((v = findVar(tok_str)) >= 0 && var[v].kind == V_LOCAL) error("%s defined twice", tok_str);
+            v = newVar(tok_str, V_LOCAL, cur_func);
+            next();
+            if (tok == '=') {
+                next();
+                n = node(N_ASSIGN, parseExpr(), NULL);
+                n->sym = v;
+                var[v].written = 1;
+                *s = node(N_EXPR, n, NULL);
+                s = &(*s)->next;
+            }
+        } while (tok == ',');
+        expect(';');
+        return first;
+    case T_IF:
+        next();
+        expect('(');
+        n = node(N_IF, parseExpr(), NULL);
+        expect(')');
+        n->b = parseStmt();
+        if (tok == T_ELSE) {
+            next();
+            n->c = parseStmt();
+        }
+        return n;
+    case T_WHILE:
+        next();
+        expect('(');
+        n = node(N_WHILE, parseExpr(), NULL);
+        expect(')');
+        n->b = parseStmt();
+        return n;
+    case T_RETURN:
+        next();
+        n = node(N_RET, tok == ';' ? NULL : parseExpr(), NULL);
+        if (n->a != NULL && !func[cur_func].is_int) error("return with a value in void function");
+        expect(';');
+        return n;
+    }
+    if (tok == T_ID && (strcmp(tok_str, "printf") == 0 || strcmp(tok_str, "scanf") == 0)) {
+        v = tok_str[0] == 'p';
+        next();
+        return parseIO(v);
+    }
+    n = node(N_EXPR, parseExpr(), NULL);
+    expect(';');
+    return n;
+}
+
+// Function after its name: parameters, then body or ';'
+void parseFunc(const char *name, int is_int) {
+    FUNC *f;
+    char pname[MAX_PARAMS][32];
+    int n = 0, i;
+
+    cur_func = findFunc(name);
+    f = &func[cur_func];
+    f->is_int = is_int;
+    next();
+    if (tok == T_VOID) next();
+    while (tok != ')') {
+        expect(T_INT);
+        if (tok != T_ID) error("parameter name expected");
+        if (n == MAX_PARAMS) error("too many parameters");
+        strcpy(pname[n++], tok_str);
+        next();
+        if (tok != ')') expect(',');
+    }
+    next();
+    if (tok == ';') {	// prototype
+        next();
+        return;
+    }
+    if (f->defined) error("%s defined twice", name);
+    f->defined = 1;
+    f->n_param = n;
+    for (i = 0; i < n; i++) f->param[i] = newVar(pname[i], V_LOCAL, cur_func);
+    if (is_int) f->ret_var = newVar("", V_TEMP, cur_func);
+    if (strcmp(name, "main") == 0) main_func = cur_func;
+    f->body = parseBlock();
+    cur_func = -1;
+}
+
+// Program: globals and functions
+void parseProgram() {
+    char name[32];
+    int is_int, v;
+    NODE *n;
+
+    next();
+    while (tok != T_EOF) {
+        if (tok != T_INT && tok != T_VOID) error("declaration expected");
+        is_int = (tok == T_INT);
+        next();
+        if (tok != T_ID || strlen(tok_str) >= sizeof(name)) error("name expected");
+        strcpy(name, tok_str);
+        next();
+        if (tok == '(') {
+            parseFunc(name, is_int);
+            continue;
+        }
+        for (;;) {	// globals
+            if (!is_int) error("void variable %s", name);
+            if (findVar(name) >= 0) error("%s defined twice", name);
+            v = newVar(name, V_GLOBAL, -1);
+            if (tok == '=') {
+                next();
+                n = parseExpr();
+                if (n->kind != N_NUM) error("constant expected");
+                var[v].init = n->op;
+            }
+            if (tok != ',') break;
+            next();
+            if (tok != T_ID || strlen(tok_str) >= sizeof(name)) error("name expected");
+            strcpy(name, tok_str);
+            next();
+        }
+        expect(';');
+    }
+    if (main_func < 0) error("no main()");
+}
+
+//========================================
+// IR Generation
+// - an expression's temporary is used once, by the code just after it
+// - while loops are rotated: jump to the test at the bottom
+//========================================
+FUNC *cf;	// function being compiled
+
+// Append an IR instruction
+QUAD *emit(int op, int d, int a, int b) {
+    QUAD *p;
+
+    if (cf->n_q == MAX_QUADS) error("%s is too long", cf->name);
+    p = &cf->q[cf->n_q++];
+    memset(p, 0, sizeof(QUAD));
+    p->op = op;
+    p->d = d;
+    p->a = a;
+    p->b = b;
+    return p;
+}
+
+void emitLabel(int lab) {
+    emit(Q_LABEL, NONE, NONE, NONE)->lab = lab;
+}
+
+void emitJmp(int lab) {
+    emit(Q_JMP, NONE, NONE, NONE)->lab = lab;
+}
+
+void emitBr(int cc, int a, int b, int lab) {
+    QUAD *p = emit(Q_BR, NONE, a, b);
+
+    p->cc = cc;
+    p->lab = lab;
+}
+
+int newLabel() {
+    if (n_label == MAX_LABELS) error("too many labels");
+    return n_label++;
+}
+
+int newTemp() {
+    return newVar("", V_TEMP, (int)(cf - func));
+}
+
+// Move x to variable v, writing the last instruction's temporary to v directly
+void emitMove(int v, int x) {
+    QUAD *p = &cf->q[cf->n_q - 1];
+
+    if (IS_VAR(x) && var[x].kind == V_TEMP && cf->n_q > 0 && p->d == x && x != cf->ret_var &&
+        (p->op == Q_MOV || (p->op >= Q_ADD && p->op <= Q_AND)))
+        p->d = v;
+    else emit(Q_MOV, v, x, NONE);
+}
+
+int negateCC(int cc) {
+    static int neg[] = { CC_NE, CC_EQ, CC_GE, CC_GT, CC_LE, CC_LT };
+    return neg[cc];
+}
+
+// Condition with swapped operands
+int mirrorCC(int cc) {
+    static int mir[] = { CC_EQ, CC_NE, CC_GT, CC_GE, CC_LT, CC_LE };
+    return mir[cc];
+}
+
+int tokCC(int t) {
+    switch (t) {
+    case T_EQ: return CC_EQ;
+    case T_NE: return CC_NE;
+    case '<': return CC_LT;
+    case T_LE: return CC_LE;
+    case '>': return CC_GT;
+    case T_GE: return CC_GE;
+    }
+    return -1;
+}
+
+int genExpr(NODE *n);
+
+// Branch to lab if the truth of n is sense
+void genBranch(NODE *n, int lab, int sense) {
+    NODE *l, *r, *t;
+    int cc, skip, a;
+
+    if (n->kind == N_NUM) {
+        if ((n->op != 0) == sense) emitJmp(lab);
+        return;
+    }
+    if (n->kind == N_NOT) {
+        genBranch(n->a, lab, !sense);
+        return;
+    }
+    if (n->kind == N_BIN && (n->op == T_AND || n->op == T_OR)) {
+        if (sense == (n->op == T_OR)) {	// either one decides
+            genBranch(n->a, lab, sense);
+            genBranch(n->b, lab, sense);
+        }
+        else {
+            skip = newLabel();
+            genBranch(n->a, skip, !sense);
+            genBranch(n->b, lab, sense);
+            emitLabel(skip);
+        }
+        return;
+    }
+    if (n->kind != N_BIN || (cc = tokCC(n->op)) < 0) {
+        emitBr(sense ? CC_NE : CC_EQ, genExpr(n), CON(0), lab);
+        return;
+    }
+
+    l = n->a;
+    r = n->b;
+    if (l->kind == N_NUM && r->kind != N_NUM) {	// constant second
+        t = l, l = r, r = t;
+        cc = mirrorCC(cc);
+    }
+    if (r->kind == N_NUM && r->op == 0 && l->kind == N_BIN && l->op == '-') {	// x - y cc 0: x cc y
+        r = l->b;
+        l = l->a;
+    }
+    if (r->kind == N_BIN && r->b->kind == N_NUM && r->b->op == 1) {
+        if (r->op == '-' && (cc == CC_LE || cc == CC_GT)) {	// x <= y - 1: x < y
+            cc = (cc == CC_LE) ? CC_LT : CC_GE;
+            r = r->a;
+        }
+        else if (r->op == '+' && (cc == CC_LT || cc == CC_GE)) {	// x < y + 1: x <= y
+            cc = (cc == CC_LT) ? CC_LE : CC_GT;
+            r = r->a;
+        }
+    }
+    a = genExpr(l);
+    emitBr(sense ? cc : negateCC(cc), a, genExpr(r), lab);
+}
+
+// Call: arguments to the parameters, result to a temporary
+int genCall(NODE *n) {
+    FUNC *g = &func[n->sym];
+    int arg[MAX_PARAMS], i, t;
+    NODE *a;
+
+    for (i = 0, a = n->a; a != NULL; a = a->next, i++) {
+        if (i == MAX_PARAMS) error("too many arguments to %s", g->name);
+        arg[i] = genExpr(a);
+    }
+    if (!g->defined) error("%s is not defined", g->name);
+    if (i != g->n_param) error("%s needs %d arguments", g->name, g->n_param);
+    for (i = 0; i < g->n_param; i++) emitMove(g->param[i], arg[i]);
+    emit(Q_CALL, NONE, NONE, NONE)->lab = n->sym;
+    g->sites++;
+    if (!g->is_int) return CON(0);
+    t = newTemp();
+    emit(Q_MOV, t, g->ret_var, NONE);
+    return t;
+}
+
+// Code for an expression, return its operand
+int genExpr(NODE *n) {
+    int a, b, t, skip;
+    static int qop[128] = { ['+'] = Q_ADD, ['-'] = Q_SUB, ['*'] = Q_MUL, ['/'] = Q_DIV, ['%'] = Q_MOD };
+
+    switch (n->kind) {
+    case N_NUM:
+        return CON(n->op);
+    case N_VAR:
+        t = n->sym;
+        if (opt && var[t].kind == V_GLOBAL && !var[t].written) return CON(var[t].init);	// constant global
+        return t;
+    case N_ASSIGN:
+        emitMove(n->sym, genExpr(n->a));
+        return n->sym;
+    case N_CALL:
+        return genCall(n);
+    case N_NEG:
+        t = newTemp();
+        emit(Q_SUB, t, CON(0), genExpr(n->a));
+        return t;
+    case N_BIN:
+        if (n->op < 128 && qop[n->op] != 0) {
+            a = genExpr(n->a);
+            b = genExpr(n->b);
+            t = newTemp();
+            emit(qop[n->op], t, a, b);
+            return t;
+        }
+    }
+    // condition as 0 or 1
+    t = newTemp();
+    skip = newLabel();
+    emit(Q_MOV, t, CON(1), NONE);
+    genBranch(n, skip, 1);
+    emit(Q_MOV, t, CON(0), NONE);
+    emitLabel(skip);
+    return t;
+}
+
+void genStmt(NODE *n) {
+    int l1, l2, arg[64], n_arg, i, v;
+    NODE *a;
+    char *s;
+
+    for (; n != NULL; n = n->next) {
+        switch (n->kind) {
+        case N_EXPR:
+            genExpr(n->a);
+            break;
+        case N_BLOCK:
+            genStmt(n->a);
+            break;
+        case N_IF:
+            l1 = newLabel();
+            genBranch(n->a, l1, 0);
+            genStmt(n->b);
+            if (n->c != NULL) {
+                l2 = newLabel();
+                emitJmp(l2);
+                emitLabel(l1);
+                genStmt(n->c);
+                emitLabel(l2);
+            }
+            else emitLabel(l1);
+            break;
+        case N_WHILE:
+            l1 = newLabel();
+            l2 = newLabel();
+            if (n->a->kind == N_NUM) {
+                if (n->a->op == 0) break;
+                emitLabel(l1);
+                genStmt(n->b);
+                emitJmp(l1);
+                break;
+            }
+            emitJmp(l2);
+            emitLabel(l1);
+            genStmt(n->b);
+            emitLabel(l2);
+            genBranch(n->a, l1, 1);
+            break;
+        case N_RET:
+            if (n->a != NULL) {
+                v = genExpr(n->a);
+                if (cf != &func[main_func]) emitMove(cf->ret_var, v);
+            }
+            emit(cf == &func[main_func] ? Q_HALT : Q_RET, NONE, NONE, NONE);
+            break;
+        case N_PRINTF:
+            // arguments first, copied: a later one may change a variable
+            for (n_arg = 0, a = n->a; a != NULL; a = a->next) {
+                if (n_arg == 64) error("too many printf arguments");
+                v = genExpr(a);
+                if (IS_VAR(v) && var[v].kind != V_TEMP) {
+                    i = newTemp();
+                    emit(Q_MOV, i, v, NONE);
+                    v = i;
+                }
+                arg[n_arg++] = v;
+            }
+            for (s = n->str, i = 0; *s != '\0'; s++) {
+                if (*s == '%' && (s[1] == 'd' || s[1] == 'c')) {
+                    if (i == n_arg) error("printf needs more arguments");
+                    emit(*++s == 'd' ? Q_PRT : Q_PRC, NONE, arg[i++], NONE);
+                }
+                else if (*s == '%' && s[1] == '%') emit(Q_PRC, NONE, CON(*++s), NONE);
+                else if (*s == '%') error("printf supports %%d and %%c only");
+                else emit(Q_PRC, NONE, CON(*s), NONE);
+            }
+            if (i != n_arg) error("printf has too many arguments");
+            break;
+        case N_SCANF:
+            // next input word: a global that only the input writes
+            v = newVar(n_inputs ? "B" : "A", V_GLOBAL, -1);
+            var[v].input = n_inputs + 1;
+            var[v].written = 1;
+            slot_var[n_inputs++] = v;
+            emitMove(n->sym, v);
+            break;
+        }
+    }
+}
+
+// IR of each function
+void genProgram() {
+    int i;
+
+    for (i = 0; i < n_func; i++) {
+        if (!func[i].defined) {
+            line = func[i].line;
+            error("%s is not defined", func[i].name);
+        }
+        cf = &func[i];
+        cf->q = malloc(MAX_QUADS * sizeof(QUAD));
+        cf->n_q = 0;
+        genStmt(cf->body);
+        emit(i == main_func ? Q_HALT : Q_RET, NONE, NONE, NONE);
+    }
+}
+
+//========================================
+// Call Graph and Inlining
+// - no recursion: locals and parameters are static
+// - picoMIPS inlines every call, AccCom calls with one call site
+//========================================
+int visiting[MAX_FUNCS];	// 1: on the call path, 2: done
+
+void checkRecursion(int f) {
+    int i;
+
+    if (visiting[f] == 2) return;
+    visiting[f] = 1;
+    for (i = 0; i < func[f].n_q; i++)
+        if (func[f].q[i].op == Q_CALL) {
+            if (visiting[func[f].q[i].lab] == 1) {
+                line = func[func[f].q[i].lab].line;
+                error("recursion is not supported (%s)", func[func[f].q[i].lab].name);
+            }
+            checkRecursion(func[f].q[i].lab);
+        }
+    visiting[f] = 2;
+}
+
+// Insert an instruction at index at
+QUAD *insertQuad(FUNC *f, int at, QUAD *p) {
+    if (f->n_q == MAX_QUADS) error("%s is too long", f->name);
+    memmove(&f->q[at + 1], &f->q[at], (f->n_q - at)*sizeof(QUAD));
+    f->q[at] = *p;
+    f->n_q++;
+    return &f->q[at];
+}
+
+// Replace the call at f->q[at] by the body of the callee
+void inlineCall(FUNC *f, int at) {
+    FUNC *g = &func[f->q[at].lab];
+    int map[MAX_LABELS], i, end = newLabel();
+    QUAD *p;
+
+    for (i = 0; i < g->n_q; i++)
+        if (g->q[i].op == Q_LABEL) map[g->q[i].lab] = newLabel();
+    if (f->n_q + g->n_q + 1 > MAX_QUADS) error("%s is too long after inlining", f->name);
+    memmove(&f->q[at + g->n_q + 1], &f->q[at + 1], (f->n_q - at - 1)*sizeof(QUAD));
+    for (i = 0; i < g->n_q; i++) {
+        p = &f->q[at + i];
+        *p = g->q[i];
+        if (p->op == Q_LABEL || p->op == Q_JMP || p->op == Q_BR) p->lab = map[p->lab];
+        else if (p->op == Q_RET) {
+            p->op = Q_JMP;
+            p->lab = end;
+        }
+    }
+    p = &f->q[at + g->n_q];
+    memset(p, 0, sizeof(QUAD));
+    p->op = Q_LABEL;
+    p->d = p->a = p->b = NONE;
+    p->lab = end;
+    f->n_q += g->n_q;
+    g->sites--;
+}
+
+void inlineCalls() {
+    int fi, i;
+
+    checkRecursion(main_func);
+    for (fi = 0; fi < n_func; fi++)
+        for (i = 0; i < func[fi].n_q; i++)
+            if (func[fi].q[i].op == Q_CALL && (pico || (opt && func[func[fi].q[i].lab].sites == 1)))
+                inlineCall(&func[fi], i--);	// the inlined code may call again
+}
+
+// Function still compiled: main or called
+int live(int fi) {
+    return fi == main_func || func[fi].sites > 0;
+}
+
+//========================================
+// Data Flow
+//========================================
+int lab_at[MAX_LABELS];	// index of each label in the current function
+
+void findLabels(FUNC *f) {
+    int i;
+
+    for (i = 0; i < f->n_q; i++)
+        if (f->q[i].op == Q_LABEL) lab_at[f->q[i].lab] = i;
+}
+
+// Successors of f->q[i], return # of them
+int succs(FUNC *f, int i, int *s) {
+    QUAD *p = &f->q[i];
+    int n = 0;
+
+    if (p->op == Q_JMP || p->op == Q_BR) s[n++] = lab_at[p->lab];
+    if (p->op != Q_JMP && p->op != Q_RET && p->op != Q_HALT && i + 1 < f->n_q) s[n++] = i + 1;
+    return n;
+}
+
+int isAlu(int op) {
+    return op >= Q_ADD && op <= Q_AND;
+}
+
+int commutes(int op) {
+    return op == Q_ADD || op == Q_MUL || op == Q_AND;
+}
+
+// Variable written by an instruction, NONE
+int quadDef(QUAD *p) {
+    return (p->op == Q_MOV || isAlu(p->op)) ? p->d : NONE;
+}
+
+// 1: v is read by p
+int quadUses(QUAD *p, int v) {
+    return v >= 0 && (p->a == v || p->b == v) && p->op != Q_LABEL && p->op != Q_JMP;
+}
+
+// 1: v outlives a call into or return from function fi
+int shared(int v, int fi) {
+    return var[v].func != fi;
+}
+
+// Remove Q_NOP instructions
+void compact(FUNC *f) {
+    int i, n = 0;
+
+    for (i = 0; i < f->n_q; i++)
+        if (f->q[i].op != Q_NOP) f->q[n++] = f->q[i];
+    f->n_q = n;
+}
+
+// Liveness of variables before and after each instruction
+UINT64 *live_in = NULL, *live_out = NULL;
+int lw;		// words of a variable set
+
+void liveness(FUNC *f) {
+    int fi = (int)(f - func), i, k, ns, s[2], w, v, changed;
+    UINT64 *in, *out, *sh;
+    QUAD *p;
+
+    lw = (n_var + 63)/64;
+    live_in = realloc(live_in, (f->n_q + 1)*lw*sizeof(UINT64));
+    live_out = realloc(live_out, (f->n_q + 1)*lw*sizeof(UINT64));
+    memset(live_in, 0, f->n_q*lw*sizeof(UINT64));
+    sh = &live_in[f->n_q*lw];	// shared variables
+    memset(sh, 0, lw*sizeof(UINT64));
+    for (v = 0; v < n_var; v++)
+        if (shared(v, fi)) SET(sh, v);
+    findLabels(f);
+    do {
+        changed = 0;
+        for (i = f->n_q - 1; i >= 0; i--) {
+            p = &f->q[i];
+            in = &live_in[i*lw];
+            out = &live_out[i*lw];
+            memset(out, 0, lw*sizeof(UINT64));
+            ns = succs(f, i, s);
+            for (k = 0; k < ns; k++)
+                for (w = 0; w < lw; w++) out[w] |= live_in[s[k]*lw + w];
+            if (p->op == Q_RET) {	// the caller reads globals and the result
+                for (w = 0; w < lw; w++) out[w] |= sh[w];
+                if (f->ret_var >= 0) SET(out, f->ret_var);
+            }
+            for (w = 0; w < lw; w++) {
+                UINT64 x = out[w];
+                if (p->op == Q_CALL) x |= sh[w];
+                if (quadDef(p) >= 0 && quadDef(p) >> 6 == w) x &= ~(1ULL << (quadDef(p) & 63));
+                if (IS_VAR(p->a) && p->op != Q_LABEL && p->a >> 6 == w) x |= 1ULL << (p->a & 63);
+                if (IS_VAR(p->b) && p->b >> 6 == w) x |= 1ULL << (p->b & 63);
+                if (x != in[w]) {
+                    in[w] = x;
+                    changed = 1;
+                }
+            }
+        }
+    } while (changed);
+}
+
+// Facts of a must analysis: d = a op b (op Q_MOV: d = a)
+typedef struct {
+    int op, a, b, d;
+} FACT;
+
+FACT fact[MAX_FACTS];
+int n_fact;
+UINT64 *fact_in = NULL;	// facts true before each instruction
+int fw;					// words of a fact set
+
+// Index of the fact an instruction makes true, -1: none
+int factOf(QUAD *p, int kind) {
+    int i;
+
+    if (p->op != kind && !(kind != Q_MOV && isAlu(p->op))) return -1;
+    if (p->op == Q_MOV ? !IS_VAR(p->a) || p->a == p->d : p->a == p->d || p->b == p->d) return -1;
+    for (i = 0; i < n_fact; i++)
+        if (fact[i].op == p->op && fact[i].a == p->a && fact[i].b == (p->op == Q_MOV ? NONE : p->b) &&
+            fact[i].d == p->d) return i;
+    return -1;
+}
+
+// Apply f->q[i] to fact set s
+void factStep(FUNC *f, int i, UINT64 *s, int kind) {
+    QUAD *p = &f->q[i];
+    int d = quadDef(p), k, fi = (int)(f - func);
+
+    for (k = 0; k < n_fact; k++) {
+        FACT *x = &fact[k];
+        if ((d >= 0 && (x->a == d || x->b == d || x->d == d)) ||
+            (p->op == Q_CALL && ((IS_VAR(x->a) && shared(x->a, fi)) || (IS_VAR(x->b) && shared(x->b, fi)) ||
+                                 shared(x->d, fi))))
+            CLR(s, k);
+    }
+    if ((k = factOf(p, kind)) >= 0) SET(s, k);
+}
+
+// Facts of kind Q_MOV (copies) or Q_ADD (expressions) before each instruction
+void solveFacts(FUNC *f, int kind) {
+    int i, k, ns, s[2], w, changed;
+    UINT64 *tmp;
+    QUAD *p;
+
+    n_fact = 0;
+    for (i = 0; i < f->n_q && n_fact < MAX_FACTS; i++) {
+        p = &f->q[i];
+        if ((p->op == kind || (kind != Q_MOV && isAlu(p->op))) && factOf(p, kind) < 0 &&
+            (p->op == Q_MOV ? IS_VAR(p->a) && p->a != p->d : p->a != p->d && p->b != p->d)) {
+            fact[n_fact].op = p->op;
+            fact[n_fact].a = p->a;
+            fact[n_fact].b = (p->op == Q_MOV) ? NONE : p->b;
+            fact[n_fact++].d = p->d;
+        }
+    }
+    fw = (n_fact + 64)/64;
+    fact_in = realloc(fact_in, (f->n_q + 1)*fw*sizeof(UINT64));
+    memset(fact_in, 0xFF, f->n_q*fw*sizeof(UINT64));
+    memset(fact_in, 0, fw*sizeof(UINT64));
+    tmp = &fact_in[f->n_q*fw];
+    findLabels(f);
+    do {
+        changed = 0;
+        for (i = 0; i < f->n_q; i++) {
+            memcpy(tmp, &fact_in[i*fw], fw*sizeof(UINT64));
+            factStep(f, i, tmp, kind);
+            ns = succs(f, i, s);
+            for (k = 0; k < ns; k++)
+                for (w = 0; w < fw; w++)
+                    if (fact_in[s[k]*fw + w] & ~tmp[w]) {
+                        fact_in[s[k]*fw + w] &= tmp[w];
+                        changed = 1;
+                    }
+        }
+    } while (changed);
+}
+
+// Loop of instruction i: the innermost back edge range holding it
+// - return its head, -1: none; *end: its back edge
+int loopOf(FUNC *f, int i, int *end) {
+    int k, h, best = -1;
+
+    for (k = 0; k < f->n_q; k++)
+        if ((f->q[k].op == Q_JMP || f->q[k].op == Q_BR) && (h = lab_at[f->q[k].lab]) <= i && i <= k &&
+            h <= k && (best < 0 || h > best)) {
+            best = h;
+            *end = k;
+        }
+    return best;
+}
+
+//========================================
+// Optimizer
+// - constant folding and propagation, jump threading on known values
+// - copy propagation, common subexpressions (available expressions)
+// - strength reduction: x*2 is x+x, and i*j in a loop where j steps by
+//   a constant becomes a running sum
+// - dead code, variables nothing reads, cold blocks out of line
+//========================================
+#define CP_TOP		0x7FFF0000	// not reached
+#define CP_NAC		0x7FFF0001	// not a constant
+
+int *cp = NULL;		// constants before each instruction, n_var per instruction
+
+int cpVal(int *s, int x) {
+    return IS_CON(x) ? CVAL(x) : s[x];
+}
+
+// Fold op on constants, CP_NAC if it traps
+int foldOp(int op, int x, int y) {
+    switch (op) {
+    case Q_ADD: return (short)(x + y);
+    case Q_SUB: return (short)(x - y);
+    case Q_MUL: return (short)(x*y);
+    case Q_DIV: return y == 0 ? CP_NAC : divide(x, y, 0);
+    case Q_MOD: return y == 0 ? CP_NAC : divide(x, y, 1);
+    case Q_AND: return (short)(x & y);
+    }
+    return CP_NAC;
+}
+
+int testCC(int cc, int x, int y) {
+    switch (cc) {
+    case CC_EQ: return x == y;
+    case CC_NE: return x != y;
+    case CC_LT: return x < y;
+    case CC_LE: return x <= y;
+    case CC_GT: return x > y;
+    }
+    return x >= y;
+}
+
+// Apply f->q[i] to constant state s
+void cpStep(FUNC *f, int i, int *s) {
+    QUAD *p = &f->q[i];
+    int v, x, y, fi = (int)(f - func);
+
+    if (p->op == Q_MOV) s[p->d] = cpVal(s, p->a);
+    else if (isAlu(p->op)) {
+        x = cpVal(s, p->a);
+        y = cpVal(s, p->b);
+        s[p->d] = (x == CP_NAC || y == CP_NAC) ? CP_NAC : foldOp(p->op, x, y);
+    }
+    else if (p->op == Q_CALL)
+        for (v = 0; v < n_var; v++)
+            if (shared(v, fi)) s[v] = CP_NAC;
+}
+
+// Outcome of the branch at f->q[m] in state s: 1 taken, 0 not, -1 unknown
+int cpBranch(FUNC *f, int m, int *s) {
+    QUAD *p = &f->q[m];
+    int x = cpVal(s, p->a), y = cpVal(s, p->b);
+
+    if (p->op != Q_BR || x == CP_NAC || y == CP_NAC) return -1;
+    return testCC(p->cc, x, y);
+}
+
+// First instruction at or after i that is not a label
+int firstReal(FUNC *f, int i) {
+    while (i < f->n_q && (f->q[i].op == Q_LABEL || f->q[i].op == Q_NOP)) i++;
+    return i;
+}
+
+// Jump threading: an edge into a branch decided by known constants goes to its outcome
+// - return 1 after one change
+int threadJumps(FUNC *f, int *reached) {
+    int *s = malloc(n_var*sizeof(int)), i, m, t, lab;
+    QUAD *p, q;
+
+    for (i = 0; i < f->n_q; i++) {
+        p = &f->q[i];
+        if (!reached[i]) continue;
+        if (p->op == Q_JMP || p->op == Q_BR) m = firstReal(f, lab_at[p->lab]);
+        else if (p->op != Q_RET && p->op != Q_HALT && i + 1 < f->n_q && f->q[i + 1].op == Q_LABEL)
+            m = firstReal(f, i + 1);
+        else continue;
+        memcpy(s, &cp[i*n_var], n_var*sizeof(int));
+        cpStep(f, i, s);
+        if (m == i || (t = cpBranch(f, m, s)) < 0) continue;
+        if (t) lab = f->q[m].lab;
+        else if (m + 1 < f->n_q && f->q[m + 1].op == Q_LABEL) lab = f->q[m + 1].lab;
+        else {	// label after the branch
+            memset(&q, 0, sizeof(q));
+            q.op = Q_LABEL;
+            q.d = q.a = q.b = NONE;
+            q.lab = lab = newLabel();
+            insertQuad(f, m + 1, &q);
+            if (i > m) i++;
+            p = &f->q[i];
+        }
+        if (p->op == Q_JMP || p->op == Q_BR) {
+            if (p->lab == lab) continue;
+            p->lab = lab;
+        }
+        else {
+            memset(&q, 0, sizeof(q));
+            q.op = Q_JMP;
+            q.d = q.a = q.b = NONE;
+            q.lab = lab;
+            insertQuad(f, i + 1, &q);
+        }
+        free(s);
+        return 1;
+    }
+    free(s);
+    return 0;
+}
+
+// Algebraic simplification, return 1 if changed
+int simplify(QUAD *p) {
+    int t;
+
+    if (p->op == Q_MOV && p->a == p->d) {
+        p->op = Q_NOP;
+        return 1;
+    }
+    if (p->op == Q_BR && IS_CON(p->a) && !IS_CON(p->b)) {	// constant second
+        t = p->a, p->a = p->b, p->b = t;
+        p->cc = mirrorCC(p->cc);
+        return 1;
+    }
+    if (p->op == Q_BR && p->a == p->b) {
+        p->op = (p->cc == CC_EQ || p->cc == CC_LE || p->cc == CC_GE) ? Q_JMP : Q_NOP;
+        return 1;
+    }
+    if (!isAlu(p->op)) return 0;
+    if (commutes(p->op) && IS_CON(p->a) && !IS_CON(p->b)) {
+        t = p->a, p->a = p->b, p->b = t;
+        return 1;
+    }
+    if (p->op == Q_SUB && p->a == p->b) {
+        p->op = Q_MOV;
+        p->a = CON(0);
+    }
+    else if (!IS_CON(p->b)) return 0;
+    else if (CVAL(p->b) == 0 && (p->op == Q_ADD || p->op == Q_SUB)) p->op = Q_MOV;
+    else if (CVAL(p->b) == 1 && (p->op == Q_MUL || p->op == Q_DIV)) p->op = Q_MOV;
+    else if ((CVAL(p->b) == 0 && (p->op == Q_MUL || p->op == Q_AND)) || (CVAL(p->b) == 1 && p->op == Q_MOD)) {
+        p->op = Q_MOV;
+        p->a = CON(0);
+    }
+    else if (CVAL(p->b) == 2 && p->op == Q_MUL) {	// strength reduction
+        p->op = Q_ADD;
+        p->b = p->a;
+        return 1;
+    }
+    else return 0;
+    p->b = NONE;
+    return 1;
+}
+
+// Constant propagation and folding, jump threading, unreachable code
+int constProp(FUNC *f) {
+    int fi = (int)(f - func), nv = n_var, n = 0, i, k, v, ns, s[2], changed, t, x, y;
+    int *reached = calloc(f->n_q + 1, sizeof(int)), *tmp;
+    QUAD *p;
+
+    findLabels(f);
+    cp = realloc(cp, (f->n_q + 1)*nv*sizeof(int));
+    for (i = 0; i < f->n_q*nv; i++) cp[i] = CP_TOP;
+    tmp = &cp[f->n_q*nv];
+    for (v = 0; v < nv; v++)	// main starts with the initial values
+        cp[v] = (fi == main_func && var[v].kind == V_GLOBAL && !var[v].input) ? (short)var[v].init : CP_NAC;
+    if (f->n_q > 0) reached[0] = 1;
+    do {
+        changed = 0;
+        for (i = 0; i < f->n_q; i++) {
+            if (!reached[i]) continue;
+            memcpy(tmp, &cp[i*nv], nv*sizeof(int));
+            cpStep(f, i, tmp);
+            ns = succs(f, i, s);
+            if (f->q[i].op == Q_BR && (t = cpBranch(f, i, tmp)) >= 0) {	// decided: one edge
+                if (t) ns = 1;
+                else if (ns == 2) s[0] = s[1], ns = 1;
+                else ns = 0;
+            }
+            for (k = 0; k < ns; k++) {
+                int *d = &cp[s[k]*nv];
+                if (!reached[s[k]]) {
+                    reached[s[k]] = changed = 1;
+                    memcpy(d, tmp, nv*sizeof(int));
+                    continue;
+                }
+                for (v = 0; v < nv; v++)
+                    if (d[v] != tmp[v] && d[v] != CP_NAC) {
+                        d[v] = (d[v] == CP_TOP) ? tmp[v] : CP_NAC;
+                        changed = 1;
+                    }
+            }
+        }
+    } while (changed);
+
+    for (i = 0; i < f->n_q; i++) {
+        p = &f->q[i];
+        if (!reached[i]) {
+            if (p->op != Q_LABEL && p->op != Q_NOP) {
+                p->op = Q_NOP;
+                n++;
+            }
+            continue;
+        }
+        if (p->op == Q_LABEL || p->op == Q_JMP || p->op == Q_CALL) continue;
+        if (IS_VAR(p->a) && (x = cp[i*nv + p->a]) != CP_NAC && x != CP_TOP) {
+            p->a = CON(x);
+            n++;
+        }
+        if (IS_VAR(p->b) && (y = cp[i*nv + p->b]) != CP_NAC && y != CP_TOP) {
+            p->b = CON(y);
+            n++;
+        }
+        if (isAlu(p->op) && IS_CON(p->a) && IS_CON(p->b) && (x = foldOp(p->op, CVAL(p->a), CVAL(p->b))) != CP_NAC) {
+            p->op = Q_MOV;
+            p->a = CON(x);
+            p->b = NONE;
+            n++;
+        }
+        if (p->op == Q_BR && IS_CON(p->a) && IS_CON(p->b)) {
+            p->op = testCC(p->cc, CVAL(p->a), CVAL(p->b)) ? Q_JMP : Q_NOP;
+            n++;
+        }
+        n += simplify(p);
+    }
+    n += threadJumps(f, reached);
+    compact(f);
+    free(reached);
+    return n;
+}
+
+// Copy propagation: read the source of a copy still valid
+int copyProp(FUNC *f) {
+    int n = 0, i, k;
+    QUAD *p;
+
+    solveFacts(f, Q_MOV);
+    for (i = 0; i < f->n_q; i++) {
+        p = &f->q[i];
+        if (p->op == Q_LABEL || p->op == Q_JMP || p->op == Q_CALL) continue;
+        for (k = 0; k < n_fact; k++) {
+            if (!BIT(&fact_in[i*fw], k)) continue;
+            if (p->a == fact[k].d) {
+                p->a = fact[k].a;
+                n++;
+            }
+            if (p->b == fact[k].d) {
+                p->b = fact[k].a;
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+// Common subexpressions: reuse a variable still holding the value
+int availExpr(FUNC *f) {
+    int n = 0, i, k;
+    QUAD *p;
+    FACT *x;
+
+    solveFacts(f, Q_ADD);
+    for (i = 0; i < f->n_q; i++) {
+        p = &f->q[i];
+        if (!isAlu(p->op)) continue;
+        for (k = 0; k < n_fact; k++) {
+            x = &fact[k];
+            if (BIT(&fact_in[i*fw], k) && x->op == p->op && x->d != p->d &&
+                ((x->a == p->a && x->b == p->b) || (commutes(p->op) && x->a == p->b && x->b == p->a))) {
+                p->op = Q_MOV;
+                p->a = x->d;
+                p->b = NONE;
+                n++;
+                break;
+            }
+        }
+    }
+    return n;
+}
+
+// Step of a basic induction variable j in loop h ~ e: its only definition
+// there is j = j + k, return k (0: not one), *at: that instruction
+int ivStep(FUNC *f, int j, int h, int e, int *at) {
+    int i, n = 0, k = 0;
+    QUAD *p;
+
+    if (!IS_VAR(j)) return 0;
+    for (i = h; i <= e; i++) {
+        p = &f->q[i];
+        if (quadDef(p) != j) continue;
+        n++;
+        *at = i;
+        if (p->op == Q_ADD && p->a == j && IS_CON(p->b)) k = CVAL(p->b);
+        else if (p->op == Q_ADD && p->b == j && IS_CON(p->a)) k = CVAL(p->a);
+        else if (p->op == Q_SUB && p->a == j && IS_CON(p->b)) k = -CVAL(p->b);
+    }
+    return n == 1 ? k : 0;
+}
+
+// # of definitions of v in h ~ e
+int defCount(FUNC *f, int v, int h, int e) {
+    int i, n = 0;
+
+    for (i = h; i <= e; i++)
+        if (quadDef(&f->q[i]) == v) n++;
+    return n;
+}
+
+// 1: a fact x = c*j (either order) is true before f->q[i], or after it if step
+int factHolds(FUNC *f, int i, int step, int x, int c, int j) {
+    UINT64 *s = &fact_in[f->n_q*fw];
+    int k;
+
+    memcpy(s, &fact_in[i*fw], fw*sizeof(UINT64));
+    if (step) factStep(f, i, s, Q_ADD);
+    for (k = 0; k < n_fact; k++)
+        if (BIT(s, k) && fact[k].op == Q_MUL && fact[k].d == x &&
+            ((fact[k].a == c && fact[k].b == j) || (fact[k].a == j && fact[k].b == c))) return 1;
+    return 0;
+}
+
+// Strength reduction of x = c*j in a loop, j a basic induction variable and c invariant
+// - x must hold c*j at the loop entry, and its only definition follow j's
+//   step in the same block: it becomes x = x + c*k
+// - a separate running sum would cost as much as the mul it replaces
+// - return 1 after one change
+int strengthReduce(FUNC *f) {
+    int i, e, h, c, j, k, at, step, x, cc, fall, n, inc, t, u;
+    QUAD *p, q;
+
+    solveFacts(f, Q_ADD);
+    for (e = 0; e < f->n_q; e++) {
+        if ((f->q[e].op != Q_JMP && f->q[e].op != Q_BR) || (h = lab_at[f->q[e].lab]) > e || h == 0) continue;
+        // one entry: the jump or fall through at h - 1
+        for (i = h, n = 0; i <= e; i++)
+            if (f->q[i].op == Q_CALL) n = 99;
+        for (i = 0; i < f->n_q; i++)
+            if ((i < h || i > e) && (f->q[i].op == Q_JMP || f->q[i].op == Q_BR) &&
+                lab_at[f->q[i].lab] >= h && lab_at[f->q[i].lab] <= e && !(i == h - 1 && f->q[i].op == Q_JMP)) n++;
+        p = &f->q[h - 1];
+        fall = !(p->op == Q_JMP || p->op == Q_BR || p->op == Q_RET || p->op == Q_HALT);
+        if (n > 0 || (!fall && p->op != Q_JMP)) continue;
+        at = fall ? h : h - 1;
+
+        for (c = h; c <= e; c++) {
+            p = &f->q[c];
+            if (p->op != Q_MUL || !IS_VAR(p->d)) continue;
+            x = p->d;
+            for (k = 0; k < 2; k++) {
+                j = k ? p->a : p->b;
+                cc = k ? p->b : p->a;
+                if ((step = ivStep(f, j, h, e, &i)) != 0 && (IS_CON(cc) || defCount(f, cc, h, e) == 0) &&
+                    x != j && x != cc) break;
+            }
+            for (t = i + 1; t < c && f->q[t].op != Q_LABEL && f->q[t].op != Q_BR && f->q[t].op != Q_JMP; t++);
+            if (k == 2 || i > c || t != c || defCount(f, x, h, e) != 1 || !factHolds(f, at, fall, x, cc, j)) continue;
+
+            // increment: c*step
+            u = NONE;
+            if (IS_CON(cc)) inc = CON(CVAL(cc)*step);
+            else if (step == 1 || step == -1) inc = cc;
+            else inc = u = newTemp();
+            memset(&q, 0, sizeof(q));
+            q.op = (step == -1 && !IS_CON(cc)) ? Q_SUB : Q_ADD;
+            q.d = q.a = x;
+            q.b = inc;
+            f->q[c] = q;
+            if (u != NONE) {
+                q.op = Q_MUL;
+                q.d = u;
+                q.a = cc;
+                q.b = CON(step);
+                insertQuad(f, at, &q);
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Dead code: definitions nothing reads
+int deadCode(FUNC *f) {
+    int n = 0, i, d;
+
+    liveness(f);
+    for (i = 0; i < f->n_q; i++)
+        if ((d = quadDef(&f->q[i])) >= 0 && !BIT(&live_out[i*lw], d)) {
+            f->q[i].op = Q_NOP;
+            n++;
+        }
+    compact(f);
+    return n;
+}
+
+// Variables nothing reads: only their own definitions use them
+int uselessVars() {
+    unsigned char *need = calloc(n_var, 1);
+    int n = 0, fi, i, changed;
+    QUAD *p;
+
+    do {
+        changed = 0;
+        for (fi = 0; fi < n_func; fi++) {
+            if (!live(fi)) continue;
+            for (i = 0; i < func[fi].n_q; i++) {
+                p = &func[fi].q[i];
+                if (quadDef(p) >= 0 && !need[p->d] && p->op != Q_DIV && p->op != Q_MOD) continue;
+                if (p->op == Q_LABEL || p->op == Q_JMP || p->op == Q_CALL) continue;
+                if (IS_VAR(p->a) && !need[p->a]) need[p->a] = changed = 1;
+                if (IS_VAR(p->b) && !need[p->b]) need[p->b] = changed = 1;
+            }
+            if (func[fi].ret_var >= 0 && !need[func[fi].ret_var] && fi != main_func) {
+                for (i = 0; i < n_func; i++) {	// needed if a caller reads it
+                    int k;
+                    for (k = 0; k < func[i].n_q && live(i); k++)
+                        if (quadUses(&func[i].q[k], func[fi].ret_var) && !need[func[fi].ret_var])
+                            need[func[fi].ret_var] = changed = 1;
+                }
+            }
+        }
+    } while (changed);
+    for (fi = 0; fi < n_func; fi++) {
+        if (!live(fi)) continue;
+        for (i = 0; i < func[fi].n_q; i++) {
+            p = &func[fi].q[i];
+            if (quadDef(p) >= 0 && !need[p->d] && p->op != Q_DIV && p->op != Q_MOD) {
+                p->op = Q_NOP;
+                n++;
+            }
+        }
+        compact(&func[fi]);
+    }
+    free(need);
+    return n;
+}
+
+// 1: label lab comes right after f->q[i], before any instruction
+int labelFollows(FUNC *f, int i, int lab) {
+    for (i++; i < f->n_q && (f->q[i].op == Q_LABEL || f->q[i].op == Q_NOP); i++)
+        if (f->q[i].op == Q_LABEL && f->q[i].lab == lab) return 1;
+    return 0;
+}
+
+// Control flow cleanup: jumps to jumps or to the next instruction, branches
+// over a jump, unreachable code, labels nothing jumps to
+int cleanCfg(FUNC *f) {
+    static int ref[MAX_LABELS];
+    int n = 0, i, j, m, hops;
+    QUAD *p;
+
+    findLabels(f);
+    for (i = 0; i < f->n_q; i++) {
+        p = &f->q[i];
+        if (p->op == Q_JMP || p->op == Q_BR) {
+            for (hops = 0; hops < 8; hops++) {
+                m = firstReal(f, lab_at[p->lab]);
+                if (m >= f->n_q || f->q[m].op != Q_JMP || f->q[m].lab == p->lab) break;
+                p->lab = f->q[m].lab;
+                n++;
+            }
+            if (labelFollows(f, i, p->lab)) {
+                p->op = Q_NOP;
+                n++;
+                continue;
+            }
+            if (p->op == Q_BR && i + 1 < f->n_q && f->q[i + 1].op == Q_JMP && f->q[i + 1].lab == p->lab) {
+                p->op = Q_NOP;
+                n++;
+                continue;
+            }
+            if (p->op == Q_BR && i + 1 < f->n_q && f->q[i + 1].op == Q_JMP && labelFollows(f, i + 1, p->lab)) {
+                p->cc = negateCC(p->cc);
+                p->lab = f->q[i + 1].lab;
+                f->q[i + 1].op = Q_NOP;
+                n++;
+            }
+        }
+        if (p->op == Q_JMP || p->op == Q_RET || p->op == Q_HALT)
+            for (j = i + 1; j < f->n_q && f->q[j].op != Q_LABEL; j++)
+                if (f->q[j].op != Q_NOP) {
+                    f->q[j].op = Q_NOP;
+                    n++;
+                }
+    }
+    memset(ref, 0, n_label*sizeof(int));
+    for (i = 0; i < f->n_q; i++)
+        if (f->q[i].op == Q_JMP || f->q[i].op == Q_BR) ref[f->q[i].lab]++;
+    for (i = 0; i < f->n_q; i++)
+        if (f->q[i].op == Q_LABEL && ref[f->q[i].lab] == 0) {
+            f->q[i].op = Q_NOP;
+            n++;
+        }
+    compact(f);
+    return n;
+}
+
+// Cold blocks out of line: a block a branch skips that leaves the function
+// or its loop moves to the end, the branch goes to it instead
+int layout(FUNC *f) {
+    int i, j, h, e, k, len, lab;
+    QUAD *p, *blk;
+
+    findLabels(f);
+    for (i = 0; i + 1 < f->n_q; i++) {
+        p = &f->q[i];
+        if (p->op != Q_BR) continue;
+        for (j = i + 1; j < f->n_q && f->q[j].op != Q_LABEL && f->q[j].op != Q_JMP &&
+             f->q[j].op != Q_RET && f->q[j].op != Q_HALT && f->q[j].op != Q_BR; j++);
+        if (j >= f->n_q || f->q[j].op == Q_LABEL || f->q[j].op == Q_BR || !labelFollows(f, j, p->lab)) continue;
+        if (f->q[j].op == Q_JMP) {	// cold if it leaves the loop
+            if ((h = loopOf(f, i, &e)) < 0) continue;
+            k = lab_at[f->q[j].lab];
+            if (k >= h && k <= e) continue;
+        }
+        else if (loopOf(f, i, &e) < 0) continue;
+        len = j - i;
+        blk = malloc(len*sizeof(QUAD));
+        memcpy(blk, &f->q[i + 1], len*sizeof(QUAD));
+        memmove(&f->q[i + 1], &f->q[j + 1], (f->n_q - j - 1)*sizeof(QUAD));
+        f->n_q -= len;
+        lab = newLabel();
+        p->cc = negateCC(p->cc);
+        p->lab = lab;
+        p = &f->q[f->n_q++];
+        memset(p, 0, sizeof(QUAD));
+        p->op = Q_LABEL;
+        p->d = p->a = p->b = NONE;
+        p->lab = lab;
+        memcpy(&f->q[f->n_q], blk, len*sizeof(QUAD));
+        f->n_q += len;
+        free(blk);
+        return 1;
+    }
+    return 0;
+}
+
+void optimize() {
+    int fi, n, rounds;
+    FUNC *f;
+
+    // common subexpressions and strength reduction before constants fold away their facts
+    for (fi = 0; fi < n_func; fi++) {
+        if (!live(fi)) continue;
+        f = &func[fi];
+        for (rounds = 0; rounds < MAX_ROUNDS && availExpr(f) + copyProp(f) + strengthReduce(f) > 0; rounds++);
+    }
+    for (rounds = 0; rounds < MAX_ROUNDS; rounds++) {
+        for (fi = n = 0; fi < n_func; fi++) {
+            if (!live(fi)) continue;
+            f = &func[fi];
+            n += constProp(f) + copyProp(f) + availExpr(f) + deadCode(f) + cleanCfg(f);
+            if (n == 0) n += layout(f);
+        }
+        n += uselessVars();
+        if (n == 0) break;
+    }
+}
+
+//========================================
+// AccCom Code Generation
+// - variables and constants are DATA words, A and B at 0100 and 0102
+// - the accumulator keeps a value across instructions: a value stored
+//   only when something reads it from memory later
+//========================================
+char out_buf[MAX_CODE];	// CODE section text
+int out_len = 0;
+int out_on = 1;			// 0: dry run
+
+void out(const char *fmt, ...) {
+    va_list ap;
+
+    if (!out_on) return;
+    va_start(ap, fmt);
+    out_len += vsnprintf(out_buf + out_len, MAX_CODE - out_len, fmt, ap);
+    va_end(ap);
+    if (out_len >= MAX_CODE - 1) error("program is too long");
+}
+
+// Assembler label of a variable, function or constant
+char *varName(int v) {
+    static char buf[4][16];
+    static int k = 0;
+    char *s = buf[k++ & 3];
+
+    if (var[v].input) sprintf(s, "in%c", var[v].name[0]);
+    else if (var[v].kind == V_GLOBAL && strlen(var[v].name) < 14) sprintf(s, "_%s", var[v].name);
+    else if (var[v].kind == V_TEMP) sprintf(s, "t%d", v);
+    else sprintf(s, "v%d", v);
+    return s;
+}
+
+char *funcName(int fi) {
+    static char buf[16];
+
+    if (fi == main_func) return "main";
+    if (strlen(func[fi].name) < 13) sprintf(buf, "f_%s", func[fi].name);
+    else sprintf(buf, "f%d", fi);
+    return buf;
+}
+
+int const_used[0x10000];	// AccCom constants in DATA
+
+char *conName(int n) {
+    static char buf[4][16];
+    static int k = 0;
+    char *s = buf[k++ & 3];
+
+    const_used[n & 0xFFFF] = 1;
+    if (n < 0) sprintf(s, "km%d", -n);
+    else sprintf(s, "k%d", n);
+    return s;
+}
+
+char *opName(int x) {
+    return IS_CON(x) ? conName(CVAL(x)) : varName(x);
+}
+
+#define ACC_TOP		(-2)	// label not reached yet
+
+int acc_lab[MAX_LABELS];	// operand in acc at each label, NONE: unknown
+int psw_lab[MAX_LABELS];	// 1: PSW reflects acc there
+int a_opd;		// operand acc holds, NONE: unknown
+int a_psw;		// 1: PSW reflects acc
+int a_dirty;	// 1: acc holds variable a_opd not stored yet
+int a_changes;	// label states changed in this pass
+int n_local;	// local labels of this function
+FUNC *af;
+
+// Acc goes to label lab
+void accMerge(int lab) {
+    if (acc_lab[lab] == ACC_TOP) {
+        acc_lab[lab] = a_opd;
+        psw_lab[lab] = a_psw;
+        a_changes++;
+        return;
+    }
+    if (acc_lab[lab] != a_opd && acc_lab[lab] != NONE) {
+        acc_lab[lab] = NONE;
+        a_changes++;
+    }
+    if (psw_lab[lab] && (!a_psw || acc_lab[lab] == NONE)) {
+        psw_lab[lab] = 0;
+        a_changes++;
+    }
+}
+
+// Store the variable acc holds if it is read later
+// - live: variables read after this point
+void accStore(UINT64 *live) {
+    if (a_dirty && BIT(live, a_opd)) out("        STA %s\n", varName(a_opd));
+    a_dirty = 0;
+}
+
+// Before acc changes in instruction i: store the value acc holds if needed
+void accClobber(int i) {
+    QUAD *p = &af->q[i];
+
+    if (a_dirty && ((BIT(&live_out[i*lw], a_opd) && a_opd != quadDef(p)) || quadUses(p, a_opd)))
+        out("        STA %s\n", varName(a_opd));
+    a_dirty = 0;
+}
+
+void accLoad(int i, int x) {
+    if (a_opd == x) return;
+    accClobber(i);
+    out("        LDA %s\n", opName(x));
+    a_opd = x;
+    a_psw = 1;
+}
+
+// Before an instruction reads x from memory
+void accMem(int x) {
+    if (a_dirty && a_opd == x) {
+        out("        STA %s\n", varName(x));
+        a_dirty = 0;
+    }
+}
+
+// One pass over function f, return # of label states changed
+int accFunc(FUNC *f) {
+    static char *name[] = { [Q_ADD] = "ADD", [Q_SUB] = "SUB", [Q_MUL] = "MUL", [Q_DIV] = "DIV", [Q_MOD] = "MOD" };
+    int i, x, y, cc, t, reach = 1;
+    QUAD *p;
+
+    af = f;
+    a_opd = NONE;
+    a_psw = a_dirty = a_changes = 0;
+    out("%s:\n", funcName((int)(f - func)));
+    for (i = 0; i < f->n_q; i++) {
+        p = &f->q[i];
+        if (p->op == Q_LABEL) {
+            if (reach) {
+                accStore(&live_in[i*lw]);
+                accMerge(p->lab);
+            }
+            a_opd = acc_lab[p->lab];
+            a_psw = psw_lab[p->lab];
+            reach = (a_opd != ACC_TOP);
+            if (!reach && out_on) reach = 1, a_opd = NONE, a_psw = 0;
+            out("L%d:\n", p->lab);
+            continue;
+        }
+        if (!reach) continue;
+        switch (p->op) {
+        case Q_MOV:
+            if (a_opd == p->a && a_dirty && BIT(&live_out[i*lw], p->a)) accMem(p->a);
+            else accLoad(i, p->a);
+            a_opd = p->d;
+            a_dirty = 1;
+            break;
+        case Q_ADD: case Q_SUB: case Q_MUL: case Q_DIV: case Q_MOD:
+            x = p->a;
+            y = p->b;
+            if (commutes(p->op) && a_opd == y && a_opd != x) t = x, x = y, y = t;
+            accLoad(i, x);
+            if (p->op == Q_ADD && IS_CON(y) && CVAL(y) == 1) {
+                accClobber(i);
+                out("        IAC\n");
+                a_psw = 0;
+            }
+            else {
+                if (IS_VAR(y)) accMem(y);
+                accClobber(i);
+                out("        %s %s\n", name[p->op], opName(y));
+                a_psw = 1;
+            }
+            a_opd = p->d;
+            a_dirty = 1;
+            break;
+        case Q_BR:
+            // x - y: LT negative, LE negative or zero, EQ zero, NE not zero
+            x = p->a;
+            y = p->b;
+            cc = p->cc;
+            if (cc == CC_GT || cc == CC_GE) {
+                t = x, x = y, y = t;
+                cc = mirrorCC(cc);
+            }
+            if ((cc == CC_EQ || cc == CC_NE) && a_opd == y) t = x, x = y, y = t;
+            if (!(IS_CON(y) && CVAL(y) == 0 && a_opd == x && a_psw)) {
+                accLoad(i, x);
+                if (!(IS_CON(y) && CVAL(y) == 0 && a_psw)) {
+                    if (IS_VAR(y)) accMem(y);
+                    out("        CMP %s\n", opName(y));
+                    a_psw = IS_CON(y) && CVAL(y) == 0;
+                }
+            }
+            if (!(IS_CON(y) && CVAL(y) == 0)) a_psw = 0;
+            accStore(&live_out[i*lw]);
+            accMerge(p->lab);
+            if (cc == CC_NE) {
+                out("        BRZ l%d\n", n_local);
+                out("        JMP L%d\n", p->lab);
+                out("l%d:\n", n_local++);
+            }
+            else {
+                if (cc != CC_EQ) out("        BRN L%d\n", p->lab);
+                if (cc != CC_LT) out("        BRZ L%d\n", p->lab);
+            }
+            break;
+        case Q_JMP:
+            accStore(&live_out[i*lw]);
+            accMerge(p->lab);
+            out("        JMP L%d\n", p->lab);
+            reach = 0;
+            break;
+        case Q_CALL:
+            accStore(&live_in[i*lw]);
+            out("        CAL %s\n", funcName(p->lab));
+            a_opd = NONE;
+            a_psw = 0;
+            break;
+        case Q_RET:
+            accStore(&live_in[i*lw]);
+            out("        RET\n");
+            reach = 0;
+            break;
+        case Q_HALT:
+            out("        HLT\n");
+            reach = 0;
+            break;
+        case Q_PRT:
+            if (IS_VAR(p->a)) accMem(p->a);
+            out("        PRT %s\n", opName(p->a));
+            break;
+        case Q_PRC:
+            if (IS_CON(p->a)) out("        PRC %03X\n", CVAL(p->a) & 0xFF);
+            else {
+                accMem(p->a);
+                out("        PRC (%s)\n", varName(p->a));
+            }
+            break;
+        }
+    }
+    return a_changes;
+}
+
+// Operand names read from memory in the code
+char (*read_name)[16] = NULL;
+int n_read = 0;
+
+int isRead(const char *name) {
+    int i;
+
+    for (i = 0; i < n_read; i++)
+        if (strcmp(read_name[i], name) == 0) return 1;
+    return 0;
+}
+
+// Stores of variables the code never reads from memory: the accumulator
+// carried all their uses
+void dropStores() {
+    char op[16], opd[32], *p, *q, *eol, *o = out_buf;
+    int len;
+
+    read_name = realloc(read_name, (n_var + 0x10000)*sizeof(*read_name));
+    for (p = out_buf; *p != '\0'; p = eol + 1) {
+        eol = strchr(p, '\n');
+        if (sscanf(p, " %15s %31s", op, opd) == 2 && strcmp(op, "STA") != 0) {
+            q = (opd[0] == '(') ? opd + 1 : opd;
+            q[strcspn(q, ")")] = '\0';
+            if (!isRead(q)) strcpy(read_name[n_read++], q);
+        }
+    }
+    for (p = out_buf; *p != '\0'; p = eol + 1) {
+        eol = strchr(p, '\n');
+        len = (int)(eol - p) + 1;
+        if (!(sscanf(p, " %15s %31s", op, opd) == 2 && strcmp(op, "STA") == 0 && !isRead(opd))) {
+            memmove(o, p, len);
+            o += len;
+        }
+    }
+    *o = '\0';
+}
+
+void genAccCom() {
+    static int used[MAX_VARS];
+    char lab[24];
+    int fi, k, i, v, addr;
+    QUAD *p;
+
+    // code, main first: dry runs until the acc state at every label is known
+    for (k = -1; k < n_func; k++) {
+        fi = (k < 0) ? main_func : k;
+        if ((k >= 0 && fi == main_func) || !live(fi)) continue;
+        liveness(&func[fi]);
+        for (i = 0; i < n_label; i++) acc_lab[i] = ACC_TOP;
+        out_on = 0;
+        while (accFunc(&func[fi]) > 0);
+        out_on = 1;
+        accFunc(&func[fi]);
+    }
+
+    // data: A, B, variables, constants
+    for (fi = 0; fi < n_func; fi++)
+        for (i = 0; live(fi) && i < func[fi].n_q; i++) {
+            p = &func[fi].q[i];
+            if (p->op == Q_LABEL || p->op == Q_JMP || p->op == Q_CALL) continue;
+            if (IS_VAR(p->a)) used[p->a] = 1;
+            if (IS_VAR(p->b)) used[p->b] = 1;
+            if (p->d >= 0) used[p->d] = 1;
+        }
+    if (opt) dropStores();
+    printf("; AccCom code by minicc\n");
+    printf(".data %04X\n", DATA_ADDR);
+    for (i = 0; i < N_INPUTS; i++)
+        printf("in%c:    .word 0         ; input %c\n", 'A' + i, 'A' + i);
+    addr = DATA_ADDR + 2*N_INPUTS;
+    for (v = 0; v < n_var; v++) {
+        if (!used[v] || var[v].input || (opt && !isRead(varName(v)))) continue;
+        sprintf(lab, "%s:", varName(v));
+        printf("%-7s .word %d", lab, var[v].kind == V_GLOBAL ? var[v].init : 0);
+        if (var[v].kind == V_LOCAL) printf("%*s; %s in %s", 8, "", var[v].name, func[var[v].func].name);
+        printf("\n");
+        addr += 2;
+    }
+    for (i = -32768; i < 32768; i++)
+        if (const_used[i & 0xFFFF]) {
+            sprintf(lab, "%s:", conName(i));
+            printf("%-7s .word %d\n", lab, i);
+            addr += 2;
+        }
+    printf(".code %04X\n", addr > CODE_ADDR ? addr : CODE_ADDR);
+    fputs(out_buf, stdout);
+}
+
+//========================================
+// picoMIPS Code Generation
+// - compares are a subtraction masked by 0x8000 and beq
+// - constants the instruction cannot take as an immediate live in
+//   registers set once at the start
+// - locals, globals and temporaries get registers by priority coloring
+//   of the interference graph, the rest lives in DATA after A and B
+//========================================
+#define SCR1		7		// scratch registers when some variable is in memory
+#define SCR2		6
+
+int const_reg[0x10000];		// constant register variable of each value + 1
+
+// Constant register variable holding n, set at the start by lowerPico()
+int constVar(FUNC *f, int n) {
+    int v;
+
+    if (const_reg[n & 0xFFFF]) return const_reg[n & 0xFFFF] - 1;
+    v = newVar("", V_TEMP, (int)(f - func));
+    var[v].is_const = 1;
+    var[v].init = n;
+    const_reg[n & 0xFFFF] = v + 1;
+    return v;
+}
+
+// Operand in a register position: 0 is r0, other constants a constant register
+int regOpd(FUNC *f, int x) {
+    return (IS_CON(x) && CVAL(x) != 0) ? constVar(f, CVAL(x)) : x;
+}
+
+// picoMIPS forms of compares and modulo
+void lowerPico(FUNC *f) {
+    int i, v, s, m, neg, mask = NONE, first = n_var;
+    QUAD *p, q;
+
+    for (i = 0; i < f->n_q; i++) {
+        p = &f->q[i];
+        memset(&q, 0, sizeof(q));
+        if (p->op == Q_MOD) {	// d = a - a/b*b
+            q = *p;
+            q.op = Q_DIV;
+            q.d = newTemp();
+            insertQuad(f, i, &q);
+            q.op = Q_MUL;
+            q.a = q.d;
+            insertQuad(f, i + 1, &q);
+            p = &f->q[i + 2];
+            p->op = Q_SUB;
+            p->b = q.d;
+            i += 2;
+        }
+        else if (p->op == Q_BR && p->cc != CC_EQ && p->cc != CC_NE) {
+            // LT, GE: sign of a - b, GT, LE: sign of b - a
+            if (mask == NONE) mask = constVar(f, 0x8000);
+            neg = (p->cc == CC_LT || p->cc == CC_GT);
+            q.op = Q_SUB;
+            q.d = s = newTemp();
+            q.a = (p->cc == CC_LT || p->cc == CC_GE) ? p->a : p->b;
+            q.b = (p->cc == CC_LT || p->cc == CC_GE) ? p->b : p->a;
+            insertQuad(f, i++, &q);
+            q.op = Q_AND;
+            q.d = m = newTemp();
+            q.a = s;
+            q.b = mask;
+            insertQuad(f, i++, &q);
+            p = &f->q[i];
+            p->cc = CC_EQ;
+            p->a = m;
+            p->b = neg ? mask : CON(0);
+        }
+    }
+    for (i = 0; i < f->n_q; i++) {	// constants in register positions
+        p = &f->q[i];
+        if (p->op == Q_SUB) p->a = regOpd(f, p->a);
+        else if (p->op == Q_MUL || p->op == Q_DIV || p->op == Q_AND || p->op == Q_BR ||
+                 p->op == Q_PRT || p->op == Q_PRC) {
+            p->a = regOpd(f, p->a);
+            p->b = regOpd(f, p->b);
+        }
+    }
+    for (v = first; v < n_var; v++) {	// set them at the start
+        if (!var[v].is_const) continue;
+        memset(&q, 0, sizeof(q));
+        q.op = Q_MOV;
+        q.d = v;
+        q.a = CON(var[v].init);
+        q.b = NONE;
+        insertQuad(f, 0, &q);
+    }
+}
+
+// Register allocation with n_scr scratch registers kept out
+void picoAlloc(FUNC *f, int n_scr) {
+    static int order[MAX_VARS];
+    unsigned char *ig = calloc((size_t)n_var*n_var, 1);
+    int colors = N_REGS - 1 - n_scr, i, j, k, v, d, e, h, n = 0, used, r;
+    double w;
+    QUAD *p;
+
+    liveness(f);
+    findLabels(f);
+    for (v = 0; v < n_var; v++) {
+        var[v].reg = -1;
+        var[v].weight = 0;
+    }
+    for (i = 0; i < f->n_q; i++) {
+        p = &f->q[i];
+        if (p->op == Q_LABEL || p->op == Q_JMP || p->op == Q_CALL) continue;
+        for (w = 1, h = i; (h = loopOf(f, h, &e)) >= 0 && w < 1e12; w *= 8, h--);	// 8 per loop level
+        if (IS_VAR(p->a)) var[p->a].weight += w;
+        if (IS_VAR(p->b)) var[p->b].weight += w;
+        if ((d = quadDef(p)) >= 0) {
+            var[d].weight += w;
+            for (v = 0; v < n_var; v++)
+                if (v != d && BIT(&live_out[i*lw], v) && !(p->op == Q_MOV && p->a == v))
+                    ig[d*n_var + v] = ig[v*n_var + d] = 1;
+        }
+    }
+    for (v = 0; v < n_var; v++)	// live at the start: all at once
+        for (k = 0; k < n_var && BIT(live_in, v); k++)
+            if (k != v && BIT(live_in, k)) ig[v*n_var + k] = 1;
+
+    for (v = 0; v < n_var; v++)
+        if (var[v].weight > 0) order[n++] = v;
+    for (i = 1; i < n; i++)	// by weight
+        for (j = i; j > 0 && var[order[j]].weight > var[order[j - 1]].weight; j--)
+            v = order[j], order[j] = order[j - 1], order[j - 1] = v;
+    for (i = 0; i < n; i++) {
+        v = order[i];
+        for (used = k = 0; k < n_var; k++)
+            if (ig[v*n_var + k] && var[k].reg > 0) used |= 1 << var[k].reg;
+        r = 0;
+        for (j = 0; j < f->n_q && !r; j++) {	// share a register with a copy
+            p = &f->q[j];
+            if (p->op != Q_MOV || !IS_VAR(p->a)) continue;
+            k = (p->d == v) ? p->a : (p->a == v) ? p->d : NONE;
+            if (k >= 0 && var[k].reg > 0 && !(used >> var[k].reg & 1)) r = var[k].reg;
+        }
+        for (k = 1; k <= colors && !r; k++)
+            if (!(used >> k & 1)) r = k;
+        var[v].reg = r ? r : -1;
+    }
+    free(ig);
+}
+
+// 1: operand x needs a scratch register
+int picoScratch(int x) {
+    return IS_VAR(x) && var[x].reg < 0;
+}
+
+// Scratch registers the code needs with the current allocation
+int picoNeed(FUNC *f) {
+    int i, n, need = 0;
+    QUAD *p;
+
+    for (i = 0; i < f->n_q; i++) {
+        p = &f->q[i];
+        if (p->op == Q_LABEL || p->op == Q_JMP || p->op == Q_CALL) continue;
+        n = picoScratch(p->a) + (p->op != Q_MOV && picoScratch(p->b));
+        if (p->op == Q_MOV && var[p->d].is_const) n = 0;
+        else if (quadDef(p) >= 0 && var[p->d].reg < 0 && n == 0) n = 1;
+        if (n > need) need = n;
+    }
+    return need;
+}
+
+// r = n
+void picoLi(int r, int n) {
+    if (n >= 0 && n <= 63) out("        addi r%d, r0, %d\n", r, n);
+    else if (n < 0 && n >= -63) out("        subi r%d, r0, %d\n", r, -n);
+    else if ((n & 0x7F) == 0) out("        lui  r%d, %d\n", r, (n >> 7) & 0x1FF);
+    else out("        addi r%d, r0, %d\n", r, n);
+}
+
+// Register holding operand x, loaded to scratch s if needed
+int picoReg(int x, int s) {
+    if (IS_CON(x)) {
+        if (CVAL(x) == 0) return 0;
+        picoLi(s, CVAL(x));
+        return s;
+    }
+    if (var[x].reg >= 0) return var[x].reg;
+    if (var[x].is_const) picoLi(s, var[x].init);
+    else out("        lw   r%d, %d(r0)    ; %s\n", s, var[x].addr/2, varName(x));
+    return s;
+}
+
+// Store register r to variable d if d is in memory
+void picoStore(int d, int r) {
+    if (var[d].reg < 0) out("        sw   r%d, %d(r0)    ; %s\n", r, var[d].addr/2, varName(d));
+}
+
+// Jump from instruction i: j only goes backward
+void picoJump(int i, int lab) {
+    if (lab_at[lab] < i) out("        j    L%d\n", lab);
+    else out("        beq  r0, r0, L%d\n", lab);
+}
+
+void genPico() {
+    static char *name[] = { [Q_ADD] = "add ", [Q_SUB] = "sub ", [Q_MUL] = "mul ", [Q_DIV] = "div ", [Q_AND] = "and " };
+    FUNC *f = &func[main_func];
+    int n_scr = 0, i, v, ra, rb, rd, n, addr, local = 0;
+    QUAD *p;
+
+    lowerPico(f);
+    if (opt) while (cleanCfg(f) + deadCode(f) > 0);
+    for (;;) {
+        picoAlloc(f, n_scr);
+        if ((n = picoNeed(f)) <= n_scr) break;
+        n_scr = n;
+    }
+    addr = DATA_ADDR + 2*N_INPUTS;
+    for (v = 0; v < n_var; v++) {
+        if (var[v].input) var[v].addr = DATA_ADDR + 2*(var[v].input - 1);
+        else if (var[v].reg < 0 && var[v].weight > 0 && !var[v].is_const) {
+            var[v].addr = addr;
+            addr += 2;
+        }
+    }
+
+    printf("; picoMIPS code by minicc\n;");
+    for (v = 0; v < n_var; v++)	// registers of named variables and constants
+        if (var[v].reg > 0 && var[v].weight > 0 && (var[v].is_const || var[v].kind != V_TEMP))
+            printf(" r%d %s", var[v].reg, var[v].is_const ? conName(var[v].init) :
+                   var[v].input ? varName(v) : var[v].name);
+    printf("\n.data 0x%04X\n", DATA_ADDR);
+    for (i = 0; i < N_INPUTS; i++) printf("        .word 0         ; input %c\n", 'A' + i);
+    for (v = 0; v < n_var; v++)
+        if (var[v].reg < 0 && var[v].weight > 0 && !var[v].is_const && !var[v].input)
+            printf("        .word %d        ; %s\n", var[v].kind == V_GLOBAL ? var[v].init : 0,
+                   var[v].name[0] ? var[v].name : varName(v));
+    printf(".code 0x%04X\nmain:\n", addr > CODE_ADDR ? addr : CODE_ADDR);
+
+    liveness(f);
+    findLabels(f);
+    for (v = 0; v < n_var; v++)	// registers read before written: inputs, initial values
+        if (BIT(live_in, v) && var[v].reg > 0) {
+            if (var[v].input) out("        lw   r%d, %d(r0)    ; %s\n", var[v].reg, var[v].addr/2, varName(v));
+            else if (var[v].kind == V_GLOBAL && var[v].init != 0) picoLi(var[v].reg, var[v].init);
+        }
+    for (i = 0; i < f->n_q; i++) {
+        p = &f->q[i];
+        rd = (quadDef(p) >= 0 && var[p->d].reg >= 0) ? var[p->d].reg : SCR1;
+        switch (p->op) {
+        case Q_LABEL:
+            out("L%d:\n", p->lab);
+            break;
+        case Q_MOV:
+            if (var[p->d].is_const && var[p->d].reg < 0) break;
+            if (IS_CON(p->a)) picoLi(rd, CVAL(p->a));
+            else if ((ra = picoReg(p->a, rd)) != rd) out("        add  r%d, r%d, r0\n", rd, ra);
+            picoStore(p->d, rd);
+            break;
+        case Q_ADD: case Q_SUB: case Q_MUL: case Q_DIV: case Q_AND:
+            ra = picoReg(p->a, SCR1);
+            if ((p->op == Q_ADD || p->op == Q_SUB) && IS_CON(p->b)) {
+                n = (p->op == Q_ADD) ? CVAL(p->b) : -CVAL(p->b);
+                out("        %s r%d, r%d, %d\n", n >= 0 ? "addi" : "subi", rd, ra, n >= 0 ? n : -n);
+            }
+            else {
+                rb = picoReg(p->b, ra == SCR1 ? SCR2 : SCR1);
+                out("        %s r%d, r%d, r%d\n", name[p->op], rd, ra, rb);
+            }
+            picoStore(p->d, rd);
+            break;
+        case Q_BR:
+            ra = picoReg(p->a, SCR1);
+            rb = picoReg(p->b, ra == SCR1 ? SCR2 : SCR1);
+            if (p->cc == CC_EQ) out("        beq  r%d, r%d, L%d\n", ra, rb, p->lab);
+            else {
+                out("        beq  r%d, r%d, l%d\n", ra, rb, local);
+                picoJump(i, p->lab);
+                out("l%d:\n", local++);
+            }
+            break;
+        case Q_JMP:
+            picoJump(i, p->lab);
+            break;
+        case Q_PRT:
+        case Q_PRC:
+            out("        %s  r%d\n", p->op == Q_PRT ? "prt" : "prc", picoReg(p->a, SCR1));
+            break;
+        case Q_RET:
+        case Q_HALT:
+            out("        halt\n");
+            break;
+        }
+    }
+    fputs(out_buf, stdout);
+}
+
+//========================================
+// Main
+//========================================
+int main(int argc, char *argv[]) {
+    size_t n = 0, size = 0x10000;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-pico") == 0) pico = 1;
+        else if (strcmp(argv[i], "-O0") == 0) opt = 0;
+        else {
+            fprintf(stderr, "usage: minicc [-pico] [-O0] < source.c > program.s\n");
+            return 1;
+        }
+    }
+    src = malloc(size);
+    while ((i = getchar()) != EOF) {
+        if (n == size - 1) src = realloc(src, size *= 2);
+        src[n++] = (char)i;
+    }
+    src[n] = '\0';
+    src_p = src;
+
+    parseProgram();
+    genProgram();
+    inlineCalls();
+    if (opt) optimize();
+    else for (i = 0; i < n_func; i++) if (live(i)) cleanCfg(&func[i]);
+    if (pico) genPico();
+    else genAccCom();
+    return 0;
+}
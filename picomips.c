@@ -19,13 +19,187 @@
 typedef unsigned char  UCHAR;
 typedef unsigned int   UINT;
 typedef unsigned short WORD;
+typedef unsigned long long UINT64;
 
 #define MEM_SIZE	0x00010000	// memory size
 #define REG_SIZE	8		// register size
 #define END_OF_ARG	0xFFFF		// end of argument
 
+#ifndef TRACE
+#define TRACE		1		// 1: print pc and registers after each instruction
+#endif
+#ifndef WORKLOAD
+#define WORKLOAD	0		// 0: Y = A*A + B*B, 1: same with lui,
+#endif							// 2: array sum, 3: array sum with lwp and loop, 4: array sum with vectors,
+								// 5: dot product with lwp and loop, 6: dot product with vectors,
+								// 7: array sum in 4 threads, 8: same with shared partial sums and fadd
+#ifndef ASM_FILE
+#define ASM_FILE	""		// assembler source to load instead of WORKLOAD (e.g. written by minicc)
+#endif
+#define ASM_SYMS	1024		// # of assembler labels
+#define ASM_SIZE	0x20000	// max bytes of ASM_FILE
+#ifndef THREADS
+#define THREADS		1		// # of hardware thread contexts, > 1: barrel mode
+#endif
+#ifndef TIMING
+#define TIMING		0		// 1: count cycles, a load keeps its thread from issuing
+#endif
+#ifndef MEM_LATENCY
+#define MEM_LATENCY	4		// cycles a load adds before its thread issues again (TIMING)
+#endif
+#ifndef OOO
+#define OOO			0		// 1: out-of-order superscalar timing model (one thread)
+#endif
+#ifndef OOO_WIDTH
+#define OOO_WIDTH	2		// instructions dispatched and committed per cycle (OOO)
+#endif
+#ifndef ROB_SIZE
+#define ROB_SIZE	32		// reorder buffer entries (OOO)
+#endif
+#ifndef RS_SIZE
+#define RS_SIZE		4		// reservation station entries per functional unit (OOO)
+#endif
+#ifndef LSQ_SIZE
+#define LSQ_SIZE	8		// load/store queue entries (OOO)
+#endif
+#define LAT_MUL		3		// mul latency, pipelined (OOO)
+#define LAT_DIV		12		// div latency, not pipelined (OOO)
+#define BR_PENALTY	3		// cycles lost on a mispredicted beq (OOO)
+#ifndef MMU
+#define MMU			0		// 1: translate addresses by a page table in guest memory and a TLB
+#endif
+#ifndef MMU_PAGE_BITS
+#define MMU_PAGE_BITS	8	// page size = 1 << MMU_PAGE_BITS bytes, 6 ~ 12 (MMU)
+#endif
+#ifndef TLB_SETS
+#define TLB_SETS	4		// TLB sets (MMU)
+#endif
+#ifndef TLB_WAYS
+#define TLB_WAYS	2		// TLB ways, LRU replacement (MMU)
+#endif
+#define PT_BASE		0xF000	// page tables; virtual addresses from here are not mapped (MMU)
+#ifndef CORES
+#define CORES		1		// # of cores, > 1: one host thread and a MESI L1 per core (-pthread)
+#endif
+#ifndef QUANTUM
+#define QUANTUM		1000	// instructions a core runs between lockstep barriers
+#endif
+#define L1_LINES	64		// lines of each L1 (direct mapped)
+#define LINE_SIZE	16		// bytes of an L1 line
+#if CORES > 1
+#undef THREADS
+#define THREADS		CORES	// one thread context per core
+#undef TRACE
+#define TRACE		0		// traces of concurrent cores would interleave
+#endif
+#ifndef JOBS
+#define JOBS		1		// # of times to load and run the program
+#endif
+#ifndef RUN_STATS
+#define RUN_STATS	0		// 1: print [RUN] and the TIMING, MESI, OOO and MMU statistics at exit
+#endif
+
+#ifndef USE_DIRTY_PAGES
+#define USE_DIRTY_PAGES	1	// 1: reset only memory pages written since last reset
+#endif
+#define PAGE_SIZE	0x0100		// page size for dirty tracking
+#define N_PAGES		(MEM_SIZE/PAGE_SIZE)
+
+#ifndef WORD_MEM
+#define WORD_MEM	0		// 1: memory holds native 16-bit words, byte order fixed at the edges
+#endif
+#if WORD_MEM && !(defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define BYTE_SWAP	1		// guest byte at addr is host byte at addr ^ 1
+#else
+#define BYTE_SWAP	0
+#endif
+
+#ifndef USE_GUARD_PAGES
+#if defined(__unix__) || defined(__APPLE__)
+#define USE_GUARD_PAGES	1	// 1: memory between PROT_NONE pages, overrun is a guest fault
+#else
+#define USE_GUARD_PAGES	0
+#endif
+#endif
+
+#ifndef USE_SIMD
+#if defined(__SSE2__)
+#define USE_SIMD	1		// 1: vector instructions use host SSE2 intrinsics
+#else
+#define USE_SIMD	0
+#endif
+#endif
+
+#if OOO && (THREADS > 1 || CORES > 1)
+#error "OOO models one thread"
+#endif
+#if MMU && (CORES > 1 || MMU_PAGE_BITS < 6 || MMU_PAGE_BITS > 12)
+#error "MMU needs CORES == 1 and MMU_PAGE_BITS 6 ~ 12"
+#endif
+#if WORKLOAD >= 7 && THREADS < 4
+#error "WORKLOAD 7, 8 need THREADS >= 4 or CORES >= 4"
+#endif
+
+#if USE_SIMD
+#include <emmintrin.h>
+#endif
+#if USE_GUARD_PAGES
+#include <sys/mman.h>
+#include <unistd.h>
+#include <signal.h>
+#include <setjmp.h>
+#endif
+#if MMU && !USE_GUARD_PAGES
+#include <setjmp.h>
+#endif
+#if CORES > 1
+#include <pthread.h>
+#define CORE_LOCAL	__thread	// state of the core running on this host thread
+#define MEM_LOAD(p)		__atomic_load_n(p, __ATOMIC_RELAXED)	// mem[] is shared by the core threads
+#define MEM_STORE(p, x)	__atomic_store_n(p, x, __ATOMIC_RELAXED)
+#else
+#define CORE_LOCAL
+#define MEM_LOAD(p)		(*(p))
+#define MEM_STORE(p, x)	(*(p) = (x))
+#endif
+#define SIMD_MEM	(USE_SIMD && CORES == 1)	// vlwp/vswp move 8 bytes by SSE2, cores go word by word
+
+#if USE_GUARD_PAGES
+UCHAR *mem;						// memory image (between guard pages)
+UCHAR *mem_map;					// mapped area including guard pages
+size_t mem_map_size;			// size of mem_map
+CORE_LOCAL sigjmp_buf fault_jmp;	// where runProgram() handles a memory fault
+CORE_LOCAL volatile sig_atomic_t fault_armed = 0;	// 1: in runProgram()
+CORE_LOCAL long fault_addr;		// guest address of the fault
+#elif WORD_MEM
+WORD mem_buf[MEM_SIZE/2 + 1];	// memory image (word aligned)
+UCHAR *mem = (UCHAR *)mem_buf;
+#else
 UCHAR mem[MEM_SIZE];			// memory image
-WORD reg[REG_SIZE] = { 0, };	// register file
+#endif
+
+// Hardware thread context: contexts share mem[], each has its own pc and registers
+typedef struct CONTEXT {
+    UINT pc;					// pc while another context runs
+    WORD reg[REG_SIZE];			// register file
+    UINT64 vreg[REG_SIZE];		// vector registers
+    UINT loop_start;			// first word of loop body
+    UINT loop_end;				// word after loop body
+    UINT loop_cnt;				// iterations left including current one
+    int state;					// CTX_FREE, CTX_RUN, CTX_JOIN
+    UINT join;					// tid waited for in CTX_JOIN
+    UINT64 ready;				// first cycle it can issue (TIMING)
+    struct CONTEXT *next;		// next running context
+} CONTEXT;
+CONTEXT ctx[THREADS];			// thread contexts, index = tid
+CORE_LOCAL CONTEXT *cur = &ctx[0];		// running context
+CORE_LOCAL WORD *reg = ctx[0].reg;		// register file of running context
+CORE_LOCAL UINT64 *vreg = ctx[0].vreg;	// vector registers of running context
+
+#if USE_DIRTY_PAGES
+UCHAR mem_dirty[N_PAGES + 1];	// 1: page written since last reset
+int mem_clean = 0;				// 1: mem[] is all zero except dirty pages
+#endif
 
 UINT data_bgn;			// begin address of DATA section
 UINT data_end;			// end address of DATA section
@@ -37,15 +211,104 @@ UINT code_end;			// end address of CODE section
 // for loadProgram(), inputData()
 //========================================
 
+#if WORD_MEM
+// Read a word data at odd address (two host words)
+WORD readWordOdd(UINT addr) {
+    return (WORD)((MEM_LOAD(&mem[addr ^ BYTE_SWAP]) << 8) | MEM_LOAD(&mem[(addr + 1) ^ BYTE_SWAP]));
+}
+
+// Write a word data at odd address (two host words)
+void writeWordOdd(UINT addr, WORD data) {
+    MEM_STORE(&mem[ addr	   ^ BYTE_SWAP], (UCHAR)((data & 0xFF00) >> 8));
+    MEM_STORE(&mem[(addr + 1) ^ BYTE_SWAP], (UCHAR) (data & 0x00FF));
+}
+#endif
+
 // Read a word data from memory
 WORD readWord(UINT addr) {
-    return (WORD)((mem[addr] << 8) | mem[addr + 1]);
+#if WORD_MEM
+    if (addr & 1) return readWordOdd(addr);
+    return MEM_LOAD((WORD *)&mem[addr]);
+#else
+    return (WORD)((MEM_LOAD(&mem[addr]) << 8) | MEM_LOAD(&mem[addr + 1]));
+#endif
 }
 
 // Write a word data to memory
 void writeWord(UINT addr, WORD data) {
-    mem[addr	] = (UCHAR)((data & 0xFF00) >> 8);
-    mem[addr + 1] = (UCHAR) (data & 0x00FF);
+#if WORD_MEM
+    if (addr & 1) writeWordOdd(addr, data);
+    else MEM_STORE((WORD *)&mem[addr], data);
+#else
+    MEM_STORE(&mem[addr], (UCHAR)((data & 0xFF00) >> 8));
+    MEM_STORE(&mem[addr + 1], (UCHAR) (data & 0x00FF));
+#endif
+#if USE_DIRTY_PAGES
+    MEM_STORE(&mem_dirty[ addr		/PAGE_SIZE], 1);
+    MEM_STORE(&mem_dirty[(addr + 1)/PAGE_SIZE], 1);
+#endif
+}
+
+#if USE_GUARD_PAGES
+// SIGSEGV/SIGBUS handler
+// - access to a guard page: back to runProgram() as a guest fault
+void memFault(int sig, siginfo_t *si, void *ctx) {
+    UCHAR *p = (UCHAR *)si->si_addr;
+
+    (void)ctx;
+    if (fault_armed && p >= mem_map && p < mem_map + mem_map_size) {
+        fault_armed = 0;
+        fault_addr = (long)(p - mem) ^ BYTE_SWAP;
+        siglongjmp(fault_jmp, 1);
+    }
+    signal(sig, SIG_DFL);	// host bug: crash as usual
+}
+
+// Allocate memory between two PROT_NONE guard pages
+// - pc and lw/sw addresses are kept in 16 bits, so a word at 0xFFFF
+//   overruns into the guard page before any host memory
+void initMemory() {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = (MEM_SIZE + page - 1)/page*page;
+    struct sigaction sa;
+
+    mem_map_size = size + 2*page;
+    mem_map = (UCHAR *)mmap(NULL, mem_map_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem_map == MAP_FAILED || mprotect(mem_map + page, size, PROT_READ | PROT_WRITE) != 0) {
+        printf("Error: Memory allocation");
+        exit(-1);
+    }
+    mem = mem_map + page;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = memFault;
+    sa.sa_flags = SA_SIGINFO;
+    sigaction(SIGSEGV, &sa, NULL);
+    sigaction(SIGBUS, &sa, NULL);
+}
+#endif
+
+// Reset whole memory to zero
+// - with dirty tracking only pages written since last reset are cleared
+void resetMemory() {
+#if USE_DIRTY_PAGES
+    int i;
+
+    if (!mem_clean) {
+        memset(mem, 0, MEM_SIZE);
+        memset(mem_dirty, 0, sizeof(mem_dirty));
+        mem_clean = 1;
+        return;
+    }
+    for (i = 0; i < N_PAGES; i++) {
+        if (mem_dirty[i]) {
+            memset(&mem[i*PAGE_SIZE], 0, PAGE_SIZE);
+            mem_dirty[i] = 0;
+        }
+    }
+#else
+    memset(mem, 0, MEM_SIZE);
+#endif
 }
 
 // Write variable # of words data to memory
@@ -82,9 +345,13 @@ void printMemory(char *name, UINT addr1, UINT addr2) {
 
 // Print registers
 void printRegisters() {
-    static WORD old_reg[REG_SIZE] = { 0, };	// previous register image
+    static WORD old_regs[THREADS][REG_SIZE];	// previous register image of each thread
+    WORD *old_reg = old_regs[cur - ctx];
     int i, j;
 
+#if THREADS > 1
+    printf("\tthread %d\n", (int)(cur - ctx));
+#endif
     for (i = 0; i < 4; i++) {
         printf("\tr%d: %04X (%d)", i, old_reg[i], (short)old_reg[i]);
         if (reg[i] == old_reg[i])
@@ -104,13 +371,284 @@ void printRegisters() {
     }
 }
 
+//========================================
+// Assembler
+// - one instruction or directive per line, ';' starts a comment
+// - registers r0 ~ r7, numbers in decimal or 0x hex, labels
+// - .data addr / .code addr: start of DATA / CODE section
+// - .word n, ...: 16-bit words
+// - an immediate out of 0 ~ 63 gets an ext prefix; pass 1 repeats until
+//   label addresses settle, so a far forward beq/loop gets one too
+//========================================
+typedef struct {
+    char *name;		// mnemonic
+    UINT code;		// op and fn bits
+    int fmt;		// 'R', 'V' (vd, vs, vt), 'S' (vsum), 'T' (vsplat), 'I' (rt, imm(rs)),
+                    // 'W' (vt, imm(rs)), 'A' (rt, rs, imm), 'B' (beq), 'L' (loop),
+                    // 'J', 'U' (lui), 'X' (ext), 'N' (no operand),
+                    // 'P' (spawn rt, rs), 'Q' (join rs, prt rs, prc rs), 'H' (tid rt), 'K' (tas rd, rs)
+} ASM_OP;
+
+ASM_OP asm_op[] = {
+    {"and",  0x0000, 'R'}, {"or",   0x0001, 'R'}, {"add",  0x0002, 'R'},
+    {"sub",  0x0003, 'R'}, {"mul",  0x0004, 'R'}, {"div",  0x0005, 'R'},
+    {"addi", 0xA000, 'A'}, {"subi", 0xB000, 'A'},
+    {"lw",   0x4000, 'I'}, {"sw",   0x5000, 'I'}, {"lwp",  0x6000, 'I'}, {"swp",  0x7000, 'I'},
+    {"beq",  0x1000, 'B'}, {"loop", 0x9000, 'L'}, {"j",    0x3000, 'J'},
+    {"lui",  0x2000, 'U'}, {"ext",  0x8000, 'X'}, {"halt", 0xF000, 'N'},
+    {"vadd", 0xC000, 'V'}, {"vsub", 0xC001, 'V'}, {"vmul", 0xC002, 'V'}, {"vcmp", 0xC003, 'V'},
+    {"vaddb", 0xC004, 'R'}, {"vsubb", 0xC005, 'R'}, {"vmulb", 0xC006, 'R'}, {"vcmpb", 0xC007, 'R'},
+    {"vsum", 0x0006, 'S'}, {"vsplat", 0x0007, 'T'}, {"vlwp", 0xD000, 'W'}, {"vswp", 0xE000, 'W'},
+    {"spawn", 0xF001, 'P'}, {"join", 0xF002, 'Q'}, {"tid",  0xF003, 'H'},
+    {"tas",  0xF004, 'K'}, {"fadd", 0xF005, 'R'}, {"prt",  0xF006, 'Q'}, {"prc",  0xF007, 'Q'},
+    {NULL, 0, 0}
+};
+
+typedef struct {
+    char name[16];
+    UINT addr;
+    int line;		// source line of definition
+} ASM_SYM;
+
+ASM_SYM asm_sym[ASM_SYMS];	// labels
+int asm_n_sym = 0;			// # of labels
+
+// Find a label
+// - return index, or -1 if not defined
+int asmSymbol(const char *name) {
+    int i;
+
+    for (i = 0; i < asm_n_sym; i++)
+        if (strcmp(asm_sym[i].name, name) == 0) return i;
+    return -1;
+}
+
+// Get a register operand
+// - kind: 'r' general, 'v' vector
+UINT asmReg(const char *tok, int kind, int line) {
+    if (tok == NULL || tok[0] != kind || tok[1] < '0' || tok[1] > '7' || tok[2] != '\0') {
+        printf("Error: line %d: %c register expected\n", line, kind);
+        exit(-1);
+    }
+    return (UINT)(tok[1] - '0');
+}
+
+// Get a number or label operand
+// - *known: 0 if it is a label not defined before this line (pass 1 size)
+int asmValue(const char *tok, int pass, int line, int *known) {
+    char *end;
+    long n;
+    int i;
+
+    *known = 1;
+    if (tok == NULL) {
+        printf("Error: line %d: operand missing\n", line);
+        exit(-1);
+    }
+    n = strtol(tok, &end, 0);
+    if (*end == '\0') return (int)n;
+    i = asmSymbol(tok);
+    if (i >= 0 && asm_sym[i].line <= line) return (int)asm_sym[i].addr;
+    *known = 0;
+    if (i >= 0) return (int)asm_sym[i].addr;
+    if (pass == 2) {
+        printf("Error: line %d: undefined label %s\n", line, tok);
+        exit(-1);
+    }
+    return 0;
+}
+
+// Emit an I-format word, with ext prefix if imm needs more than 6 bits
+// - return next address
+UINT asmImm(UINT addr, UINT code, int imm, int ext, int pass) {
+    if (ext) {
+        if (pass == 2) writeWord(addr, (WORD)(0x8000 | ((imm >> 6) & 0x0FFF)));
+        addr += 2;
+    }
+    if (pass == 2) writeWord(addr, (WORD)(code | (imm & 0x003F)));
+    return addr + 2;
+}
+
+// Assemble source to memory, set DATA and CODE section addresses
+void assemble(const char *src) {
+    char buf[128];
+    char *tok, *p;
+    const char *s;
+    const char *sep = " \t\r,()";
+    UINT addr = 0, code;
+    int pass, line, i, n, known, rs, rt, rd, f, ext, moved = 0, rounds = 0;
+
+    asm_n_sym = 0;
+    for (pass = 1; pass <= 2; pass++) {
+        if (pass == 2 && moved && ++rounds < 64) pass = 1;	// ext prefixes moved labels: size again
+        addr = 0;
+        line = 0;
+        moved = 0;
+        for (s = src; *s != '\0'; ) {
+            // next line without comment
+            for (i = 0; *s != '\0' && *s != '\n'; s++)
+                if (i < (int)sizeof(buf) - 1) buf[i++] = *s;
+            if (*s == '\n') s++;
+            buf[i] = '\0';
+            line++;
+            if ((p = strchr(buf, ';')) != NULL) *p = '\0';
+
+            tok = strtok(buf, sep);
+            if (tok == NULL) continue;
+            if (tok[strlen(tok) - 1] == ':') {
+                tok[strlen(tok) - 1] = '\0';
+                if (pass == 1 && (i = asmSymbol(tok)) >= 0 && asm_sym[i].line == line) {
+                    moved |= (asm_sym[i].addr != addr);
+                    asm_sym[i].addr = addr;
+                }
+                else if (pass == 1 && i < 0) {
+                    if (asm_n_sym == ASM_SYMS || strlen(tok) >= sizeof(asm_sym[0].name)) {
+                        printf("Error: line %d: too many labels\n", line);
+                        exit(-1);
+                    }
+                    strcpy(asm_sym[asm_n_sym].name, tok);
+                    asm_sym[asm_n_sym].line = line;
+                    asm_sym[asm_n_sym++].addr = addr;
+                    moved = 1;
+                }
+                if ((tok = strtok(NULL, sep)) == NULL) continue;
+            }
+
+            if (strcmp(tok, ".data") == 0) {
+                data_bgn = addr = (UINT)asmValue(strtok(NULL, sep), pass, line, &known);
+                continue;
+            }
+            if (strcmp(tok, ".code") == 0) {
+                data_end = addr;
+                code_bgn = addr = (UINT)asmValue(strtok(NULL, sep), pass, line, &known);
+                continue;
+            }
+            if (strcmp(tok, ".word") == 0) {
+                while ((tok = strtok(NULL, sep)) != NULL) {
+                    n = asmValue(tok, pass, line, &known);
+                    if (pass == 2) writeWord(addr, (WORD)n);
+                    addr += 2;
+                }
+                continue;
+            }
+
+            for (i = 0; asm_op[i].name != NULL && strcmp(asm_op[i].name, tok) != 0; i++);
+            if (asm_op[i].name == NULL) {
+                printf("Error: line %d: unknown instruction %s\n", line, tok);
+                exit(-1);
+            }
+            code = asm_op[i].code;
+            switch (asm_op[i].fmt) {
+            case 'R':	// rd, rs, rt
+            case 'V':
+            case 'S':
+            case 'T':
+            case 'K':
+                f = asm_op[i].fmt;
+                rd = asmReg(strtok(NULL, sep), (f == 'V' || f == 'T') ? 'v' : 'r', line);
+                rs = asmReg(strtok(NULL, sep), (f == 'V' || f == 'S') ? 'v' : 'r', line);
+                rt = (f == 'R' || f == 'V') ? asmReg(strtok(NULL, sep), f == 'V' ? 'v' : 'r', line) : 0;
+                if (pass == 2) writeWord(addr, (WORD)(code | rs << 9 | rt << 6 | rd << 3));
+                addr += 2;
+                break;
+            case 'A':	// rt, rs, imm
+                rt = asmReg(strtok(NULL, sep), 'r', line);
+                rs = asmReg(strtok(NULL, sep), 'r', line);
+                n = asmValue(strtok(NULL, sep), pass, line, &known);
+                addr = asmImm(addr, code | rs << 9 | rt << 6, n, !known || n < 0 || n > 63, pass);
+                break;
+            case 'I':	// rt, imm(rs)
+            case 'W':
+                rt = asmReg(strtok(NULL, sep), asm_op[i].fmt == 'W' ? 'v' : 'r', line);
+                n = asmValue(strtok(NULL, sep), pass, line, &known);
+                rs = asmReg(strtok(NULL, sep), 'r', line);
+                addr = asmImm(addr, code | rs << 9 | rt << 6, n, !known || n < 0 || n > 63, pass);
+                break;
+            case 'B':	// rs, rt, label: offset in words from next instruction
+            case 'L':	// rs, end label: body length in words
+                rs = asmReg(strtok(NULL, sep), 'r', line);
+                rt = (asm_op[i].fmt == 'B') ? asmReg(strtok(NULL, sep), 'r', line) : 0;
+                tok = strtok(NULL, sep);
+                n = asmValue(tok, pass, line, &known);
+                // ext when needed; a forward label not seen yet is assumed near
+                ext = (known || asmSymbol(tok) >= 0) && ((n - (int)addr - 2)/2 < 0 || (n - (int)addr - 2)/2 > 63);
+                addr = asmImm(addr, code | rs << 9 | rt << 6, (n - (int)addr - 2 - 2*ext)/2, ext, pass);
+                break;
+            case 'J':	// label, backward only
+                n = asmValue(strtok(NULL, sep), pass, line, &known);
+                n = (n - (int)addr - 2)/2;
+                if (pass == 2 && (n >= 0 || n < -4096)) {
+                    printf("Error: line %d: j must go backward\n", line);
+                    exit(-1);
+                }
+                if (pass == 2) writeWord(addr, (WORD)(code | (n & 0x0FFF)));
+                addr += 2;
+                break;
+            case 'U':	// rt, imm9
+                rt = asmReg(strtok(NULL, sep), 'r', line);
+                n = asmValue(strtok(NULL, sep), pass, line, &known);
+                if (pass == 2) writeWord(addr, (WORD)(code | rt << 9 | (n & 0x01FF)));
+                addr += 2;
+                break;
+            case 'P':	// rt, rs
+            case 'Q':	// rs
+            case 'H':	// rt
+                f = asm_op[i].fmt;
+                rt = (f != 'Q') ? asmReg(strtok(NULL, sep), 'r', line) : 0;
+                rs = (f != 'H') ? asmReg(strtok(NULL, sep), 'r', line) : 0;
+                if (pass == 2) writeWord(addr, (WORD)(code | rs << 9 | rt << 6));
+                addr += 2;
+                break;
+            case 'X':	// imm12
+                n = asmValue(strtok(NULL, sep), pass, line, &known);
+                if (pass == 2) writeWord(addr, (WORD)(code | (n & 0x0FFF)));
+                addr += 2;
+                break;
+            default:
+                if (pass == 2) writeWord(addr, (WORD)code);
+                addr += 2;
+            }
+        }
+    }
+    code_end = addr;
+}
+
 //========================================
 // Load AccCom program to memory
 // - return start address of program
 //========================================
 UINT loadProgram() {
     // reset whole memory
-    memset(mem, 0, MEM_SIZE);
+    resetMemory();
+
+    // program from ASM_FILE, inputs A and B at 0100 and 0102, start at label main
+    if (ASM_FILE[0] != '\0') {
+        static char src[ASM_SIZE];
+        FILE *f = fopen(ASM_FILE, "r");
+        size_t n;
+        int i, x;
+
+        if (f == NULL) {
+            printf("Error: cannot open %s\n", ASM_FILE);
+            exit(-1);
+        }
+        n = fread(src, 1, sizeof(src) - 1, f);
+        fclose(f);
+        src[n] = '\0';
+        assemble(src);
+        for (i = 0; i < 2; i++) {
+            printf("%04X: %c = ", 0x0100 + 2*i, 'A' + i);
+            if (scanf("%d", &x) == 1) writeWord(0x0100 + 2*i, (WORD)x);
+        }
+        printf("\n");
+        printMemory("DATA", data_bgn, data_end);
+        printMemory("CODE", code_bgn, code_end);
+        if ((i = asmSymbol("main")) < 0) {
+            printf("Error: %s has no label main\n", ASM_FILE);
+            exit(-1);
+        }
+        return asm_sym[i].addr;
+    }
 
     /*
         Y = A*A + B*B
@@ -125,6 +663,9 @@ UINT loadProgram() {
             1010 000 000 010000			=> 1010 0000 0001 0000 => A010
         mul	r0, r0, r0		// r0 = r0*r0 = 0x0100
             0000 000 000 000 100		=> 0000 0010 0000 0100 => 0004
+        (WORKLOAD 1: the three instructions above are one lui)
+        lui	r0, 0x002		// r0 = 0x002 << 7 = 0x0100
+            0010 000 000000010			=> 0010 0000 0000 0010 => 2002
         lw	r1, 0(r0)		// r1 = A (0x0100 + 0*2 = 0x0100)
             0100 000 001 000000 (100h)	=> 0100 0000 0100 0000 => 4040
         lw	r2,	1(r0)		// r2 = B (0x0100 + 1*2 = 0x0102)
@@ -141,6 +682,119 @@ UINT loadProgram() {
             1111 0000 0000 0000								   => F000
     */
 
+#if WORKLOAD >= 2
+    /*
+        S = sum of A[0] ~ A[31]		(WORKLOAD 2 ~ 4)
+        S = A[0]*A[0] + ... + A[31]*A[31]	(WORKLOAD 5, 6)
+        S = sum of A[0] ~ A[31] in 4 threads	(WORKLOAD 7, 8)
+
+        0100: A[32]
+        0140: S		(WORKLOAD 7, 8: 0140: P[4], 0148: S)
+    */
+    assemble(
+        ".data 0x0100\n"
+        "a:     .word 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16\n"
+        "       .word 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32\n"
+#if WORKLOAD >= 7
+        "p:     .word 0, 0, 0, 0    ; partial sums of the threads\n"
+        "s:     .word 0\n"
+        ".code 0x0200\n"
+        "       addi r1, r0, work   ; r1 = entry of threads 1 ~ 3\n"
+        "       spawn r2, r1\n"
+        "       spawn r2, r1\n"
+        "       spawn r2, r1\n"
+        "work:  tid  r5             ; r5 = tid, thread sums A[8*tid] ~ A[8*tid+7]\n"
+        "       add  r6, r5, r5\n"
+        "       add  r6, r6, r6\n"
+        "       add  r6, r6, r6\n"
+        "       add  r6, r6, r6     ; r6 = 16*tid\n"
+        "       lui  r1, 2\n"
+        "       add  r1, r1, r6     ; r1 = &A[8*tid]\n"
+        "       addi r2, r0, 8\n"
+#if WORKLOAD == 7
+        "       sub  r3, r3, r3\n"
+        "       loop r2, put\n"
+        "       lwp  r4, 0(r1)\n"
+        "       add  r3, r3, r4\n"
+        "put:   add  r6, r5, r5\n"
+        "       addi r6, r6, p\n"
+        "       sw   r3, 0(r6)      ; P[tid] = r3\n"
+#else
+        "       add  r6, r5, r5\n"
+        "       addi r6, r6, p      ; r6 = &P[tid]\n"
+        "       loop r2, put\n"
+        "       lwp  r4, 0(r1)\n"
+        "       lw   r3, 0(r6)\n"
+        "       add  r3, r3, r4\n"
+        "       sw   r3, 0(r6)      ; P[tid] += A[i]: all P[] in one L1 line\n"
+        "put:   addi r7, r0, s\n"
+        "       fadd r4, r7, r3     ; S += P[tid]\n"
+#endif
+        "       beq  r5, r0, gather\n"
+        "       halt                ; threads 1 ~ 3 end here\n"
+        "gather: addi r2, r0, 1\n"
+        "       join r2             ; wait for threads 1 ~ 3\n"
+        "       addi r2, r0, 2\n"
+        "       join r2\n"
+        "       addi r2, r0, 3\n"
+        "       join r2\n"
+#if WORKLOAD == 7
+        "       addi r1, r0, p\n"
+        "       addi r2, r0, 4\n"
+        "       sub  r3, r3, r3\n"
+        "       loop r2, done\n"
+        "       lwp  r4, 0(r1)\n"
+        "       add  r3, r3, r4\n"
+        "done:  sw   r3, 0(r1)      ; r1 = &S\n"
+#endif
+#else
+        "s:     .word 0\n"
+        ".code 0x0200\n"
+        "       lui  r1, 2          ; r1 = &A[0]\n"
+        "       addi r2, r0, 32     ; r2 = # of words\n"
+#if WORKLOAD == 2
+        "next:  beq  r2, r0, done\n"
+        "       lw   r4, 0(r1)\n"
+        "       add  r3, r3, r4\n"
+        "       addi r1, r1, 2      ; next word\n"
+        "       subi r2, r2, 1\n"
+        "       j    next\n"
+        "done:  sw   r3, 0(r1)      ; r1 = &S\n"
+#elif WORKLOAD == 3
+        "       loop r2, done       ; body runs r2 times\n"
+        "       lwp  r4, 0(r1)      ; r4 = A[i], r1 += 2\n"
+        "       add  r3, r3, r4\n"
+        "done:  sw   r3, 0(r1)      ; r1 = &S\n"
+#elif WORKLOAD == 4
+        "       subi r2, r2, 24     ; r2 = # of 4-word vectors\n"
+        "       loop r2, done\n"
+        "       vlwp v1, 0(r1)      ; v1 = A[i ~ i+3], r1 += 8\n"
+        "       vadd v0, v0, v1\n"
+        "done:  vsum r3, v0\n"
+        "       sw   r3, 0(r1)      ; r1 = &S\n"
+#elif WORKLOAD == 5
+        "       lui  r5, 2          ; r5 = &A[0], second stream\n"
+        "       loop r2, done\n"
+        "       lwp  r4, 0(r1)\n"
+        "       lwp  r6, 0(r5)\n"
+        "       mul  r6, r4, r6\n"
+        "       add  r3, r3, r6\n"
+        "done:  sw   r3, 0(r1)      ; r1 = &S\n"
+#else
+        "       lui  r5, 2          ; r5 = &A[0], second stream\n"
+        "       subi r2, r2, 24     ; r2 = # of 4-word vectors\n"
+        "       loop r2, done\n"
+        "       vlwp v1, 0(r1)\n"
+        "       vlwp v2, 0(r5)\n"
+        "       vmul v2, v1, v2\n"
+        "       vadd v0, v0, v2\n"
+        "done:  vsum r3, v0\n"
+        "       sw   r3, 0(r1)      ; r1 = &S\n"
+#endif
+#endif
+        "       halt\n");
+#else
+
     // DATA section ----------------------------------------
     //FFFB -> -5
     //FFF6 -> -10
@@ -153,11 +807,17 @@ UINT loadProgram() {
 
     // CODE section ----------------------------------------
 
+#if WORKLOAD == 1
+    code_end = writeWords(code_bgn =
+                                  0x0200,		0x2002,
+                          0x4040,
+#else
     code_end = writeWords(code_bgn =
                                   0x0200,		0x0003,
                           0xA010,
                           0x0004,
                           0x4040,
+#endif
                           0x4081,
                           0x025C,
                           0x04A4,
@@ -165,6 +825,7 @@ UINT loadProgram() {
                           0x5142,
                           0xF000,
                           END_OF_ARG);
+#endif
 
     // -----------------------------------------------------
 
@@ -179,7 +840,692 @@ UINT loadProgram() {
 // Definitions and Functions
 // for runProgram()
 //========================================
+// Instruction formats
+//	R	op(4) rs(3) rt(3) rd(3) fn(3)
+//	I	op(4) rs(3) rt(3) imm(6)		addi subi lw sw beq
+//	J	op(4) addr(12)					j
+//	U	op(4) rt(3) imm(9)				lui: rt = imm << 7
+//	X	op(4) imm(12)					ext: imm is bits 17..6 of the next I immediate,
+//										so ext + addi loads any 16-bit constant
+//	lwp/swp	I format, rs += 2 after the access
+//	loop	I format, imm = body length in words: the body after loop runs
+//			reg[rs] times with no branch instruction (one loop at a time)
+//	vector	op C: R format, fn = vector ALU op; vlwp/vswp: op D/E, I format, rt = v0 ~ v7;
+//			R format fn 6: vsum rd, vs (sum of lanes), fn 7: vsplat vd, rs (all lanes = rs)
+//	thread	op F: R format, fn 0: halt, 1: spawn rt, rs, 2: join rs, 3: tid rt,
+//			4: tas rd, rs, 5: fadd rd, rs, rt, 6: prt rs, 7: prc rs
+
+#define NO_LOOP		0x10000		// loop_end when no loop is active
+
+// Vector extension
+// - v0 ~ v7: 4 x 16-bit lanes, lane i in bits 16i+15 ~ 16i of vreg[]
+// - vadd/vsub/vmul/vcmp work on vector registers, vaddb/vsubb/vmulb/vcmpb
+//   on the two 8-bit lanes of general registers; vcmp lanes are all ones if equal
+// - vlwp/vswp move 4 words at reg[rs] + imm*2, then rs += 8
+
+// Vector ALU: op C, fn 0 ~ 3 on vector registers, fn 4 ~ 7 on general registers
+void vecAlu(UINT fn, UINT rd, UINT rs, UINT rt) {
+#if USE_SIMD
+    __m128i a, b, r;
+
+    if (fn < 4) {
+        a = _mm_loadl_epi64((__m128i *)&vreg[rs]);
+        b = _mm_loadl_epi64((__m128i *)&vreg[rt]);
+        if (fn == 0) r = _mm_add_epi16(a, b);
+        else if (fn == 1) r = _mm_sub_epi16(a, b);
+        else if (fn == 2) r = _mm_mullo_epi16(a, b);
+        else r = _mm_cmpeq_epi16(a, b);
+        _mm_storel_epi64((__m128i *)&vreg[rd], r);
+        return;
+    }
+    a = _mm_cvtsi32_si128(reg[rs]);
+    b = _mm_cvtsi32_si128(reg[rt]);
+    if (fn == 4) r = _mm_add_epi8(a, b);
+    else if (fn == 5) r = _mm_sub_epi8(a, b);
+    else if (fn == 6)	// no 8-bit multiply: 16-bit products of zero-extended lanes, low bytes kept
+        r = _mm_and_si128(_mm_mullo_epi16(_mm_unpacklo_epi8(a, _mm_setzero_si128()),
+                                          _mm_unpacklo_epi8(b, _mm_setzero_si128())), _mm_set1_epi16(0x00FF)),
+        r = _mm_packus_epi16(r, r);
+    else r = _mm_cmpeq_epi8(a, b);
+    reg[rd] = (WORD)_mm_cvtsi128_si32(r);
+#else
+    UINT64 v = 0;
+    UINT a, b, x = 0;
+    int i;
+
+    if (fn < 4) {
+        for (i = 0; i < 64; i += 16) {
+            a = (UINT)(vreg[rs] >> i) & 0xFFFF;
+            b = (UINT)(vreg[rt] >> i) & 0xFFFF;
+            x = (fn == 0) ? a + b : (fn == 1) ? a - b : (fn == 2) ? a*b : (a == b) ? 0xFFFF : 0;
+            v |= (UINT64)(x & 0xFFFF) << i;
+        }
+        vreg[rd] = v;
+        return;
+    }
+    for (i = 0; i < 16; i += 8) {
+        a = (reg[rs] >> i) & 0xFF;
+        b = (reg[rt] >> i) & 0xFF;
+        x |= (((fn == 4) ? a + b : (fn == 5) ? a - b : (fn == 6) ? a*b : (a == b) ? 0xFF : 0) & 0xFF) << i;
+    }
+    reg[rd] = (WORD)x;
+#endif
+}
+
+// vlwp: load 4 words to vreg[rt]
+void vecLoad(UINT addr, UINT rt) {
+#if SIMD_MEM && WORD_MEM
+    if ((addr & 1) == 0) {	// host words in guest order (SSE2 hosts are little-endian)
+        _mm_storel_epi64((__m128i *)&vreg[rt], _mm_loadl_epi64((__m128i *)&mem[addr]));
+        return;
+    }
+#elif SIMD_MEM
+    __m128i x = _mm_loadl_epi64((__m128i *)&mem[addr]);	// big-endian guest words
+    _mm_storel_epi64((__m128i *)&vreg[rt], _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8)));
+    return;
+#endif
+    vreg[rt] = (UINT64)readWord(addr) | (UINT64)readWord(addr + 2) << 16 |
+               (UINT64)readWord(addr + 4) << 32 | (UINT64)readWord(addr + 6) << 48;
+}
 
+// vswp: store 4 words of vreg[rt]
+void vecStore(UINT addr, UINT rt) {
+    int i;
+
+#if SIMD_MEM
+    __m128i x = _mm_loadl_epi64((__m128i *)&vreg[rt]);
+#if WORD_MEM
+    if ((addr & 1) == 0) {
+        _mm_storel_epi64((__m128i *)&mem[addr], x);
+#else
+    {
+        _mm_storel_epi64((__m128i *)&mem[addr], _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8)));
+#endif
+#if USE_DIRTY_PAGES
+        mem_dirty[ addr		/PAGE_SIZE] = 1;
+        mem_dirty[(addr + 7)/PAGE_SIZE] = 1;
+#endif
+        return;
+    }
+#endif
+    for (i = 0; i < 4; i++) writeWord(addr + 2*i, (WORD)(vreg[rt] >> 16*i));
+}
+
+CORE_LOCAL UINT64 inst_cnt = 0;	// # of executed instructions
+
+// Hardware threads
+// - halt ends the running thread, the program ends when no thread is left
+// - spawn rt, rs: a free context starts at reg[rs] with a copy of the registers,
+//   rt = its tid (FFFF: no free context)
+// - join rs: wait until thread reg[rs] halts
+// - tid rt: rt = tid of the running thread (0: the one started at the entry)
+// Running contexts are linked in a ring and issue in turn: the fetch cycle
+// switches context with no check, only thread ops rebuild the ring
+#define CTX_FREE	0
+#define CTX_RUN		1
+#define CTX_JOIN	2
+
+CORE_LOCAL UINT64 cycle = 0;		// # of cycles (TIMING)
+CORE_LOCAL UINT64 stall_cnt = 0;	// # of cycles no thread could issue (TIMING)
+
+#if TIMING
+#define LOAD_WAIT()	(cur->ready = cycle + MEM_LATENCY)
+#else
+#define LOAD_WAIT()
+#endif
+
+#if MMU
+// Virtual memory
+// - virtual address: VPN, offset; the VPN is split into a first and a second level index
+// - table entry: address of the second level table or of the page | PTE_W | PTE_V
+// - the loader maps each page below PT_BASE to itself, read only if it holds code and no data
+// - a TLB miss walks the table in mem[], one read per level;
+//   readWord()/writeWord() take physical addresses and do not change
+#define VPN_BITS	(16 - MMU_PAGE_BITS)
+#define PT2_BITS	(VPN_BITS/2)		// second level index
+#define PT1_BITS	(VPN_BITS - PT2_BITS)	// first level index
+#define PTE_V		0x0001
+#define PTE_W		0x0002
+#define PAGE_MASK	((1 << MMU_PAGE_BITS) - 1)
+
+typedef struct {
+    UINT vpn;		// virtual page number
+    UINT page;		// physical page address
+    UINT pte;		// flags
+    UINT64 used;	// last use, for LRU
+} TLB_ENTRY;
+
+TLB_ENTRY tlb[TLB_SETS][TLB_WAYS];
+UINT64 tlb_clock = 0;		// LRU clock
+UINT64 tlb_hit = 0;			// # of TLB hits
+UINT64 tlb_miss = 0;		// # of TLB misses = page walks
+UINT64 walk_reads = 0;		// # of table entries read by page walks
+UINT64 walk_cycles = 0;		// cycles spent in page walks
+UINT64 page_faults = 0;		// # of page and protection faults
+jmp_buf mmu_jmp;			// where runProgram() handles a page fault
+UINT mmu_fault_va;			// virtual address of the fault
+int mmu_fault_fetch;		// 1: the fault is in the fetch cycle
+
+// Build the page table and flush the TLB
+void mmuInit() {
+    UINT i, va, pte, pt2;
+
+    for (i = 0; i < (1 << PT1_BITS); i++) {
+        pt2 = PT_BASE + (2 << PT1_BITS) + (i << (PT2_BITS + 1));
+        writeWord(PT_BASE + i*2, (WORD)(pt2 | PTE_V));
+    }
+    for (i = 0; i < (1 << VPN_BITS); i++) {
+        va = i << MMU_PAGE_BITS;
+        pte = 0;
+        if (va < PT_BASE) {
+            pte = va | PTE_V;
+            if (va + PAGE_MASK < code_bgn || va >= code_end ||		// no code
+                (va + PAGE_MASK >= data_bgn && va < data_end)) pte |= PTE_W;	// or some data
+        }
+        writeWord(PT_BASE + (2 << PT1_BITS) + i*2, (WORD)pte);
+    }
+    memset(tlb, 0, sizeof(tlb));
+}
+
+// Translate virtual address va for a read (0), write (1) or fetch (2)
+// - fault to runProgram() if not mapped, or a write to a read only page
+UINT translate(UINT va, int write) {
+    UINT vpn = va >> MMU_PAGE_BITS;
+    TLB_ENTRY *e = tlb[vpn%TLB_SETS], *v = e;
+    UINT pte;
+    int i;
+
+    for (i = 0; i < TLB_WAYS; i++)
+        if (e[i].pte && e[i].vpn == vpn) break;
+    if (i < TLB_WAYS) {
+        tlb_hit++;
+        e += i;
+    }
+    else {	// walk, then fill the LRU way
+        tlb_miss++;
+        pte = readWord(PT_BASE + (vpn >> PT2_BITS)*2);
+        walk_reads++;
+        if (pte & PTE_V) {
+            pte = readWord((pte & 0xFFFC) + (vpn & ((1 << PT2_BITS) - 1))*2);
+            walk_reads++;
+        }
+        walk_cycles += (pte & PTE_V ? 2 : 1)*(1 + MEM_LATENCY);
+#if TIMING
+        cycle += (pte & PTE_V ? 2 : 1)*(1 + MEM_LATENCY);
+        stall_cnt += (pte & PTE_V ? 2 : 1)*(1 + MEM_LATENCY);
+#endif
+        if (!(pte & PTE_V)) {
+            page_faults++;
+            mmu_fault_va = va;
+            mmu_fault_fetch = (write == 2);
+            longjmp(mmu_jmp, 1);
+        }
+        for (i = 1; i < TLB_WAYS; i++)
+            if (e[i].used < v->used) v = &e[i];
+        e = v;
+        e->vpn = vpn;
+        e->page = pte & ~PAGE_MASK & 0xFFFF;
+        e->pte = pte & (PTE_V | PTE_W);
+    }
+    if (write == 1 && !(e->pte & PTE_W)) {
+        page_faults++;
+        mmu_fault_va = va;
+        mmu_fault_fetch = 0;
+        longjmp(mmu_jmp, 2);
+    }
+    e->used = ++tlb_clock;
+    return e->page | (va & PAGE_MASK);
+}
+
+// Print TLB and page walk statistics
+void printMmu() {
+    printf("[MMU]\n");
+    printf("page %d bytes, 2 levels, TLB %d sets x %d ways\n", 1 << MMU_PAGE_BITS, TLB_SETS, TLB_WAYS);
+    printf("%llu translations: %llu TLB hits (%.2f%%), %llu misses\n", tlb_hit + tlb_miss, tlb_hit,
+           tlb_hit + tlb_miss ? 100.0*tlb_hit/(tlb_hit + tlb_miss) : 0.0, tlb_miss);
+    printf("page walks: %llu table reads, %llu cycles; %llu faults\n", walk_reads, walk_cycles, page_faults);
+}
+
+#define VA(addr, write)	translate(addr, write)
+#else
+#define VA(addr, write)	(addr)
+#endif
+
+#if CORES > 1
+// Multi-core
+// - core i runs context i on its own host thread, a core with no running
+//   context waits until spawn starts one there
+// - cores run QUANTUM instructions, then meet at a barrier
+// - each core has a direct mapped L1 kept coherent by snooping MESI;
+//   the L1 holds tags and states only, data stays in mem[]
+// - misses, upgrades, thread ops and atomics hold bus_lock: one bus transaction at a time
+// - mem[], mem_dirty[] and l1_used[] are read and written without bus_lock, by relaxed atomics
+#define L1_I		0
+#define L1_S		1
+#define L1_E		2
+#define L1_M		3
+#define N_LINES		(MEM_SIZE/LINE_SIZE)
+
+UINT l1[CORES][L1_LINES];			// line number << 2 | MESI state
+UCHAR l1_used[CORES][L1_LINES];		// words the core accessed since the line was filled
+UINT64 l1_hit[CORES];				// L1 hits of each core
+UINT64 l1_miss[CORES];				// L1 misses and upgrades of each core
+UINT64 bus_rd = 0;					// BusRd: read miss
+UINT64 bus_rdx = 0;					// BusRdX: write miss
+UINT64 bus_upgr = 0;				// BusUpgr: write to a shared line
+UINT64 bus_wb = 0;					// modified lines written back
+UINT64 bus_inval = 0;				// copies invalidated in other L1s
+UINT line_inval[N_LINES];			// invalidations per memory line
+UINT line_false[N_LINES];			// of those, the copy never used the written word
+pthread_mutex_t bus_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define BUS_LOCK()		pthread_mutex_lock(&bus_lock)
+#define BUS_UNLOCK()	pthread_mutex_unlock(&bus_lock)
+#define L1_READ(addr)	l1Access(addr, 0)
+#define L1_WRITE(addr)	l1Access(addr, 1)
+#define L1_WRITE_LOCKED(addr)	l1Bus(addr, 1)
+
+// Access addr in the L1 of the running core with bus_lock held
+// - a hit needs no bus transaction, as in l1Access()
+// - l1_used[] of a core is written by that core only, others read it here
+void l1Bus(UINT addr, int write) {
+    UINT c = (UINT)(cur - ctx);
+    UINT line = addr/LINE_SIZE;
+    UINT set = line%L1_LINES;
+    UCHAR bit = (UCHAR)(1 << (addr%LINE_SIZE/2));
+    UINT e = __atomic_load_n(&l1[c][set], __ATOMIC_ACQUIRE);
+    UINT x, shared = 0;
+    int i;
+
+    if (e >> 2 == line && (e & 3) != L1_I && (!write || (e & 3) != L1_S)) {
+        if (write) __atomic_store_n(&l1[c][set], line << 2 | L1_M, __ATOMIC_RELEASE);
+        l1_hit[c]++;
+        __atomic_fetch_or(&l1_used[c][set], bit, __ATOMIC_RELAXED);
+        return;
+    }
+    if (e >> 2 == line && (e & 3) != L1_I) bus_upgr++;	// write to S (E snooped to S meanwhile)
+    else {
+        if ((e & 3) == L1_M) bus_wb++;	// victim
+        if (write) bus_rdx++;
+        else bus_rd++;
+        __atomic_store_n(&l1_used[c][set], 0, __ATOMIC_RELAXED);
+    }
+    for (i = 0; i < CORES; i++) {	// snoop
+        if (i == (int)c) continue;
+        x = __atomic_load_n(&l1[i][set], __ATOMIC_ACQUIRE);
+        do {
+            if (x >> 2 != line || (x & 3) == L1_I) break;
+        } while (!__atomic_compare_exchange_n(&l1[i][set], &x, line << 2 | (write ? L1_I : L1_S), 0,
+                                              __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+        if (x >> 2 != line || (x & 3) == L1_I) continue;
+        if ((x & 3) == L1_M) bus_wb++;
+        if (write) {
+            bus_inval++;
+            line_inval[line]++;
+            if (!(__atomic_load_n(&l1_used[i][set], __ATOMIC_RELAXED) & bit)) line_false[line]++;
+        }
+        else shared = 1;
+    }
+    __atomic_store_n(&l1[c][set], line << 2 | (write ? L1_M : shared ? L1_S : L1_E), __ATOMIC_RELEASE);
+    __atomic_fetch_or(&l1_used[c][set], bit, __ATOMIC_RELAXED);
+    l1_miss[c]++;
+}
+
+// Access addr in the L1 of the running core
+void l1Access(UINT addr, int write) {
+    UINT c = (UINT)(cur - ctx);
+    UINT line = addr/LINE_SIZE;
+    UINT set = line%L1_LINES;
+    UINT e = __atomic_load_n(&l1[c][set], __ATOMIC_ACQUIRE);
+
+    // hit: read in S/E/M, write in M, or E -> M with no bus transaction
+    if (e >> 2 == line && (e & 3) != L1_I &&
+        (!write || (e & 3) == L1_M || ((e & 3) == L1_E &&
+         __atomic_compare_exchange_n(&l1[c][set], &e, line << 2 | L1_M, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)))) {
+        l1_hit[c]++;
+        __atomic_fetch_or(&l1_used[c][set], (UCHAR)(1 << (addr%LINE_SIZE/2)), __ATOMIC_RELAXED);
+        return;
+    }
+    BUS_LOCK();
+    l1Bus(addr, write);
+    BUS_UNLOCK();
+}
+#else
+#define BUS_LOCK()
+#define BUS_UNLOCK()
+#define L1_READ(addr)
+#define L1_WRITE(addr)
+#define L1_WRITE_LOCKED(addr)
+#endif
+
+// Link running contexts in a ring, a stopped one keeps a link into it
+// - return # of running contexts
+int linkContexts() {
+    int i, j, n = 0;
+
+    for (i = 0; i < THREADS; i++) {
+        for (j = 1; j < THREADS && ctx[(i + j)%THREADS].state != CTX_RUN; j++);
+        ctx[i].next = &ctx[(i + j)%THREADS];
+        n += (ctx[i].state == CTX_RUN);
+    }
+    return n;
+}
+
+// Reset contexts: only thread 0 runs, at addr
+void resetContexts(UINT addr) {
+    int i;
+
+    memset(ctx, 0, sizeof(ctx));
+    for (i = 0; i < THREADS; i++) ctx[i].loop_end = NO_LOOP;
+    ctx[0].state = CTX_RUN;
+    ctx[0].pc = addr;
+    cur = &ctx[0];
+    reg = cur->reg;
+    vreg = cur->vreg;
+    linkContexts();
+}
+
+// Thread ops: op F, fn 0 (and 4 ~ 5) halt, 1 spawn, 2 join, 3 tid
+// - return 0: threads running, 1: no thread left, 2: all threads wait in join
+int threadOp(UINT fn, UINT rs, UINT rt) {
+    UINT self = (UINT)(cur - ctx);
+    UINT t;
+
+    if (fn == 1) { //spawn
+        for (t = 0; t < THREADS && ctx[t].state != CTX_FREE; t++);
+        if (t == THREADS) {
+            reg[rt] = 0xFFFF;
+            return 0;
+        }
+        memcpy(ctx[t].reg, reg, sizeof(ctx[t].reg));
+        memcpy(ctx[t].vreg, vreg, sizeof(ctx[t].vreg));
+        ctx[t].pc = reg[rs];
+        ctx[t].loop_end = NO_LOOP;
+        ctx[t].ready = cycle;
+        ctx[t].state = CTX_RUN;
+        reg[rt] = (WORD)t;
+    }
+    else if (fn == 2) { //join
+        t = reg[rs];
+        if (t >= THREADS || t == self || ctx[t].state == CTX_FREE) return 0;
+        cur->state = CTX_JOIN;
+        cur->join = t;
+    }
+    else if (fn == 3) { //tid
+        reg[rt] = (WORD)self;
+        return 0;
+    }
+    else { //halt
+        cur->state = CTX_FREE;
+        for (t = 0; t < THREADS; t++)
+            if (ctx[t].state == CTX_JOIN && ctx[t].join == self) {
+                ctx[t].state = CTX_RUN;
+                ctx[t].ready = cycle;
+            }
+    }
+    if (linkContexts() > 0) return 0;
+    for (t = 0; t < THREADS; t++)
+        if (ctx[t].state == CTX_JOIN) return 2;
+    return 1;
+}
+
+// Atomics: op F, fn 4 tas rd, rs: rd = M[reg[rs]], M[reg[rs]] = 1
+//                fn 5 fadd rd, rs, rt: rd = M[reg[rs]], M[reg[rs]] += reg[rt]
+// - read and write are one bus transaction, atomic between cores
+void atomicOp(UINT fn, UINT rd, UINT rs, UINT rt) {
+    UINT addr = VA(reg[rs], 1);
+    WORD x = readWord(addr);	// a guard page fault must not leave bus_lock held
+    WORD y = reg[rt];
+
+    BUS_LOCK();
+    L1_WRITE_LOCKED(addr);
+    x = readWord(addr);
+    writeWord(addr, (fn == 4) ? 1 : (WORD)(x + y));
+    BUS_UNLOCK();
+    reg[rd] = x;
+    LOAD_WAIT();
+}
+
+// Output: op F, fn 6 prt rs: print reg[rs] as a signed decimal
+//               fn 7 prc rs: print the char in reg[rs]
+void printOp(UINT fn, UINT rs) {
+    if (fn == 6) printf("%d", (short)reg[rs]);
+    else putchar(reg[rs] & 0xFF);
+}
+
+#if OOO
+// Out-of-order timing model
+// - fed by the functional engine before each instruction executes,
+//   register values give the addresses and branch outcomes
+// - renaming: each register (r0 ~ r7, v0 ~ v7) maps to its latest producer,
+//   so only true dependences wait
+// - dispatch in order into the ROB, the RS of a unit and the LSQ,
+//   issue when operands and unit are free, commit in order
+// - units: OOO_WIDTH ALUs, one pipelined mul, one div, one load/store port
+// - a load forwards from an older store to its address still in the LSQ,
+//   memory disambiguation is perfect
+// - beq is predicted backward taken, forward not taken; ext is fused
+//   with the instruction it extends, the loop instruction's jump back is free
+#define FU_ALU		0
+#define FU_MUL		1
+#define FU_DIV		2
+#define FU_LSU		3
+#define N_FU		4
+#define ST_ROB		N_FU	// stall causes: RS of each unit, then these
+#define ST_LSQ		(N_FU + 1)
+#define ST_BR		(N_FU + 2)
+#define N_ST		(N_FU + 3)
+#define OOO_WIN		0x4000	// cycles tracked ahead for units and ROB occupancy
+#define OOO_STQ		256		// recent stores by address, for forwarding
+
+char *ooo_stall_name[N_ST] = { "rs alu", "rs mul", "rs div", "rs lsu", "rob", "lsq", "branch" };
+UINT ooo_fu_cnt[N_FU] = { OOO_WIDTH, 1, 1, 1 };
+
+struct {						// state of one run, cycles count from 0
+    UINT64 ready[2*REG_SIZE];	// cycle each register's latest value is ready
+    UINT64 rob[ROB_SIZE];		// commit cycles of the last ROB_SIZE instructions
+    UINT64 lsq[LSQ_SIZE];		// commit cycles of the last LSQ_SIZE loads/stores
+    UINT64 rs[N_FU][RS_SIZE];	// issue cycles of the instructions holding RS entries
+    UINT64 disp[OOO_WIDTH];		// dispatch cycles of the last OOO_WIDTH instructions
+    UINT64 comm[OOO_WIDTH];		// commit cycles of the last OOO_WIDTH instructions
+    UINT64 fu_cyc[N_FU][OOO_WIN];	// cycle a slot of the unit table stands for
+    UINT fu_use[N_FU][OOO_WIN];	// issues in that cycle
+    UINT dcnt[OOO_WIN];			// dispatches in a cycle not yet in ooo_hist
+    UINT ccnt[OOO_WIN];			// commits in a cycle not yet in ooo_hist
+    struct { UINT addr; UINT64 done, commit; } stq[OOO_STQ];	// last store to an address
+    UINT64 n, m;				// # of instructions, loads/stores
+    UINT64 redirect;			// first cycle after a mispredict
+    UINT64 div_free;			// first cycle the div unit takes a new one
+    UINT64 hcyc;				// next cycle to count in ooo_hist
+    UINT occ;					// ROB occupancy at hcyc
+} ooo;
+UINT64 ooo_hist[ROB_SIZE + 1];	// cycles with each ROB occupancy
+UINT64 ooo_stall[N_ST];			// dispatch cycles lost to each cause
+UINT64 ooo_inst = 0;			// # of instructions timed
+UINT64 ooo_cycles = 0;			// # of cycles of all runs
+UINT64 ooo_forward = 0;			// # of loads forwarded from a store
+
+// Count cycles before c in the ROB occupancy histogram
+void oooHist(UINT64 c) {
+    for (; ooo.hcyc < c; ooo.hcyc++) {
+        ooo.occ += ooo.dcnt[ooo.hcyc%OOO_WIN];
+        ooo.occ -= ooo.ccnt[ooo.hcyc%OOO_WIN];
+        ooo.dcnt[ooo.hcyc%OOO_WIN] = ooo.ccnt[ooo.hcyc%OOO_WIN] = 0;
+        ooo_hist[ooo.occ]++;
+    }
+}
+
+// Take the first cycle >= c with a free slot of unit fu
+UINT64 oooSlot(int fu, UINT64 c) {
+    for (;; c++) {
+        if (ooo.fu_cyc[fu][c%OOO_WIN] != c) {
+            ooo.fu_cyc[fu][c%OOO_WIN] = c;
+            ooo.fu_use[fu][c%OOO_WIN] = 0;
+        }
+        if (ooo.fu_use[fu][c%OOO_WIN] < ooo_fu_cnt[fu]) break;
+    }
+    ooo.fu_use[fu][c%OOO_WIN]++;
+    return c;
+}
+
+// Time one instruction: ir and its ext prefix bits, before it executes
+void oooInst(UINT ir, UINT ir_ext) {
+    UINT op = ir >> 12, fn = ir & 0x0007;
+    UINT rs = (ir >> 9) & 7, rt = (ir >> 6) & 7, rd = (ir >> 3) & 7;
+    int off = (signed short)(((ir & 0x003F) | ir_ext) & 0xFFFF);
+    UINT addr = (reg[rs] + off*2) & 0xFFFF;
+    int src1 = -1, src2 = -1, dst = -1, dst2 = -1;	// registers, v0 ~ v7 are 8 ~ 15
+    int fu = FU_ALU, load = 0, store = 0, miss = 0;
+    UINT64 d, iss, done, c;
+    int i, j;
+
+    switch (op) {
+    case 0x0:	// R format
+        src1 = rs, src2 = rt, dst = rd;
+        if (fn == 4) fu = FU_MUL;
+        else if (fn == 5) fu = FU_DIV;
+        else if (fn == 6) src1 = 8 + rs, src2 = -1;	// vsum
+        else if (fn == 7) dst = 8 + rd, src2 = -1;	// vsplat
+        break;
+    case 0x1:	// beq
+        src1 = rs, src2 = rt;
+        miss = (reg[rs] == reg[rt]) != (off < 0);
+        break;
+    case 0x2: dst = rs; break;	// lui
+    case 0x4: src1 = rs, dst = rt, load = 1; break;
+    case 0x5: src1 = rs, src2 = rt, store = 1; break;
+    case 0x6: src1 = rs, dst = rt, dst2 = rs, load = 1; break;
+    case 0x7: src1 = rs, src2 = rt, dst2 = rs, store = 1; break;
+    case 0x9: src1 = rs; break;	// loop
+    case 0xA:
+    case 0xB: src1 = rs, dst = rt; break;
+    case 0xC:	// vector ALU
+        if (fn < 4) src1 = 8 + rs, src2 = 8 + rt, dst = 8 + rd;
+        else src1 = rs, src2 = rt, dst = rd;
+        if ((fn & 3) == 2) fu = FU_MUL;
+        break;
+    case 0xD: src1 = rs, dst = 8 + rt, dst2 = rs, load = 1; break;
+    case 0xE: src1 = rs, src2 = 8 + rt, dst2 = rs, store = 1; break;
+    case 0xF:
+        if ((fn & 6) == 4) {	// tas, fadd
+            src1 = rs, src2 = rt, dst = rd, load = store = 1;
+            addr = reg[rs];
+        }
+        else if (fn == 1) src1 = rs;	// spawn
+        else if (fn == 3) dst = rt;		// tid
+        else if (fn >= 6) src1 = rs;	// prt, prc
+        break;
+    }
+    if (load || store) fu = FU_LSU;
+
+    // dispatch: in order, OOO_WIDTH per cycle, then wait for a redirect and free entries
+    d = ooo.n ? ooo.disp[(ooo.n - 1)%OOO_WIDTH] : 0;
+    if (ooo.n >= OOO_WIDTH && ooo.disp[ooo.n%OOO_WIDTH] + 1 > d) d = ooo.disp[ooo.n%OOO_WIDTH] + 1;
+    if (ooo.redirect > d) ooo_stall[ST_BR] += ooo.redirect - d, d = ooo.redirect;
+    if (ooo.n >= ROB_SIZE && ooo.rob[ooo.n%ROB_SIZE] > d)
+        ooo_stall[ST_ROB] += ooo.rob[ooo.n%ROB_SIZE] - d, d = ooo.rob[ooo.n%ROB_SIZE];
+    if ((load || store) && ooo.m >= LSQ_SIZE && ooo.lsq[ooo.m%LSQ_SIZE] > d)
+        ooo_stall[ST_LSQ] += ooo.lsq[ooo.m%LSQ_SIZE] - d, d = ooo.lsq[ooo.m%LSQ_SIZE];
+    for (i = j = 0; i < RS_SIZE; i++)	// RS entry freed first
+        if (ooo.rs[fu][i] < ooo.rs[fu][j]) j = i;
+    if (ooo.rs[fu][j] > d) ooo_stall[fu] += ooo.rs[fu][j] - d, d = ooo.rs[fu][j];
+    oooHist(d);
+
+    // issue: operands ready, then a free unit
+    iss = d + 1;
+    if (src1 >= 0 && ooo.ready[src1] > iss) iss = ooo.ready[src1];
+    if (src2 >= 0 && ooo.ready[src2] > iss) iss = ooo.ready[src2];
+    if (fu == FU_DIV) {
+        if (ooo.div_free > iss) iss = ooo.div_free;
+        ooo.div_free = iss + LAT_DIV;
+    }
+    else iss = oooSlot(fu, iss);
+    ooo.rs[fu][j] = iss;
+
+    // execute
+    done = iss + (fu == FU_MUL ? LAT_MUL : fu == FU_DIV ? LAT_DIV : 1);
+    if (load) {
+        i = addr%OOO_STQ;
+        if (ooo.stq[i].addr == addr && ooo.stq[i].commit >= iss) {	// forward from the LSQ
+            done = (ooo.stq[i].done > iss ? ooo.stq[i].done : iss) + 1;
+            ooo_forward++;
+        }
+        else done = iss + 1 + MEM_LATENCY;
+    }
+    if (dst >= 0) ooo.ready[dst] = done;
+    if (dst2 >= 0) ooo.ready[dst2] = iss + 1;
+    if (miss) ooo.redirect = done + BR_PENALTY;
+
+    // commit: in order, OOO_WIDTH per cycle
+    c = ooo.n ? ooo.comm[(ooo.n - 1)%OOO_WIDTH] : 0;
+    if (done > c) c = done;
+    if (ooo.n >= OOO_WIDTH && ooo.comm[ooo.n%OOO_WIDTH] + 1 > c) c = ooo.comm[ooo.n%OOO_WIDTH] + 1;
+    if (store) {
+        i = addr%OOO_STQ;
+        ooo.stq[i].addr = addr;
+        ooo.stq[i].done = done;
+        ooo.stq[i].commit = c;
+    }
+    if (load || store) ooo.lsq[ooo.m++%LSQ_SIZE] = c;
+    ooo.rob[ooo.n%ROB_SIZE] = c;
+    ooo.disp[ooo.n%OOO_WIDTH] = d;
+    ooo.comm[ooo.n%OOO_WIDTH] = c;
+    ooo.dcnt[d%OOO_WIN]++;
+    ooo.ccnt[c%OOO_WIN]++;
+    ooo.n++;
+}
+
+// End of a run: count its last cycles, add it to the totals, reset the model
+void oooFinish() {
+    UINT64 end = ooo.n ? ooo.comm[(ooo.n - 1)%OOO_WIDTH] + 1 : 0;
+
+    oooHist(end);
+    ooo_inst += ooo.n;
+    ooo_cycles += end;
+    memset(&ooo, 0, sizeof(ooo));
+}
+
+// Print IPC, dispatch stalls and the ROB occupancy histogram
+void printOoo() {
+    UINT64 h, total = 0;
+    int i, j, w = (ROB_SIZE + 7)/8;
+
+    printf("[OOO]\n");
+    printf("width %d, ROB %d, RS %d per unit, LSQ %d, latency mul %d, div %d, load %d\n",
+           OOO_WIDTH, ROB_SIZE, RS_SIZE, LSQ_SIZE, LAT_MUL, LAT_DIV, 1 + MEM_LATENCY);
+    printf("%llu instructions, %llu cycles (IPC %.2f), %llu loads forwarded\n",
+           ooo_inst, ooo_cycles, ooo_cycles ? (double)ooo_inst/ooo_cycles : 0.0, ooo_forward);
+    printf("dispatch stalls (cycles):");
+    for (i = 0; i < N_ST; i++) printf(" %s %llu%s", ooo_stall_name[i], ooo_stall[i], i < N_ST - 1 ? "," : "\n");
+    for (i = 0; i <= ROB_SIZE; i++) total += ooo_hist[i];
+    printf("ROB occupancy:\n");
+    for (i = 0; i <= ROB_SIZE; i += w) {
+        for (h = 0, j = i; j < i + w && j <= ROB_SIZE; j++) h += ooo_hist[j];
+        printf("  %2d ~ %2d: %5.1f%%\n", i, j - 1, total ? 100.0*h/total : 0.0);
+    }
+}
+#endif
+
+#if CORES > 1
+pthread_barrier_t core_barrier;	// lockstep of the cores
+int run_over;					// 1: no context left to run, or a core faulted
+int core_fault;					// 1: a core ended with a fault
+
+// Wait for the other cores at the end of a quantum
+// - states are read between the two barriers, no core runs there
+// - return 1 when the running context goes on, 0 when the run is over
+int coreSync() {
+    int go;
+
+    do {
+        if (pthread_barrier_wait(&core_barrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+            run_over = core_fault || linkContexts() == 0;
+        go = (cur->state == CTX_RUN);
+        pthread_barrier_wait(&core_barrier);
+    } while (!go && !run_over);
+    return !run_over;
+}
+#endif
 
 
 //========================================
@@ -188,8 +1534,11 @@ UINT loadProgram() {
 // - return exit state = 0: normal exit
 //                       1: error exit
 //========================================
-UINT pc = 0;
-int ST_RUN = 0;
+CORE_LOCAL UINT pc = 0;
+CORE_LOCAL int ST_RUN = 0;
+#if CORES > 1
+CORE_LOCAL UINT quantum;	// instructions left to the next barrier; like pc, not a local across sigsetjmp
+#endif
 int runProgram(UINT code_addr) {
     pc = code_addr;
     UINT ir;
@@ -201,15 +1550,110 @@ int runProgram(UINT code_addr) {
     UINT ir_imm;
     UINT ir_addr;
     UINT ir_jaddr;
+    UINT ir_ext;
+    UINT ea;	// effective address of a load or store
+#if CORES > 1
+    quantum = QUANTUM;
+#elif THREADS > 1 || TIMING
+    CONTEXT *next;
+#endif
+#if TIMING && CORES == 1
+    CONTEXT *c, *n;
+#endif
 
     int status = ST_RUN;
 
+#if USE_GUARD_PAGES
+    if (sigsetjmp(fault_jmp, 1)) {
+        // fault in fetch cycle: at pc, otherwise in the instruction at pc - 2
+        UINT fault_pc = (fault_addr == (long)pc || fault_addr == (long)pc + 1) ? pc : pc - 2;
+        printf("Fault: address %04lX out of memory at PC %04X\n", fault_addr, fault_pc);
+        return 1;
+    }
+    fault_armed = 1;
+#endif
+#if MMU
+    int fault = setjmp(mmu_jmp);
+    if (fault) {
+        UINT fault_pc = mmu_fault_fetch ? pc : pc - 2;
+        printf("Fault: %s at %04X at PC %04X\n", fault == 1 ? "page fault" : "write to read only page",
+               mmu_fault_va, fault_pc);
+#if USE_GUARD_PAGES
+        fault_armed = 0;
+#endif
+        return 1;
+    }
+#endif
+
     while(status == ST_RUN) {
+#if CORES > 1
+        //-------end of quantum: lockstep with the other cores ------------/
+        if(--quantum == 0)
+        {
+            cur->pc = pc;
+            if(!coreSync()) break;
+            pc = cur->pc;
+            quantum = QUANTUM;
+        }
+#if TIMING
+        if(cur->ready > cycle)
+        {
+            stall_cnt += cur->ready - cycle;
+            cycle = cur->ready;
+        }
+        cycle++;
+#endif
+#elif THREADS > 1 || TIMING
+        //-------switch to next running context ------------/
+        cur->pc = pc;
+        next = cur->next;
+#if TIMING
+        // first one ready to issue, or stall until the earliest one is
+        for (c = next; c->ready > cycle && c->next != next; c = c->next);
+        if (c->ready > cycle) {
+            for (c = next, n = next->next; n != next; n = n->next)
+                if (n->ready < c->ready) c = n;
+            stall_cnt += c->ready - cycle;
+            cycle = c->ready;
+        }
+        next = c;
+        cycle++;
+#endif
+        cur = next;
+        pc = cur->pc;
+        reg = cur->reg;
+        vreg = cur->vreg;
+#endif
         //-------fetch cycle ------------/
+        if(pc == cur->loop_end) //end of loop body
+        {
+            if(cur->loop_cnt > 1)
+            {
+                cur->loop_cnt--;
+                pc = cur->loop_start;
+            }
+            else cur->loop_end = NO_LOOP;
+        }
         ir = pc;
-        ir = readWord(ir);
+        ir = readWord(VA(ir, 2));
         ir_op = ir & 0xF000;
         pc += (UINT)2;
+        inst_cnt++;
+        ir_ext = 0;
+        if(ir_op == 0x8000) //ext: prefix of the next instruction
+        {
+            ir_ext = (ir & 0x0FFF) << 6;
+            ir = readWord(VA(pc, 2));
+            ir_op = ir & 0xF000;
+            pc += (UINT)2;
+            inst_cnt++;
+#if TIMING
+            cycle++;
+#endif
+        }
+#if OOO
+        oooInst(ir, ir_ext);
+#endif
 
 
         //----execution cycle---------------/
@@ -251,20 +1695,62 @@ int runProgram(UINT code_addr) {
              {
                  reg[temp_rd] = reg[temp_rs] / reg[temp_rt];
              }
+            else if(ir_fn == 0x0006) //vsum
+             {
+                 reg[temp_rd] = (WORD)(vreg[temp_rs] + (vreg[temp_rs] >> 16) + (vreg[temp_rs] >> 32) + (vreg[temp_rs] >> 48));
+             }
+            else if(ir_fn == 0x0007) //vsplat
+             {
+                 vreg[temp_rd] = reg[temp_rs]*0x0001000100010001ULL;
+             }
         }
         else{
             ir_rs = (ir & 0x0E00) >> 1;
             ir_rt = (ir & 0x01C0) >> 2;
-            ir_imm = (ir & 0x003F);
-            ir_addr = (ir & 0x003F);
+            ir_imm = (ir & 0x003F) | ir_ext;
+            ir_addr = (ir & 0x003F) | ir_ext;
             ir_jaddr = (ir & 0x0FFF);
             ir_rs = ir_rs >> 8;
             ir_rt = ir_rt >> 4;
             signed short temp_rs = (signed short)(ir_rs);
             signed short temp_rt = (signed short)(ir_rt);
-            signed short temp_imm = (signed short)(ir_imm);
-            signed short temp_addr = (signed short)(ir_addr);
-            if(ir_op == 0xF000) ST_RUN = 1;
+            signed short temp_imm = (signed short)(ir_imm & 0xFFFF);
+            signed short temp_addr = (signed short)(ir_addr & 0xFFFF);
+            if(ir_op == 0xF000) //halt, thread ops, atomics
+            {
+                if((ir & 0x0006) == 0x0004)
+                {
+                    atomicOp(ir & 0x0007, (ir & 0x0038) >> 3, temp_rs, temp_rt);
+                }
+                else if((ir & 0x0006) == 0x0006) //prt, prc
+                {
+                    printOp(ir & 0x0007, temp_rs);
+                }
+                else
+                {
+                    BUS_LOCK();
+                    int t = threadOp(ir & 0x0007, temp_rs, temp_rt);
+                    BUS_UNLOCK();
+                    if(t == 1) ST_RUN = 1;
+                    else if(t == 2)
+                    {
+                        printf("Fault: all threads wait in join at PC %04X\n", pc - 2);
+#if USE_GUARD_PAGES
+                        fault_armed = 0;
+#endif
+                        return 1;
+                    }
+#if CORES > 1
+                    else if(cur->state != CTX_RUN) //halted or joining: idle until spawned or woken
+                    {
+                        cur->pc = pc;
+                        if(!coreSync()) break;
+                        pc = cur->pc;
+                        quantum = QUANTUM;
+                    }
+#endif
+                }
+            }
             else if(ir_op== 0xA000) //addi
             {
                 reg[temp_rt] = reg[temp_rs] + temp_imm;
@@ -275,58 +1761,236 @@ int runProgram(UINT code_addr) {
             }
             else if(ir_op == 0x4000) //lw
             {
-                reg[temp_rt] = readWord(reg[temp_rs] + temp_addr * 2);
+                ea = VA((reg[temp_rs] + temp_addr * 2) & 0xFFFF, 0);
+                L1_READ(ea);
+                reg[temp_rt] = readWord(ea);
+                LOAD_WAIT();
             }
             else if(ir_op == 0x5000) //sw
             {
-                writeWord(reg[temp_rs] + temp_addr * 2,reg[temp_rt]);
+                ea = VA((reg[temp_rs] + temp_addr * 2) & 0xFFFF, 1);
+                L1_WRITE(ea);
+                writeWord(ea,reg[temp_rt]);
+            }
+            else if(ir_op == 0x6000) //lwp
+            {
+                ea = VA((reg[temp_rs] + temp_addr * 2) & 0xFFFF, 0);
+                L1_READ(ea);
+                reg[temp_rt] = readWord(ea);
+                reg[temp_rs] += 2;
+                LOAD_WAIT();
+            }
+            else if(ir_op == 0x7000) //swp
+            {
+                ea = VA((reg[temp_rs] + temp_addr * 2) & 0xFFFF, 1);
+                L1_WRITE(ea);
+                writeWord(ea,reg[temp_rt]);
+                reg[temp_rs] += 2;
+            }
+            else if(ir_op == 0xC000) //vector ALU
+            {
+                vecAlu(ir & 0x0007, (ir & 0x0038) >> 3, temp_rs, temp_rt);
+            }
+            else if(ir_op == 0xD000) //vlwp
+            {
+                ea = VA((reg[temp_rs] + temp_addr * 2) & 0xFFFF, 0);
+                (void)VA((reg[temp_rs] + temp_addr * 2 + 6) & 0xFFFF, 0);	// pages map to themselves: contiguous
+                L1_READ(ea);
+                L1_READ(ea + 6);
+                vecLoad(ea, temp_rt);
+                reg[temp_rs] += 8;
+                LOAD_WAIT();
+            }
+            else if(ir_op == 0xE000) //vswp
+            {
+                ea = VA((reg[temp_rs] + temp_addr * 2) & 0xFFFF, 1);
+                (void)VA((reg[temp_rs] + temp_addr * 2 + 6) & 0xFFFF, 1);
+                L1_WRITE(ea);
+                L1_WRITE(ea + 6);
+                vecStore(ea, temp_rt);
+                reg[temp_rs] += 8;
+            }
+            else if(ir_op == 0x2000) //lui
+            {
+                reg[temp_rs] = (WORD)((ir & 0x01FF) << 7);
             }
             else if(ir_op == 0x1000) //beq
             {
                 if(reg[temp_rs] == reg[temp_rt])
                 {
-                    pc += temp_addr * 2;
+                    pc = (pc + temp_addr * 2) & 0xFFFF;
                 }
                 else {
+#if TRACE
                     printf("%04x\n",pc-2);
                     printRegisters();
+#endif
                     continue;
                 }
             }
             else if(ir_op == 0x3000) //Jump
             {
+#if TRACE
                 printf("%04x\n",pc-2);
                 printRegisters();
+#endif
                 ir_jaddr = ir_jaddr | 0xF000;
                 signed short temp_jaddr = (signed short)(ir_jaddr);
-                pc +=  temp_jaddr * 2;
+                pc = (pc + temp_jaddr * 2) & 0xFFFF;
+            }
+            else if(ir_op == 0x9000) //loop
+            {
+                cur->loop_start = pc;
+                cur->loop_end = (pc + temp_addr * 2) & 0xFFFF;
+                cur->loop_cnt = reg[temp_rs];
+                if(cur->loop_cnt == 0)
+                {
+                    pc = cur->loop_end;
+                    cur->loop_end = NO_LOOP;
+                }
             }
         }
+#if TRACE
         printf("%04x\n",pc-2);
         printRegisters();
+#endif
     }
+#if USE_GUARD_PAGES
+    fault_armed = 0;
+#endif
     return 0;
 }
 
+#if CORES > 1
+//========================================
+// Multi-core run
+// - one host thread per core, core 0 starts at the program entry
+// - return exit state of the whole run
+//========================================
+UINT64 core_inst[CORES];	// instructions of each core
+UINT64 core_cycle[CORES];	// cycles of each core (TIMING)
+UINT64 core_stall[CORES];	// stalled cycles of each core (TIMING)
+
+void *coreMain(void *arg) {
+    int c = (int)(size_t)arg;
+
+    cur = &ctx[c];
+    reg = cur->reg;
+    vreg = cur->vreg;
+    if (coreSync() && runProgram(cur->pc) != 0) {
+        core_fault = 1;
+        while (coreSync());	// stay in lockstep until the others see the fault
+    }
+    else if (!run_over) while (coreSync());	// last thread halted here
+    core_inst[c] = inst_cnt;
+    core_cycle[c] = cycle;
+    core_stall[c] = stall_cnt;
+    return NULL;
+}
+
+int runCores() {
+    pthread_t core[CORES];
+    UINT64 max_cycle = 0;
+    int i;
+
+    memset(l1, 0, sizeof(l1));
+    run_over = core_fault = 0;
+    pthread_barrier_init(&core_barrier, NULL, CORES);
+    for (i = 0; i < CORES; i++)
+        if (pthread_create(&core[i], NULL, coreMain, (void *)(size_t)i) != 0) {
+            printf("Error: Host thread for core %d", i);
+            exit(-1);
+        }
+    for (i = 0; i < CORES; i++) {
+        pthread_join(core[i], NULL);
+        inst_cnt += core_inst[i];
+        stall_cnt += core_stall[i];
+        if (core_cycle[i] > max_cycle) max_cycle = core_cycle[i];
+    }
+    cycle += max_cycle;
+    pthread_barrier_destroy(&core_barrier);
+    return core_fault;
+}
+
+// Print L1 and coherence traffic, and the lines invalidated most
+void printCoherence() {
+    UINT top[8] = { 0, };
+    int i, j, k;
+
+    printf("[MESI]\n");
+    printf("cores: %d, L1 %d x %d bytes, quantum %d\n", CORES, L1_LINES, LINE_SIZE, QUANTUM);
+    for (i = 0; i < CORES; i++)
+        printf("core %d: %llu instructions, %llu L1 hits, %llu misses\n", i, core_inst[i], l1_hit[i], l1_miss[i]);
+    printf("bus: %llu BusRd, %llu BusRdX, %llu BusUpgr, %llu writebacks, %llu invalidations\n",
+           bus_rd, bus_rdx, bus_upgr, bus_wb, bus_inval);
+    for (i = 0; i < N_LINES; i++) {	// top 8 by invalidations
+        for (j = 0; j < 8 && line_inval[top[j]] >= line_inval[i]; j++);
+        if (j == 8 || line_inval[i] == 0) continue;
+        for (k = 7; k > j; k--) top[k] = top[k - 1];
+        top[j] = i;
+    }
+    for (j = 0; j < 8 && line_inval[top[j]] > 0; j++)
+        printf("line %04X: %u invalidations, %u false sharing\n",
+               top[j]*LINE_SIZE, line_inval[top[j]], line_false[top[j]]);
+}
+#endif
+
 //========================================
 // Main Function
 //========================================
 int main() {
     int exit_code;		// 0: normal exit, 1: error exit
     UINT start_addr;	// start address of program
+    int job;
 
     printf("========================================\n");
     printf(" picoMIPS Computer Simulator\n");
     printf("     modified by 201602955 Jang Hyeonjun\n");
     printf("========================================\n");
 
-    printf("*** Load ***\n");
-    start_addr = loadProgram();
+#if USE_GUARD_PAGES
+    initMemory();
+#endif
 
-    printf("*** Run ***\n");
-    exit_code = runProgram(start_addr);
+    for (job = 0; job < JOBS; job++) {
+        printf("*** Load ***\n");
+        start_addr = loadProgram();
+#if MMU
+        mmuInit();
+#endif
 
-    printf("*** Exit %d ***\n", exit_code);
+        printf("*** Run ***\n");
+        resetContexts(start_addr);
+        ST_RUN = 0;
+#if CORES > 1
+        exit_code = runCores();
+#else
+        exit_code = runProgram(start_addr);
+#endif
+#if OOO
+        oooFinish();
+#endif
 
-    printMemory("DATA", data_bgn, data_end);
+        printf("*** Exit %d ***\n", exit_code);
+
+        printMemory("DATA", data_bgn, data_end);
+    }
+
+#if RUN_STATS
+    printf("[RUN]\n");
+    printf("instructions: %llu executed\n", inst_cnt);
+#if TIMING
+    printf("cycles: %llu, %llu stalled (IPC %.2f, %d threads, load latency %d)\n",
+           cycle, stall_cnt, cycle ? (double)inst_cnt/cycle : 0.0, THREADS, MEM_LATENCY);
+#endif
+#if CORES > 1
+    printCoherence();
+#endif
+#if OOO
+    printOoo();
+#endif
+#if MMU
+    printMmu();
+#endif
+#endif
 }
@@ -0,0 +1,484 @@
+/*
+ * sieve.c - Segmented Sieve of Eratosthenes for the Prime List
+ *
+ * Native engine for the query of prime_list_c_version: reads A and B and
+ * prints every prime n with A <= n <= B, one per line, as it does
+ *
+ *	gcc -O2 -pthread -o sieve sieve.c
+ *	echo 1 1000000000 | ./sieve [-s KB] [-t threads] [-q] [-scale] > primes.txt
+ *
+ * - base primes up to sqrt(B) by a plain sieve, then [A, B] segment by
+ *   segment; a segment is an odd-only bitset sized to the L1 data cache
+ *   (-s KB: other size, e.g. the L2 size)
+ * - multiples of 3 ~ 13 come from precomputed word patterns instead of
+ *   a pass each
+ * - each base prime keeps the index of its next odd multiple, so a segment
+ *   costs one pass per prime that hits it and no division
+ * - -t n: n threads take chunks of CHUNK_SEGS segments from a pool; each
+ *   keeps its own next multiples, which carry over inside a chunk, and
+ *   lists into a slot of a reorder buffer that the main thread writes out
+ *   in order, so memory stays at SLOTS_PER_THREAD chunks per thread
+ * - -q: no listing, count only (throughput of the sieve itself)
+ * - -scale: count [A, B] with 1 ~ n threads (-t n, default all cores)
+ * - statistics on stderr: [SIEVE], [SCALE]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+//========================================
+// Global Definitions
+//========================================
+
+typedef unsigned long long UINT64;
+typedef unsigned int UINT32;
+
+#define SEG_BYTES	32768		// segment bitset if the L1 size is unknown
+#define MAX_B		10000000000000000ULL	// largest B: base primes below 10^8
+#define OUT_BYTES	0x10000		// output buffer
+#define PRE_PRIMES	5			// 3, 5, 7, 11, 13: crossed off by word patterns
+#define CHUNK_SEGS	4			// segments per task of a thread
+#define SLOTS_PER_THREAD	4	// reorder buffer slots per thread
+#define MAX_THREADS	256
+#define MAX_SEG_KB	262143		// largest -s: 2 * seg_bits and the next multiples fit in UINT32
+
+// Segment state: bit i stands for lo + 2i + 1, 1: composite
+typedef struct {
+    UINT64 lo;			// even start of the segment
+    UINT64 *bits;		// odd-only bitset
+    UINT32 *next;		// per base prime: bit index of its next odd multiple from lo
+    int n_active;		// base primes with p * p below the end of the segment
+    UINT64 n_seg;		// segments sieved
+} SIEVE;
+
+// Output of a range: primes printed as text, or only counted
+typedef struct {
+    char *buf;
+    size_t len, size;
+    int flush;			// 1: write out when full, 0: grow
+    UINT64 n_found;		// primes
+} OUT;
+
+UINT32 *prime = NULL;	// odd base primes up to sqrt(B)
+int n_prime = 0;
+UINT64 seg_bits;		// bits per segment, a multiple of 64
+UINT32 pre_prime[PRE_PRIMES] = {3, 5, 7, 11, 13};
+UINT64 *pre_pat[PRE_PRIMES];	// [k][r]: multiples of pre_prime[k] in a word from odd index r (mod p)
+
+UINT64 n_found = 0;		// primes in [A, B]
+UINT64 n_seg = 0;		// segments sieved
+int quiet = 0;			// 1: count only
+
+// Wall clock in seconds
+double now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// Result of malloc, calloc or realloc; exits if it failed
+void *checked(void *p) {
+    if (p == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+//========================================
+// Base Primes
+//========================================
+
+// Integer square root, floor(sqrt(n))
+UINT64 isqrt64(UINT64 n) {
+    UINT64 r = 0, b;
+
+    for (b = 1ULL << 31; b != 0; b >>= 1) {
+        if ((r + b)*(r + b) <= n) r += b;
+    }
+    return r;
+}
+
+// Upper bound of pi(x): 1.25506 x / ln x (Rosser and Schoenfeld) with
+// ln x taken down to floor(log2 x) ln 2
+UINT64 primeBound(UINT64 x) {
+    int l = 0;
+
+    if (x < 2) return 1;
+    while ((x >> (l + 1)) != 0) l++;
+    return (UINT64)(1.25506*(double)x/(l*0.693147)) + 1;
+}
+
+// Odd primes up to max by a byte sieve over the odd numbers
+void basePrimes(UINT64 max) {
+    UINT64 n = (max + 1)/2, i, j;	// flag i stands for 2i + 1
+    char *flag = checked(calloc(n + 1, 1));
+
+    prime = checked(malloc(sizeof(UINT32)*primeBound(max)));
+    for (i = 1; i < n; i++) {
+        if (flag[i]) continue;
+        prime[n_prime++] = (UINT32)(2*i + 1);
+        for (j = 2*i*(i + 1); j < n; j += 2*i + 1) flag[j] = 1;
+    }
+    free(flag);
+}
+
+// Word patterns of the pre-sieve primes: odd index g stands for 2g + 1,
+// a multiple of p if g = (p - 1) / 2 (mod p)
+void prePatterns() {
+    UINT32 k, r, b;
+
+    for (k = 0; k < PRE_PRIMES; k++) {
+        UINT32 p = pre_prime[k];
+
+        pre_pat[k] = checked(calloc(p, sizeof(UINT64)));
+        for (r = 0; r < p; r++) {
+            for (b = 0; b < 64; b++) {
+                if ((r + b) % p == (p - 1)/2) pre_pat[k][r] |= 1ULL << b;
+            }
+        }
+    }
+}
+
+//========================================
+// Segments
+//========================================
+
+void sieveInit(SIEVE *s) {
+    s->lo = 0;
+    s->bits = checked(malloc(seg_bits/8));
+    s->next = checked(malloc(sizeof(UINT32)*(n_prime + 1)));
+    s->n_active = 0;
+    s->n_seg = 0;
+}
+
+void sieveFree(SIEVE *s) {
+    free(s->bits);
+    free(s->next);
+}
+
+// Sieve the segment [lo, lo + 2 * seg_bits); lo is even
+// - moving on from the previous segment keeps the next multiples,
+//   any other lo computes them again
+void sieveSegment(SIEVE *s, UINT64 lo) {
+    UINT64 hi = lo + 2*seg_bits;
+    UINT64 *bits = s->bits;
+    UINT32 r[PRE_PRIMES], step[PRE_PRIMES];
+    UINT64 i;
+    int k;
+
+    if (s->n_active > 0 && lo == s->lo + 2*seg_bits) {
+        for (k = 0; k < s->n_active; k++) s->next[k] -= (UINT32)seg_bits;
+    }
+    else s->n_active = 0;
+    s->lo = lo;
+    for (k = 0; k < PRE_PRIMES; k++) {
+        r[k] = (UINT32)(lo/2 % pre_prime[k]);
+        step[k] = 64 % pre_prime[k];
+    }
+    for (i = 0; i < seg_bits/64; i++) {
+        UINT64 w = 0;
+
+        for (k = 0; k < PRE_PRIMES; k++) {
+            w |= pre_pat[k][r[k]];
+            r[k] += step[k];
+            if (r[k] >= pre_prime[k]) r[k] -= pre_prime[k];
+        }
+        bits[i] = w;
+    }
+    for (k = 0; k < PRE_PRIMES; k++) {
+        if (pre_prime[k] < lo) continue;
+        i = (pre_prime[k] - lo)/2;		// the pre-sieve prime itself
+        bits[i >> 6] &= ~(1ULL << (i & 63));
+    }
+    if (lo == 0) bits[0] |= 1;	// 1 is not a prime
+    for (; s->n_active < n_prime && (UINT64)prime[s->n_active]*prime[s->n_active] < hi; s->n_active++) {
+        UINT64 p = prime[s->n_active];
+        UINT64 m = p*p;
+
+        if (m <= lo) m = (lo/p + 1)*p;
+        if ((m & 1) == 0) m += p;	// odd multiple
+        s->next[s->n_active] = (UINT32)((m - lo)/2);
+    }
+    for (k = (s->n_active < PRE_PRIMES) ? s->n_active : PRE_PRIMES; k < s->n_active; k++) {
+        UINT64 p = prime[k];
+        UINT64 j = s->next[k];
+
+        for (; j < seg_bits; j += p) bits[j >> 6] |= 1ULL << (j & 63);
+        s->next[k] = (UINT32)j;
+    }
+    s->n_seg++;
+}
+
+//========================================
+// Output
+//========================================
+
+void outInit(OUT *o, int flush) {
+    o->size = OUT_BYTES;
+    o->buf = checked(malloc(o->size));
+    o->len = 0;
+    o->flush = flush;
+    o->n_found = 0;
+}
+
+void outWrite(OUT *o) {
+    fwrite(o->buf, 1, o->len, stdout);
+    o->len = 0;
+}
+
+// Print n as printf("%d\n", n) does
+void putPrime(OUT *o, UINT64 n) {
+    char d[24];
+    int i = 0;
+
+    if (o->len + 24 > o->size) {
+        if (o->flush) outWrite(o);
+        else o->buf = checked(realloc(o->buf, o->size *= 2));
+    }
+    do {
+        d[i++] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n != 0);
+    while (i > 0) o->buf[o->len++] = d[--i];
+    o->buf[o->len++] = '\n';
+}
+
+// List the primes of the segment in [a, b]
+void listSegment(SIEVE *s, UINT64 a, UINT64 b, OUT *o) {
+    UINT64 i, j, end, w;
+
+    i = (a > s->lo) ? (a - s->lo)/2 : 0;			// first bit >= a
+    end = (b - s->lo + 1)/2;						// bits below b + 1
+    if (end > seg_bits) end = seg_bits;
+    for (j = i & ~63ULL; j < end; j += 64) {
+        w = ~s->bits[j >> 6];
+        if (j < i) w &= ~0ULL << (i - j);
+        if (end - j < 64) w &= (1ULL << (end - j)) - 1;
+        if (quiet) o->n_found += __builtin_popcountll(w);
+        else {
+            for (; w != 0; w &= w - 1) {
+                putPrime(o, s->lo + 2*(j + __builtin_ctzll(w)) + 1);
+                o->n_found++;
+            }
+        }
+    }
+}
+
+//========================================
+// Thread Pool
+// - chunk c is the segments from lo0 + c * CHUNK_SEGS segments; a thread
+//   takes the next chunk once its slot c % n_slot is written out
+// - the main thread writes the slots out in chunk order
+//========================================
+
+typedef struct {
+    OUT out;
+    int done;			// 1: chunk listed, not written yet
+} SLOT;
+
+SLOT *slot = NULL;		// reorder buffer
+int n_slot = 0;
+UINT64 range_a, range_b, lo0;	// range and start of chunk 0
+UINT64 n_chunk;			// chunks in the range
+UINT64 next_chunk;		// next chunk to hand out
+UINT64 n_written;		// chunks written out
+
+pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+
+// Worker thread: sieve and list chunks until the range is done
+void *worker(void *arg) {
+    SIEVE *s = arg;
+    UINT64 c, lo;
+    SLOT *t;
+    int k;
+
+    for (;;) {
+        pthread_mutex_lock(&pool_lock);
+        while (next_chunk < n_chunk && next_chunk >= n_written + n_slot) pthread_cond_wait(&pool_cond, &pool_lock);
+        c = next_chunk;
+        if (c < n_chunk) next_chunk++;
+        pthread_mutex_unlock(&pool_lock);
+        if (c >= n_chunk) return NULL;
+
+        t = &slot[c % n_slot];
+        lo = lo0 + c*CHUNK_SEGS*2*seg_bits;
+        for (k = 0; k < CHUNK_SEGS && lo <= range_b; k++, lo += 2*seg_bits) {
+            sieveSegment(s, lo);
+            listSegment(s, range_a, range_b, &t->out);
+        }
+
+        pthread_mutex_lock(&pool_lock);
+        t->done = 1;
+        pthread_cond_broadcast(&pool_cond);
+        pthread_mutex_unlock(&pool_lock);
+    }
+}
+
+// List [a, b] with n threads; a >= 2, b >= a
+// - one thread sieves in the main thread, segment after segment
+void sieveRange(UINT64 a, UINT64 b, int threads) {
+    pthread_t tid[MAX_THREADS];
+    SIEVE s[MAX_THREADS];
+    OUT o;
+    UINT64 c, lo;
+    int k;
+
+    outInit(&o, 1);
+    if (a == 2) {
+        if (!quiet) putPrime(&o, 2);
+        o.n_found++;
+    }
+    lo0 = a & ~1ULL;
+    if (threads == 1) {
+        sieveInit(&s[0]);
+        for (lo = lo0; lo <= b; lo += 2*seg_bits) {
+            sieveSegment(&s[0], lo);
+            listSegment(&s[0], a, b, &o);
+        }
+        outWrite(&o);
+        n_found += o.n_found;
+        n_seg += s[0].n_seg;
+        sieveFree(&s[0]);
+        free(o.buf);
+        return;
+    }
+    outWrite(&o);
+    n_found += o.n_found;
+    free(o.buf);
+
+    range_a = a;
+    range_b = b;
+    n_chunk = (b - lo0)/(CHUNK_SEGS*2*seg_bits) + 1;
+    next_chunk = 0;
+    n_written = 0;
+    n_slot = SLOTS_PER_THREAD*threads;
+    slot = checked(malloc(sizeof(SLOT)*n_slot));
+    for (k = 0; k < n_slot; k++) {
+        outInit(&slot[k].out, 0);
+        slot[k].done = 0;
+    }
+    for (k = 0; k < threads; k++) {
+        sieveInit(&s[k]);
+        if (pthread_create(&tid[k], NULL, worker, &s[k]) != 0) {
+            fprintf(stderr, "Error: cannot start thread %d\n", k);
+            exit(1);
+        }
+    }
+    for (c = 0; c < n_chunk; c++) {
+        SLOT *t = &slot[c % n_slot];
+
+        pthread_mutex_lock(&pool_lock);
+        while (!t->done) pthread_cond_wait(&pool_cond, &pool_lock);
+        pthread_mutex_unlock(&pool_lock);
+        outWrite(&t->out);
+        n_found += t->out.n_found;
+        t->out.n_found = 0;
+
+        pthread_mutex_lock(&pool_lock);
+        t->done = 0;
+        n_written++;
+        pthread_cond_broadcast(&pool_cond);
+        pthread_mutex_unlock(&pool_lock);
+    }
+    for (k = 0; k < threads; k++) {
+        pthread_join(tid[k], NULL);
+        n_seg += s[k].n_seg;
+        sieveFree(&s[k]);
+    }
+    for (k = 0; k < n_slot; k++) free(slot[k].out.buf);
+    free(slot);
+}
+
+//========================================
+// Main
+//========================================
+
+// Usage on stderr; returns the exit status
+int usage() {
+    fprintf(stderr, "usage: sieve [-s KB] [-t threads] [-q] [-scale] < A B\n");
+    fprintf(stderr, "  -s KB: segment size, 1 ~ %d\n", MAX_SEG_KB);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    long long a, b;
+    UINT64 bytes = 0;
+    double sec, sec1 = 0;
+    int threads = 0, scale = 0, cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    long kb;
+    char *end;
+    int i, t;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            kb = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || kb < 1 || kb > MAX_SEG_KB) return usage();
+            bytes = (UINT64)kb*1024;
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-q") == 0) quiet = 1;
+        else if (strcmp(argv[i], "-scale") == 0) scale = quiet = 1;
+        else return usage();
+    }
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+    if (bytes == 0 && sysconf(_SC_LEVEL1_DCACHE_SIZE) > 0) bytes = (UINT64)sysconf(_SC_LEVEL1_DCACHE_SIZE);
+#endif
+    if (bytes == 0) bytes = SEG_BYTES;
+    seg_bits = (bytes*8 + 63) & ~63ULL;
+    if (cores < 1) cores = 1;
+    if (threads == 0) threads = scale ? cores : 1;
+    if (threads < 1 || threads > MAX_THREADS) {
+        fprintf(stderr, "Error: threads must be 1 ~ %d\n", MAX_THREADS);
+        return 1;
+    }
+    if (scanf("%lld", &a) != 1 || scanf("%lld", &b) != 1) return 1;
+    if (a < 2) a = 2;	// an empty range (B < A, B < 2) lists nothing, as the reference does
+    if (b >= a && (UINT64)b > MAX_B) {
+        fprintf(stderr, "Error: B > %llu\n", MAX_B);
+        return 1;
+    }
+
+    if (scale) {
+        if (b < a) return 0;
+        basePrimes(isqrt64((UINT64)b));
+        prePatterns();
+        fprintf(stderr, "[SCALE]\n");
+        fprintf(stderr, "range: %lld ~ %lld, %d cores\n", a, b, cores);
+        fprintf(stderr, "threads     time   M numbers/s  speedup\n");
+        for (t = 1; t <= threads; t++) {
+            n_found = 0;
+            sec = now();
+            sieveRange((UINT64)a, (UINT64)b, t);
+            sec = now() - sec;
+            if (t == 1) sec1 = sec;
+            fprintf(stderr, "%7d %8.3f %13.1f %8.2f\n", t, sec, (double)(b - a + 1)/sec/1e6, sec1/sec);
+        }
+        fprintf(stderr, "primes: %llu\n", n_found);
+        return 0;
+    }
+
+    sec = now();
+    if (b >= a) {
+        basePrimes(isqrt64((UINT64)b));
+        prePatterns();
+        sieveRange((UINT64)a, (UINT64)b, threads);
+    }
+    fflush(stdout);
+    sec = now() - sec;
+
+    fprintf(stderr, "[SIEVE]\n");
+    fprintf(stderr, "range: %lld ~ %lld, %d base primes\n", a, b, n_prime);
+    fprintf(stderr, "segments: %llu x %llu KB (%llu numbers), %d threads\n", n_seg, seg_bits/8/1024, 2*seg_bits, threads);
+    fprintf(stderr, "primes: %llu\n", n_found);
+    if (b >= a && sec > 0) {
+        fprintf(stderr, "time: %.3f s, %.1f M numbers/s\n", sec, (double)(b - a + 1)/sec/1e6);
+    }
+    return 0;
+}